@@ -0,0 +1,10 @@
+#version 300 es
+precision mediump float;
+
+in vec4 v_color;
+
+out vec4 Color;
+
+void main() {
+	Color = v_color;
+}
@@ -0,0 +1,18 @@
+#version 300 es
+precision mediump float;
+
+uniform mat4 u_projection;
+uniform mat4 u_view;
+// grid to screen
+uniform vec2 u_offset;
+uniform vec2 u_scale;
+
+in vec2 a_pos;
+in vec4 a_color;
+
+out vec4 v_color;
+
+void main() {
+	v_color = a_color;
+	gl_Position = u_projection * u_view * vec4(u_offset + a_pos * u_scale, 0.0, 1.0);
+}
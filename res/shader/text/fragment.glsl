@@ -2,6 +2,8 @@
 precision mediump float;
 
 uniform sampler2D u_texture;
+// set by fontatlas_setup_shader(), glyphs are signed distance fields
+uniform bool u_sdf;
 
 in vec2 v_texcoord;
 in vec4 v_color_mult;
@@ -9,25 +11,20 @@ in vec4 v_color_add;
 
 out vec4 Color;
 
-#define RENDER_NORMAL
-
 void main() {
 	vec4 pixel = vec4(0.0, 0.0, 0.0, 1.0);
-
-#ifdef RENDER_SDF
-	float dist = texture(u_texture, v_texcoord).a;
-
-	float smoothing = 1.0/5.0;
-	float border = 0.5;
-	float alpha = smoothstep(border - smoothing, border + smoothing, dist);
-	pixel = vec4(v_color_add.rgb, alpha);
-#endif
-
-#ifdef RENDER_NORMAL
 	pixel.rgb = v_color_add.rgb;
-	pixel.a = texture(u_texture, v_texcoord).a;
-#endif
+
+	if (u_sdf) {
+		// the edge is at 0.5, smooth over roughly one screen pixel
+		// so the text stays sharp at every scale.
+		float dist = texture(u_texture, v_texcoord).a;
+		float smoothing = max(fwidth(dist) * 0.75, 1.0 / 255.0);
+		float border = 0.5;
+		pixel.a = smoothstep(border - smoothing, border + smoothing, dist);
+	} else {
+		pixel.a = texture(u_texture, v_texcoord).a;
+	}
 
 	Color = pixel;
 }
-
@@ -0,0 +1,217 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cJSON.h>
+#include "util/util.h"
+#include "util/fs.h"
+#include "net/message.h"
+#include "bench/common/alloc_count.h"
+
+// Encode & decode throughput of the message wire formats.
+//
+//   ./run_bench_messages [--iterations=100000] [--json=FILE]
+//
+// Allocations are counted by wrapping malloc & co. at link time, see
+// bench/common/alloc_count.h.
+
+enum bench_message {
+	BENCH_LOBBY_CREATE_REQUEST,
+	BENCH_LOBBY_JOIN_RESPONSE,
+	BENCH_LOBBY_LIST_RESPONSE,
+	BENCH_MESSAGE_COUNT
+};
+
+static const char *wire_format_names[MESSAGE_WIRE_FORMAT_MAX] = {
+	[MESSAGE_WIRE_JSON]   = "json",
+	[MESSAGE_WIRE_BINARY] = "binary",
+};
+
+struct bench_result {
+	enum message_type type;
+	enum message_wire_format format;
+	usize iterations;
+	usize bytes;
+	double encode_ms;
+	double decode_ms;
+	usize encode_allocations;
+	usize decode_allocations;
+};
+
+union bench_message_storage {
+	struct message_header header;
+	struct lobby_create_request lobby_create_request;
+	struct lobby_join_response lobby_join_response;
+	struct lobby_list_response lobby_list_response;
+};
+
+// keeps the compiler from dropping the decoded messages.
+static volatile int g_checksum;
+
+//
+// private functions
+//
+
+static void init_message(union bench_message_storage *storage, enum bench_message message) {
+	switch (message) {
+	case BENCH_LOBBY_CREATE_REQUEST:
+		message_header_init(&storage->header, LOBBY_CREATE_REQUEST);
+		storage->lobby_create_request.lobby_id = 0;
+		storage->lobby_create_request.lobby_name = "Friday night hexes";
+		break;
+	case BENCH_LOBBY_JOIN_RESPONSE:
+		message_header_init(&storage->header, LOBBY_JOIN_RESPONSE);
+		storage->lobby_join_response.lobby_id = 73921;
+		storage->lobby_join_response.join_error = 0;
+		storage->lobby_join_response.is_other_user = 1;
+		break;
+	case BENCH_LOBBY_LIST_RESPONSE:
+		message_header_init(&storage->header, LOBBY_LIST_RESPONSE);
+		storage->lobby_list_response.ids_of_lobbies_len = 8;
+		for (int i = 0; i < 8; ++i) {
+			storage->lobby_list_response.ids_of_lobbies[i] = 1000 + i * 4099;
+		}
+		break;
+	case BENCH_MESSAGE_COUNT:
+		assert(0);
+		break;
+	}
+}
+
+static void bench_json(struct bench_result *result, struct message_header *message, usize iterations) {
+	cJSON *json = pack_message(message);
+	char *encoded = cJSON_PrintUnformatted(json);
+	result->bytes = strlen(encoded);
+	cJSON_Delete(json);
+
+	usize allocations = bench_allocations();
+	Uint64 begin = profile_begin();
+	for (usize i = 0; i < iterations; ++i) {
+		cJSON *packed = pack_message(message);
+		char *str = cJSON_PrintUnformatted(packed);
+		g_checksum += str[0];
+		free(str);
+		cJSON_Delete(packed);
+	}
+	result->encode_ms = profile_end_ms(begin);
+	result->encode_allocations = bench_allocations() - allocations;
+
+	allocations = bench_allocations();
+	begin = profile_begin();
+	for (usize i = 0; i < iterations; ++i) {
+		cJSON *parsed = cJSON_ParseWithLength(encoded, result->bytes);
+		struct message_header *decoded = unpack_message(parsed);
+		g_checksum += decoded->type;
+		free_message(parsed, decoded);
+	}
+	result->decode_ms = profile_end_ms(begin);
+	result->decode_allocations = bench_allocations() - allocations;
+
+	free(encoded);
+}
+
+static void bench_binary(struct bench_result *result, struct message_header *message, usize iterations) {
+	uint8_t encoded[512];
+	result->bytes = message_binary_encode(message, encoded, sizeof(encoded));
+	assert(result->bytes > 0);
+
+	usize allocations = bench_allocations();
+	Uint64 begin = profile_begin();
+	for (usize i = 0; i < iterations; ++i) {
+		uint8_t frame[512];
+		const size_t frame_len = message_binary_encode(message, frame, sizeof(frame));
+		g_checksum += frame[frame_len - 1];
+	}
+	result->encode_ms = profile_end_ms(begin);
+	result->encode_allocations = bench_allocations() - allocations;
+
+	allocations = bench_allocations();
+	begin = profile_begin();
+	for (usize i = 0; i < iterations; ++i) {
+		message_buffer_t buffer;
+		struct message_header *decoded = NULL;
+		size_t frame_len;
+		const enum message_decode_result decode_result = message_binary_decode(encoded, result->bytes, &frame_len, &buffer, &decoded);
+		assert(decode_result == MESSAGE_DECODE_OK);
+		(void)decode_result;
+		g_checksum += decoded->type;
+	}
+	result->decode_ms = profile_end_ms(begin);
+	result->decode_allocations = bench_allocations() - allocations;
+}
+
+static void print_table(usize results_len, const struct bench_result results[results_len]) {
+	printf("%-22s %-7s %6s %12s %12s %14s %14s\n", "message", "format", "bytes", "ns/encode", "ns/decode", "allocs/encode", "allocs/decode");
+	for (usize i = 0; i < results_len; ++i) {
+		const struct bench_result *r = &results[i];
+		const double iterations = (r->iterations > 0) ? (double)r->iterations : 1.0;
+		printf("%-22s %-7s %6lu %12.1f %12.1f %14.2f %14.2f\n",
+				message_type_to_name(r->type), wire_format_names[r->format], r->bytes,
+				r->encode_ms * 1e6 / iterations, r->decode_ms * 1e6 / iterations,
+				r->encode_allocations / iterations, r->decode_allocations / iterations);
+	}
+}
+
+static cJSON *results_to_json(usize results_len, const struct bench_result results[results_len]) {
+	cJSON *json = cJSON_CreateObject();
+	cJSON *json_results = cJSON_AddArrayToObject(json, "results");
+	for (usize i = 0; i < results_len; ++i) {
+		const struct bench_result *r = &results[i];
+		cJSON *json_result = cJSON_CreateObject();
+		cJSON_AddStringToObject(json_result, "message", message_type_to_name(r->type));
+		cJSON_AddStringToObject(json_result, "format", wire_format_names[r->format]);
+		cJSON_AddNumberToObject(json_result, "iterations", r->iterations);
+		cJSON_AddNumberToObject(json_result, "bytes", r->bytes);
+		cJSON_AddNumberToObject(json_result, "encode_ms", r->encode_ms);
+		cJSON_AddNumberToObject(json_result, "decode_ms", r->decode_ms);
+		cJSON_AddNumberToObject(json_result, "encode_allocations", r->encode_allocations);
+		cJSON_AddNumberToObject(json_result, "decode_allocations", r->decode_allocations);
+		cJSON_AddItemToArray(json_results, json_result);
+	}
+	return json;
+}
+
+int main(int argc, char **argv) {
+	usize iterations = 100000;
+	const char *json_path = NULL;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strncmp(argv[i], "--iterations=", 13) == 0) {
+			iterations = strtoul(argv[i] + 13, NULL, 10);
+		} else if (strncmp(argv[i], "--json=", 7) == 0) {
+			json_path = argv[i] + 7;
+		} else {
+			fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	struct bench_result results[BENCH_MESSAGE_COUNT * MESSAGE_WIRE_FORMAT_MAX];
+	for (enum bench_message m = 0; m < BENCH_MESSAGE_COUNT; ++m) {
+		union bench_message_storage storage;
+		init_message(&storage, m);
+
+		for (enum message_wire_format format = 0; format < MESSAGE_WIRE_FORMAT_MAX; ++format) {
+			struct bench_result *result = &results[m * MESSAGE_WIRE_FORMAT_MAX + format];
+			*result = (struct bench_result){ .type = storage.header.type, .format = format, .iterations = iterations };
+			if (format == MESSAGE_WIRE_BINARY) {
+				bench_binary(result, &storage.header, iterations);
+			} else {
+				bench_json(result, &storage.header, iterations);
+			}
+		}
+	}
+	print_table(BENCH_MESSAGE_COUNT * MESSAGE_WIRE_FORMAT_MAX, results);
+
+	if (json_path != NULL) {
+		cJSON *json = results_to_json(BENCH_MESSAGE_COUNT * MESSAGE_WIRE_FORMAT_MAX, results);
+		const int write_error = fs_writefile_json(json_path, json);
+		cJSON_Delete(json);
+		if (write_error != FS_OK) {
+			fprintf(stderr, "Could not write %s\n", json_path);
+			return 1;
+		}
+	}
+
+	return 0;
+}
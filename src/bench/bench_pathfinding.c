@@ -0,0 +1,240 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cJSON.h>
+#include "util/util.h"
+#include "util/fs.h"
+#include "game/hexmap.h"
+#include "bench/common/alloc_count.h"
+
+// Pathfinding benchmarks over generated hexmaps.
+//
+//   ./run_bench_pathfinding [--sizes=64,256,1024,2048] [--queries=100] [--seed=1] [--json=FILE]
+//
+// Allocations are counted by wrapping malloc & co. at link time, see
+// bench/common/alloc_count.h.
+
+#define BENCH_MAX_SIZES 8
+
+enum query_set {
+	QUERY_RANDOM_PAIRS,
+	QUERY_CORRIDOR,
+	QUERY_UNREACHABLE,
+	QUERY_FLOWFIELD,
+	QUERY_SET_COUNT
+};
+
+static const char *query_set_names[QUERY_SET_COUNT] = {
+	[QUERY_RANDOM_PAIRS] = "random_pairs",
+	[QUERY_CORRIDOR]     = "corridor",
+	[QUERY_UNREACHABLE]  = "unreachable",
+	[QUERY_FLOWFIELD]    = "flowfield",
+};
+
+struct bench_result {
+	int size;
+	enum query_set set;
+	usize queries;
+	usize found;
+	double total_ms;
+	usize expanded;
+	usize allocations;
+};
+
+//
+// private functions
+//
+
+static struct hexcoord random_free_coord(struct hexmap *map) {
+	for (;;) {
+		struct hexcoord coord = { .x = rng_i() % map->w, .y = rng_i() % map->h };
+		if (!hexmap_is_tile_obstacle(map, coord)) {
+			return coord;
+		}
+	}
+}
+
+// 20% obstacles, the remaining tiles cost between 1 and 4.
+static void generate_random_map(struct hexmap *map, int size) {
+	hexmap_init(map, size, size);
+	for (int i = 0; i < size * size; ++i) {
+		const struct hexcoord coord = hexmap_index_to_coord(map, i);
+		hexmap_set_movement_cost(map, coord, (rng_f() < 0.2f) ? HEXMAP_MOVEMENT_COST_MAX : 1 + rng_i() % 4);
+	}
+}
+
+// A single corridor winding through the whole map, every fourth row is a
+// wall with a gap on alternating sides.
+static void generate_corridor_map(struct hexmap *map, int size) {
+	hexmap_init(map, size, size);
+	for (int y = 2; y < size; y += 4) {
+		const int gap = ((y / 4) % 2 == 0) ? size - 1 : 0;
+		for (int x = 0; x < size; ++x) {
+			if (x != gap) {
+				hexmap_set_movement_cost(map, (struct hexcoord){ .x=x, .y=y }, HEXMAP_MOVEMENT_COST_MAX);
+			}
+		}
+	}
+}
+
+static void run_path_queries(struct bench_result *result, struct hexmap *map, usize queries_len, const struct hexcoord starts[], const struct hexcoord goals[]) {
+	result->queries = queries_len;
+	for (usize i = 0; i < queries_len; ++i) {
+		struct hexmap_path path;
+		const usize allocations = bench_allocations();
+		const Uint64 begin = profile_begin();
+		const enum hexmap_path_result path_result = hexmap_path_find(map, starts[i], goals[i], &path);
+		result->total_ms += profile_end_ms(begin);
+		result->allocations += bench_allocations() - allocations;
+		result->expanded += map->path_workspace.expanded;
+		result->found += (path_result == HEXMAP_PATH_OK);
+		hexmap_path_destroy(&path);
+	}
+}
+
+static void run_flowfield_queries(struct bench_result *result, struct hexmap *map, usize queries_len, usize *flowfield) {
+	const usize map_size = (usize)map->w * map->h;
+	result->queries = queries_len;
+	for (usize i = 0; i < queries_len; ++i) {
+		const struct hexcoord origin = random_free_coord(map);
+		const usize allocations = bench_allocations();
+		const Uint64 begin = profile_begin();
+		hexmap_generate_flowfield(map, origin, map_size, flowfield);
+		result->total_ms += profile_end_ms(begin);
+		result->allocations += bench_allocations() - allocations;
+		result->expanded += map->path_workspace.expanded;
+		++result->found;
+	}
+}
+
+static void bench_size(int size, usize queries_len, struct bench_result results[QUERY_SET_COUNT]) {
+	struct hexcoord *starts = malloc(queries_len * sizeof(*starts));
+	struct hexcoord *goals = malloc(queries_len * sizeof(*goals));
+	// the big searches take a while, a few of them are enough.
+	const usize expensive_len = (queries_len < 3) ? queries_len : 3;
+
+	for (enum query_set set = 0; set < QUERY_SET_COUNT; ++set) {
+		results[set] = (struct bench_result){ .size = size, .set = set };
+	}
+
+	struct hexmap map;
+	generate_random_map(&map, size);
+	usize *flowfield = malloc((usize)size * size * sizeof(*flowfield));
+	// grow the workspace once, like any map that is in use for a while.
+	hexmap_generate_flowfield(&map, random_free_coord(&map), (usize)size * size, flowfield);
+
+	for (usize i = 0; i < queries_len; ++i) {
+		starts[i] = random_free_coord(&map);
+		goals[i] = random_free_coord(&map);
+	}
+	run_path_queries(&results[QUERY_RANDOM_PAIRS], &map, queries_len, starts, goals);
+
+	// goals walled in by their neighbors, the whole reachable area is searched.
+	for (usize i = 0; i < expensive_len; ++i) {
+		starts[i] = random_free_coord(&map);
+		goals[i] = random_free_coord(&map);
+		for (enum hexmap_neighbor n = HEXMAP_N_FIRST; n <= HEXMAP_N_LAST; ++n) {
+			const struct hexcoord wall = hexmap_get_neighbor_coord(&map, goals[i], n);
+			if (hexmap_is_valid_coord(&map, wall) && !hexcoord_equal(wall, starts[i])) {
+				hexmap_set_movement_cost(&map, wall, HEXMAP_MOVEMENT_COST_MAX);
+			}
+		}
+	}
+	run_path_queries(&results[QUERY_UNREACHABLE], &map, expensive_len, starts, goals);
+
+	run_flowfield_queries(&results[QUERY_FLOWFIELD], &map, expensive_len, flowfield);
+	hexmap_destroy(&map);
+
+	// from one end of the corridor to the other.
+	generate_corridor_map(&map, size);
+	hexmap_generate_flowfield(&map, (struct hexcoord){ .x=0, .y=0 }, (usize)size * size, flowfield);
+	const int last_free_row = ((size - 1) % 4 == 2) ? size - 2 : size - 1;
+	for (usize i = 0; i < expensive_len; ++i) {
+		starts[i] = (struct hexcoord){ .x=0, .y=0 };
+		goals[i] = (struct hexcoord){ .x=size - 1, .y=last_free_row };
+	}
+	run_path_queries(&results[QUERY_CORRIDOR], &map, expensive_len, starts, goals);
+	hexmap_destroy(&map);
+
+	free(flowfield);
+	free(goals);
+	free(starts);
+}
+
+static void print_table(usize results_len, const struct bench_result results[results_len]) {
+	printf("%6s  %-13s %7s %7s %12s %14s %12s\n", "size", "queries", "count", "found", "us/query", "expanded/query", "allocs/query");
+	for (usize i = 0; i < results_len; ++i) {
+		const struct bench_result *r = &results[i];
+		const double queries = (r->queries > 0) ? (double)r->queries : 1.0;
+		printf("%6d  %-13s %7lu %7lu %12.1f %14.1f %12.2f\n",
+				r->size, query_set_names[r->set], r->queries, r->found,
+				r->total_ms * 1000.0 / queries, r->expanded / queries, r->allocations / queries);
+	}
+}
+
+static cJSON *results_to_json(usize results_len, const struct bench_result results[results_len], uint64_t seed) {
+	cJSON *json = cJSON_CreateObject();
+	cJSON_AddNumberToObject(json, "seed", (double)seed);
+	cJSON *json_results = cJSON_AddArrayToObject(json, "results");
+	for (usize i = 0; i < results_len; ++i) {
+		const struct bench_result *r = &results[i];
+		cJSON *json_result = cJSON_CreateObject();
+		cJSON_AddNumberToObject(json_result, "size", r->size);
+		cJSON_AddStringToObject(json_result, "queries", query_set_names[r->set]);
+		cJSON_AddNumberToObject(json_result, "count", r->queries);
+		cJSON_AddNumberToObject(json_result, "found", r->found);
+		cJSON_AddNumberToObject(json_result, "total_ms", r->total_ms);
+		cJSON_AddNumberToObject(json_result, "expanded", r->expanded);
+		cJSON_AddNumberToObject(json_result, "allocations", r->allocations);
+		cJSON_AddItemToArray(json_results, json_result);
+	}
+	return json;
+}
+
+int main(int argc, char **argv) {
+	int sizes[BENCH_MAX_SIZES] = { 64, 256, 1024, 2048 };
+	usize sizes_len = 4;
+	usize queries_len = 100;
+	uint64_t seed = 1;
+	const char *json_path = NULL;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strncmp(argv[i], "--sizes=", 8) == 0) {
+			sizes_len = 0;
+			for (char *size = strtok(argv[i] + 8, ","); size != NULL && sizes_len < BENCH_MAX_SIZES; size = strtok(NULL, ",")) {
+				sizes[sizes_len++] = atoi(size);
+			}
+		} else if (strncmp(argv[i], "--queries=", 10) == 0) {
+			queries_len = strtoul(argv[i] + 10, NULL, 10);
+		} else if (strncmp(argv[i], "--seed=", 7) == 0) {
+			seed = strtoull(argv[i] + 7, NULL, 10);
+		} else if (strncmp(argv[i], "--json=", 7) == 0) {
+			json_path = argv[i] + 7;
+		} else {
+			fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	struct bench_result results[BENCH_MAX_SIZES * QUERY_SET_COUNT];
+	for (usize i = 0; i < sizes_len; ++i) {
+		assert(sizes[i] > 0);
+		rng_seed(seed);
+		bench_size(sizes[i], queries_len, &results[i * QUERY_SET_COUNT]);
+	}
+	print_table(sizes_len * QUERY_SET_COUNT, results);
+
+	if (json_path != NULL) {
+		cJSON *json = results_to_json(sizes_len * QUERY_SET_COUNT, results, seed);
+		const int write_error = fs_writefile_json(json_path, json);
+		cJSON_Delete(json);
+		if (write_error != FS_OK) {
+			fprintf(stderr, "Could not write %s\n", json_path);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
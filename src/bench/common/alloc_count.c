@@ -0,0 +1,28 @@
+#include "bench/common/alloc_count.h"
+
+#include <stddef.h>
+
+static usize g_allocations;
+
+void *__real_malloc(size_t);
+void *__real_calloc(size_t, size_t);
+void *__real_realloc(void *, size_t);
+
+void *__wrap_malloc(size_t size) {
+	++g_allocations;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+	++g_allocations;
+	return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+	++g_allocations;
+	return __real_realloc(ptr, size);
+}
+
+usize bench_allocations(void) {
+	return g_allocations;
+}
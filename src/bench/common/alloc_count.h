@@ -0,0 +1,10 @@
+#ifndef BENCH_ALLOC_COUNT_H
+#define BENCH_ALLOC_COUNT_H
+
+#include "util/util.h"
+
+// Number of calls to malloc, calloc & realloc so far. Counted by wrapping
+// them at link time, see the `bench` target in the Makefile.
+usize bench_allocations(void);
+
+#endif
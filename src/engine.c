@@ -1,5 +1,6 @@
 #include "engine.h"
 #include <assert.h>
+#include <signal.h>
 #include <SDL.h>
 #include <SDL_mixer.h>
 #include <SDL_net.h>
@@ -17,18 +18,26 @@
 #include "gl/shader.h"
 #include "gui/console.h"
 #include "net/message.h"
+#include "net/net_thread.h"
 #include "util/util.h"
 
+// time spent handling received messages per frame, the rest waits for the next one.
+#define GAMESERVER_RECEIVE_BUDGET_MS 2.0
+// stop reading from the socket once this much is buffered.
+#define GAMESERVER_RECEIVE_MAX_PENDING (256 * 1024)
+#define GAMESERVER_RECEIVE_CHUNK 4096
+
 static Uint32 USR_EVENT_RELOAD = ((Uint32)-1);
-static Uint32 USR_EVENT_NOTIFY = ((Uint32)-1);
 static Uint32 USR_EVENT_GOBACK = ((Uint32)-1);
+// set by SIGUSR2, the notify callbacks run at the next engine_update.
+static volatile sig_atomic_t g_notify_pending = 0;
 
 static void on_window_resized(struct engine *engine, int w, int h);
 static void engine_poll_events(struct engine *engine);
 static void engine_gameserver_receive(struct engine *engine);
+static void engine_gameserver_poll_net(struct engine *engine);
 
 #ifdef __unix__
-#include <signal.h>
 void on_sigusr1(int signum) {
 	if (USR_EVENT_RELOAD != ((Uint32)-1)) {
 		SDL_Event event;
@@ -42,15 +51,7 @@ void on_sigusr1(int signum) {
 	signal(SIGUSR1, on_sigusr1);
 }
 void on_sigusr2(int signum) {
-	if (USR_EVENT_NOTIFY != ((Uint32)-1)) {
-		SDL_Event event;
-		SDL_memset(&event, 0, sizeof(event)); /* or SDL_zero(event) */
-		event.type = USR_EVENT_NOTIFY;
-		event.user.code = 0;
-		event.user.data1 = NULL;
-		event.user.data2 = NULL;
-		SDL_PushEvent(&event);
-	}
+	g_notify_pending = 1;
 	signal(SIGUSR2, on_sigusr2);
 }
 #endif
@@ -110,6 +111,12 @@ struct engine *engine_new(int argc, char **argv) {
 	engine->gameserver_ip.host = engine->gameserver_ip.port = 0;
 	engine->gameserver_tcp = NULL;
 	engine->gameserver_socketset = NULL;
+	engine->gameserver_wire_format = MESSAGE_WIRE_JSON;
+	engine->gameserver_prefer_json = is_argv_set(argc, argv, "--wire=json");
+	message_stream_init(&engine->gameserver_stream);
+	engine->gameserver_net = NULL;
+	engine->gameserver_net_is_open = 0;
+	engine->gameserver_connection_id = 0;
 	engine->console_visible = 1;
 	engine->freetype = NULL;
 	console_init(engine->console);
@@ -119,6 +126,15 @@ struct engine *engine_new(int argc, char **argv) {
 		return NULL;
 	}
 
+	if (is_argv_set(argc, argv, "--net-thread")) {
+		engine->gameserver_net = malloc(sizeof(struct net_thread));
+		if (!net_thread_start(engine->gameserver_net)) {
+			// e.g. no threads on the web, use the socket directly.
+			free(engine->gameserver_net);
+			engine->gameserver_net = NULL;
+		}
+	}
+
 	// OpenGL
 	engine->gl_ctx = SDL_GL_CreateContext(engine->window);
 	if (SDL_GL_MakeCurrent(engine->window, engine->gl_ctx) != 0) {
@@ -148,7 +164,6 @@ struct engine *engine_new(int argc, char **argv) {
 
 	// custom events
 	USR_EVENT_RELOAD = SDL_RegisterEvents(1);
-	USR_EVENT_NOTIFY = SDL_RegisterEvents(2);
 	USR_EVENT_GOBACK = SDL_RegisterEvents(3);
 #ifdef __unix__
 	signal(SIGUSR1, on_sigusr1);
@@ -214,6 +229,12 @@ int engine_destroy(struct engine *engine) {
 
 	// net
 	engine_gameserver_disconnect(engine);
+	message_stream_destroy(&engine->gameserver_stream);
+	if (engine->gameserver_net != NULL) {
+		net_thread_stop(engine->gameserver_net);
+		free(engine->gameserver_net);
+		engine->gameserver_net = NULL;
+	}
 
 	SDLNet_Quit();
 	Mix_Quit();
@@ -323,12 +344,24 @@ int engine_gameserver_connect(struct engine *engine, const char *address) {
 	assert(engine->gameserver_ip.host == 0);
 	assert(engine->gameserver_ip.port == 0);
 
-	if (engine->gameserver_tcp != NULL) {
+	if (engine_gameserver_is_connected(engine)) {
 		fprintf(stderr, "Already connected to gameserver.");
 		return 1;
 	}
 
 	const int port = 9124;
+	// resolving & connecting happen on the network thread, failing to
+	// connect arrives as MSG_DISCONNECTED.
+	if (engine->gameserver_net != NULL) {
+		++engine->gameserver_connection_id;
+		if (!net_thread_connect(engine->gameserver_net, engine->gameserver_connection_id, address, port)) {
+			fprintf(stderr, "Too many commands for the network thread...");
+			return 1;
+		}
+		engine->gameserver_net_is_open = 1;
+		return 0;
+	}
+
 	if (SDLNet_ResolveHost(&engine->gameserver_ip, address, port) < 0) {
 		engine->gameserver_ip.host = engine->gameserver_ip.port = 0;
 		fprintf(stderr, "Could not resolve host: \"%s\"...", address);
@@ -354,6 +387,16 @@ int engine_gameserver_connect(struct engine *engine, const char *address) {
 
 void engine_gameserver_disconnect(struct engine *engine) {
 	engine->gameserver_ip.host = engine->gameserver_ip.port = 0;
+	engine->gameserver_wire_format = MESSAGE_WIRE_JSON;
+	message_stream_clear(&engine->gameserver_stream);
+
+	if (engine->gameserver_net_is_open) {
+		engine->gameserver_net_is_open = 0;
+		net_thread_disconnect(engine->gameserver_net, engine->gameserver_connection_id);
+		if (engine->scene != NULL) {
+			scene_on_message(engine->scene, engine, &(struct message_header){ .type = MSG_DISCONNECTED });
+		}
+	}
 
 	if (engine->gameserver_tcp != NULL) {
 		if (engine->scene != NULL) {
@@ -373,18 +416,36 @@ void engine_gameserver_disconnect(struct engine *engine) {
 void engine_gameserver_send(struct engine *engine, struct message_header *msg) {
 	assert(engine != NULL);
 	assert(msg != NULL);
-	if (engine->gameserver_tcp == NULL) {
+	if (!engine_gameserver_is_connected(engine)) {
 		return;
 	}
 
-	// serialize
-	cJSON *json = pack_message(msg);
-	char *data = cJSON_PrintUnformatted(json);
-	const size_t data_len = strlen(data);
-	cJSON_Delete(json);
+	// serialize, messages which don't fit the frame still go out as
+	// json. the server accepts both.
+	char *data = NULL;
+	size_t data_len = 0;
+	uint8_t frame[512];
+	if (engine->gameserver_wire_format == MESSAGE_WIRE_BINARY) {
+		data_len = message_binary_encode(msg, frame, sizeof(frame));
+	}
+	if (data_len == 0) {
+		cJSON *json = pack_message(msg);
+		data = cJSON_PrintUnformatted(json);
+		data_len = strlen(data);
+		cJSON_Delete(json);
+	}
 
 	// send data
-	const int result = SDLNet_TCP_Send(engine->gameserver_tcp, data, data_len);
+	if (engine->gameserver_net != NULL) {
+		if (!net_thread_send(engine->gameserver_net, (data != NULL) ? (void *)data : (void *)frame, data_len)) {
+			fprintf(stderr, "Too many messages for the network thread, that means we disconnect...\n");
+			engine_gameserver_disconnect(engine);
+		}
+		free(data);
+		return;
+	}
+
+	const int result = SDLNet_TCP_Send(engine->gameserver_tcp, (data != NULL) ? (void *)data : (void *)frame, data_len);
 	if (result != (int)data_len) {
 		// TODO: Retry?
 		fprintf(stderr, "Only sent %d of %zu bytes, that means we disconnect...\n", result, data_len);
@@ -394,16 +455,34 @@ void engine_gameserver_send(struct engine *engine, struct message_header *msg) {
 	free(data);
 }
 
+int engine_gameserver_is_connected(struct engine *engine) {
+	assert(engine != NULL);
+	if (engine->gameserver_net != NULL) {
+		return engine->gameserver_net_is_open;
+	}
+	return (engine->gameserver_tcp != NULL);
+}
+
 // main loop
 void engine_update(struct engine *engine, double dt) {
 	// poll server
-	if (engine->gameserver_tcp != NULL) {
+	if (engine->gameserver_net != NULL) {
+		engine_gameserver_poll_net(engine);
+	} else if (engine->gameserver_tcp != NULL) {
 		engine_gameserver_receive(engine);
 	}
 	
 	// poll events
 	engine_poll_events(engine);
 
+	// hooks
+	if (g_notify_pending) {
+		g_notify_pending = 0;
+		for (int i = 0; i < stbds_arrlen(engine->on_notify_callbacks); ++i) {
+			engine->on_notify_callbacks[i](engine);
+		}
+	}
+
 	// update shader global data
 	engine->shader_global_data.periodic_time += dt * 0.33333;
 	if (engine->shader_global_data.periodic_time >= GLM_PI) {
@@ -587,10 +666,6 @@ static void engine_poll_events(struct engine *engine) {
 		if (event.type == USR_EVENT_RELOAD) {
 			// only emit this in debug?
 			engine_setscene_dll(engine, "./hotreload.so");
-		} else if (event.type == USR_EVENT_NOTIFY) {
-			for (int i = 0; i < stbds_arrlen(engine->on_notify_callbacks); ++i) {
-				engine->on_notify_callbacks[i](engine);
-			}
 		} else if (event.type == USR_EVENT_GOBACK) {
 			console_log(engine, "← Back");
 			enum scene_call_result result = scene_on_callback(engine->scene, engine, (struct engine_event){ .type = ENGINE_EVENT_CLOSE_SCENE });
@@ -604,15 +679,50 @@ static void engine_poll_events(struct engine *engine) {
 }
 
 // receive & parse messages
-static void propagate_received_message(struct engine *engine, const char *data, size_t data_len) {
+static void negotiate_wire_format(struct engine *engine, struct welcome_response *welcome) {
+	const int can_binary = (welcome->wire_formats & (1 << MESSAGE_WIRE_BINARY));
+	if (!can_binary || engine->gameserver_prefer_json || engine->gameserver_wire_format != MESSAGE_WIRE_JSON) {
+		return;
+	}
+
+	// the request itself still goes out as json.
+	struct wire_format_request request;
+	message_header_init(&request.header, WIRE_FORMAT_REQUEST);
+	request.wire_format = MESSAGE_WIRE_BINARY;
+	engine_gameserver_send(engine, &request.header);
+	if (engine_gameserver_is_connected(engine)) {
+		engine->gameserver_wire_format = MESSAGE_WIRE_BINARY;
+	}
+}
+
+static void dispatch_received_message(struct engine *engine, struct message_header *header) {
+	printf("Received a %s\n", message_type_to_name(header->type));
+	if (header->type == WELCOME_RESPONSE) {
+		negotiate_wire_format(engine, (struct welcome_response *)header);
+	}
+	scene_on_message(engine->scene, engine, header);
+}
+
+// Messages queued before the wire format was switched still arrive as
+// json, so both are accepted.
+static void propagate_received_message(struct engine *engine, const uint8_t *frame, size_t frame_len) {
+	if (frame[0] == MESSAGE_BINARY_MAGIC) {
+		message_buffer_t buffer;
+		struct message_header *header = NULL;
+		size_t decoded_len = 0;
+		if (message_binary_decode(frame, frame_len, &decoded_len, &buffer, &header) == MESSAGE_DECODE_OK) {
+			dispatch_received_message(engine, header);
+		}
+		return;
+	}
+
 	// we received something, but maybe it is no json/valid message?
-	cJSON *json = cJSON_ParseWithLength(data, data_len);
+	cJSON *json = cJSON_ParseWithLength((const char *)frame, frame_len);
 	if (json != NULL) {
 		// it may be valid json, but a valid message?
 		struct message_header *header = unpack_message(json);
 		if (header != NULL) {
-			printf("Received a %s\n", message_type_to_name(header->type));
-			scene_on_message(engine->scene, engine, header);
+			dispatch_received_message(engine, header);
 			free_message(json, header);
 		} else {
 			cJSON_Delete(json);
@@ -622,35 +732,80 @@ static void propagate_received_message(struct engine *engine, const char *data,
 
 static void engine_gameserver_receive(struct engine *engine) {
 	assert(engine != NULL);
+	struct message_stream *stream = &engine->gameserver_stream;
+	const Uint64 begin = profile_begin();
+
+	// read whatever arrived, partial messages are completed by later reads.
+	while (message_stream_pending(stream) < GAMESERVER_RECEIVE_MAX_PENDING && SDLNet_CheckSockets(engine->gameserver_socketset, 0) > 0) {
+		size_t available;
+		uint8_t *into = message_stream_reserve(stream, GAMESERVER_RECEIVE_CHUNK, &available);
+		const int received = SDLNet_TCP_Recv(engine->gameserver_tcp, into, (int)available);
+		if (received <= 0) {
+			// TODO: why did we recieve nothing?
+			printf("TCP_Recv failure, got 0 bytes...\n");
+			// TODO: if we dont disconnect this will trigger continously in browser
+			engine_gameserver_disconnect(engine);
+			return;
+		}
+		message_stream_commit(stream, (size_t)received);
+	}
 
-	const int readable_sockets = 1;
-	// Check if sockets are readable.
-	if (SDLNet_CheckSockets(engine->gameserver_socketset, 0) == readable_sockets) {
-		static char data[512] = {0};
+	// handle every complete message while the budget lasts, at least one
+	// per frame. handlers may disconnect, which also clears the stream.
+	for (int handled = 0; engine->gameserver_tcp != NULL; ++handled) {
+		if (handled > 0 && profile_end_ms(begin) >= GAMESERVER_RECEIVE_BUDGET_MS) {
+			break;
+		}
 
-		// TODO: we handle reading multiple objects in a single recv, but not partial objects.
-		const int data_len = SDLNet_TCP_Recv(engine->gameserver_tcp, &data, 511);
-		if (data_len > 0) {
-			// handle multiple json objects in a single message
-			const char *begin = data;
-			while (begin != NULL && begin < data + data_len) {
-				// TODO: this is garbage. find the end of this object
-				const char *end = str_match_bracket(begin, data_len, '{', '}');
-				if (end == NULL) break;
+		const uint8_t *frame;
+		size_t frame_len;
+		const enum message_decode_result result = message_stream_next(stream, &frame, &frame_len);
+		if (result == MESSAGE_DECODE_INCOMPLETE) {
+			break;
+		}
+		if (result == MESSAGE_DECODE_INVALID) {
+			fprintf(stderr, "Received a malformed or oversized message, disconnecting...\n");
+			engine_gameserver_disconnect(engine);
+			break;
+		}
 
-				const int len = end - begin + 1;
+		propagate_received_message(engine, frame, frame_len);
+	}
+}
 
-				propagate_received_message(engine, begin, len);
+// Messages were already received & decoded by the network thread.
+static void engine_gameserver_poll_net(struct engine *engine) {
+	assert(engine != NULL);
+	const Uint64 begin = profile_begin();
 
-				begin += len;
-			}
-			assert(begin == data + data_len);
+	// same budget as engine_gameserver_receive(), at least one per frame.
+	for (int handled = 0; ; ++handled) {
+		if (handled > 0 && profile_end_ms(begin) >= GAMESERVER_RECEIVE_BUDGET_MS) {
+			break;
+		}
 
-		} else {
-			// TODO: why did we recieve nothing?
-			printf("TCP_Recv failure, got 0 bytes...\n");
-			// TODO: if we dont disconnect this will trigger continously in browser
+		struct net_event *event = net_thread_poll(engine->gameserver_net);
+		if (event == NULL) {
+			break;
+		}
+
+		// left over from a connection which is already closed.
+		if (!engine->gameserver_net_is_open || event->connection_id != engine->gameserver_connection_id) {
+			net_event_free(event);
+			continue;
+		}
+
+		switch (event->type) {
+		case NET_EVENT_CONNECTED:
+			console_log(engine, "Connected to gameserver");
+			break;
+		case NET_EVENT_DISCONNECTED:
 			engine_gameserver_disconnect(engine);
+			break;
+		case NET_EVENT_MESSAGE:
+			dispatch_received_message(engine, event->message);
+			break;
 		}
+		net_event_free(event);
 	}
 }
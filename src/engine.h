@@ -11,6 +11,8 @@
 #include "scenes/scene.h"
 #include "gl/shader.h"
 #include "input.h"
+#include "net/message.h"
+#include "net/message_stream.h"
 
 //
 // forward decls & typedefs
@@ -19,6 +21,7 @@
 struct engine;
 struct console_s;
 struct message_header;
+struct net_thread;
 typedef void(*engine_callback_fn)(struct engine*);
 
 //
@@ -57,6 +60,19 @@ struct engine {
 	IPaddress gameserver_ip;
 	TCPsocket gameserver_tcp;
 	SDLNet_SocketSet gameserver_socketset;
+	// JSON until the server offers the binary format in its welcome.
+	enum message_wire_format gameserver_wire_format;
+	// --wire=json, keeps the traffic readable for debugging.
+	int gameserver_prefer_json;
+	// received bytes which do not form a whole message yet.
+	struct message_stream gameserver_stream;
+	// --net-thread, the connection lives on its own thread. NULL if the
+	// socket is used directly from the main loop.
+	struct net_thread *gameserver_net;
+	// connecting or connected through gameserver_net.
+	int gameserver_net_is_open;
+	// tells events of an old connection apart from the current one.
+	int gameserver_connection_id;
 
 	// rendering globals
 	mat4 u_projection;
@@ -88,6 +104,7 @@ void engine_setscene_dll(struct engine *engine, const char *filename);
 int engine_gameserver_connect(struct engine *, const char *address);
 void engine_gameserver_disconnect(struct engine *);
 void engine_gameserver_send(struct engine *, struct message_header *msg);
+int engine_gameserver_is_connected(struct engine *);
 
 // main loop
 void engine_update(struct engine *engine, double dt);
@@ -1,21 +1,35 @@
 #include "game/hexmap.h"
 
 #include <assert.h>
+#include <stdio.h>
+#include <string.h>
 #include <cglm/cglm.h>
+#include <cJSON.h>
 #include "gl/camera.h"
 #include "gl/shader.h"
 #include "engine.h"
 #include "util/util.h"
+#include "util/fs.h"
+#include "util/heap.h"
+#include "util/arena.h"
+#include "util/bitset.h"
 
 /////////////
 // PRIVATE //
 /////////////
 
-static const usize NO_EDGE = (usize)-1;
 static const usize NODE_NONE = (usize)-2;
 static const usize NODE_NOT_VISITED = (usize)-1;
 
 static void load_hextile_models(struct hexmap *);
+static u32 tile_cost(struct hexmap *, usize index);
+static void update_blocked(struct hexmap *, usize index);
+static void flowfield_generate(struct hexmap *, usize start, usize *came_from, u32 *distance);
+static void flowfield_invalidate(struct hexmap_flowfield *, struct hexmap *, usize tile, usize *invalid_len);
+static void flowfield_reconnect(struct hexmap_flowfield *, struct hexmap *, usize tile);
+static void path_find_unweighted(struct hexmap *, struct hexmap_path_workspace *, usize start, usize goal, enum path_find_flags, struct hexmap_path *);
+static void path_find_weighted(struct hexmap *, struct hexmap_path_workspace *, usize start, usize goal, enum path_find_flags, struct hexmap_path *);
+static void path_build_from_workspace(struct hexmap *, struct hexmap_path_workspace *, struct arena *, usize start, usize goal, struct hexmap_path *);
 
 ////////////
 // PUBLIC //
@@ -25,6 +39,16 @@ int hexcoord_equal(struct hexcoord a, struct hexcoord b) {
 	return a.x == b.x && a.y == b.y;
 }
 
+// Number of steps between two tiles, ignoring obstacles.
+int hexcoord_distance(struct hexcoord a, struct hexcoord b) {
+	// offset (even rows shifted right) to axial coordinates
+	const int aq = a.x - (a.y + (a.y & 1)) / 2;
+	const int bq = b.x - (b.y + (b.y & 1)) / 2;
+	const int dq = aq - bq;
+	const int dr = a.y - b.y;
+	return (abs(dq) + abs(dr) + abs(dq + dr)) / 2;
+}
+
 int hexmap_is_valid_coord(struct hexmap *map, struct hexcoord coord) {
 	assert(map != NULL);
 	return (coord.x >= 0 && coord.y >= 0 && coord.x < map->w && coord.y < map->h);
@@ -35,53 +59,21 @@ int hexmap_is_valid_index(struct hexmap *map, usize index) {
 	return (index < (usize)map->w * map->h);
 }
 
-void hexmap_init(struct hexmap *map, struct engine *engine) {
-	map->w = 7;
-	map->h = 11;
-	map->tilesize = 2.0f;
-	map->edges = malloc(map->w * map->h * sizeof(*map->edges) * HEXMAP_MAX_EDGES);
-	map->tiles = calloc(map->w * map->h, sizeof(*map->tiles));
-	for (usize i = 0; i < (usize)map->w * map->h; ++i) {
-		map->tiles[i].movement_cost = 1;
-		map->tiles[i].occupied_by = 0;
-	}
-	shader_init_from_dir(&map->tile_shader, "res/shader/model/hexmap_tile/");
-	shader_use(&map->tile_shader);
-	shader_set_kind(&map->tile_shader, SHADER_KIND_MODEL);
-	shader_set_uniform_buffer(&map->tile_shader, "Global", &engine->shader_global_ubo);
+void hexmap_init(struct hexmap *map, int w, int h) {
+	assert(map != NULL);
+	assert(w > 0 && h > 0);
+	const usize n_tiles = (usize)w * h;
 
-	// Make some map
-#define M(x, y, T, R, M) \
-	map->tiles[x + map->w * y].tile = T;     \
-	map->tiles[x + map->w * y].rotation = R; \
-	map->tiles[x + map->w * y].movement_cost = M;
-	
-	M(0, 0, 1,  0, HEXMAP_MOVEMENT_COST_MAX);
-	M(1, 0, 4, -1, HEXMAP_MOVEMENT_COST_MAX);
-	M(2, 0, 6, -1, 1);
-	M(0, 1, 1,  0, HEXMAP_MOVEMENT_COST_MAX);
-	M(1, 1, 1,  0, HEXMAP_MOVEMENT_COST_MAX);
-	M(2, 1, 4, -2, HEXMAP_MOVEMENT_COST_MAX);
-	M(0, 2, 1,  0, HEXMAP_MOVEMENT_COST_MAX);
-	M(1, 2, 5, -3, HEXMAP_MOVEMENT_COST_MAX);
-	M(2, 2, 6, -2, 1);
-	M(0, 3, 3, -4, HEXMAP_MOVEMENT_COST_MAX);
-	M(1, 3, 4, -3, HEXMAP_MOVEMENT_COST_MAX);
-	M(2, 3, 6, -2, 1);
-	M(0, 4, 6, -3, 1);
-
-	M(4, 0, 8,  1, 1);
-	M(4, 1, 8, -2, 1);
-	M(4, 2, 9, -1, 1);
-	M(5, 2, 7,  0, 1);
-	M(6, 2, 7,  0, 1);
-	M(5, 3, 8,  1, 1);
-	M(4, 4, 7, -2, 1);
-	M(4, 5, 8, -2, 1);
-	M(4, 6, 8,  1, 1);
-	M(4, 7, 8, -2, 1);
-	M(4, 8, 7, -1, 1);
-#undef M
+	map->w = w;
+	map->h = h;
+	map->tilesize = 2.0f;
+	map->tiles = calloc(n_tiles, sizeof(*map->tiles));
+	map->movement_cost = malloc(n_tiles * sizeof(*map->movement_cost));
+	map->occupied_by = calloc(n_tiles, sizeof(*map->occupied_by));
+	map->blocked = calloc(bitset_words(n_tiles), sizeof(*map->blocked));
+	memset(map->movement_cost, 1, n_tiles * sizeof(*map->movement_cost));
+	map->highlight_tile_index = (usize)-1;
+	map->version = 0;
 
 	// precomputed
 	map->tile_offsets = (vec2s){
@@ -89,19 +81,100 @@ void hexmap_init(struct hexmap *map, struct engine *engine) {
 		.y = (3.f / 2.f) * map->tilesize,
 	};
 
-	load_hextile_models(map);
-
 	// Generate pathfinding data
-	hexmap_generate_edges(map);
+	hexmap_path_workspace_init(&map->path_workspace, n_tiles);
+}
+
+// Loads a map from level data. `tiles`, `rotations` and `movement_costs`
+// are optional arrays of `width * height` numbers, stored row by row.
+// Returns 0 on success.
+int hexmap_init_from_file(struct hexmap *map, const char *path) {
+	assert(map != NULL);
+	assert(path != NULL);
+
+	char *file;
+	long file_len;
+	if (fs_readfile(path, &file, &file_len) != FS_OK) {
+		fprintf(stderr, "could not read '%s'!\n", path);
+		return 1;
+	}
+
+	cJSON *json = cJSON_ParseWithLength(file, file_len);
+	free(file);
+
+	const cJSON *width          = cJSON_GetObjectItem(json, "width");
+	const cJSON *height         = cJSON_GetObjectItem(json, "height");
+	const cJSON *tiles          = cJSON_GetObjectItem(json, "tiles");
+	const cJSON *rotations      = cJSON_GetObjectItem(json, "rotations");
+	const cJSON *movement_costs = cJSON_GetObjectItem(json, "movement_costs");
+
+	if (!cJSON_IsNumber(width) || !cJSON_IsNumber(height) || width->valueint <= 0 || height->valueint <= 0) {
+		fprintf(stderr, "could not parse hexmap dimensions in '%s'.\n", path);
+		cJSON_Delete(json);
+		return 1;
+	}
+
+	hexmap_init(map, width->valueint, height->valueint);
+
+	const usize n_tiles = (usize)map->w * map->h;
+	usize index = 0;
+	const cJSON *value;
+	cJSON_ArrayForEach(value, tiles) {
+		if (index >= n_tiles) break;
+		if (cJSON_IsNumber(value)) {
+			map->tiles[index].tile = value->valueint;
+		}
+		++index;
+	}
+	index = 0;
+	cJSON_ArrayForEach(value, rotations) {
+		if (index >= n_tiles) break;
+		if (cJSON_IsNumber(value)) {
+			map->tiles[index].rotation = value->valueint;
+		}
+		++index;
+	}
+	index = 0;
+	cJSON_ArrayForEach(value, movement_costs) {
+		if (index >= n_tiles) break;
+		if (cJSON_IsNumber(value)) {
+			const int cost = value->valueint;
+			map->movement_cost[index] = (cost < 0) ? 0 : (cost > HEXMAP_MOVEMENT_COST_MAX) ? HEXMAP_MOVEMENT_COST_MAX : cost;
+			update_blocked(map, index);
+		}
+		++index;
+	}
+
+	cJSON_Delete(json);
+	return 0;
 }
 
 void hexmap_destroy(struct hexmap *map) {
+	assert(map != NULL);
+	hexmap_path_workspace_destroy(&map->path_workspace);
+	free(map->blocked);
+	free(map->occupied_by);
+	free(map->movement_cost);
+	free(map->tiles);
+}
+
+void hexmap_init_render(struct hexmap *map, struct engine *engine) {
+	assert(map != NULL);
+	assert(engine != NULL);
+	shader_init_from_dir(&map->tile_shader, "res/shader/model/hexmap_tile/");
+	shader_use(&map->tile_shader);
+	shader_set_kind(&map->tile_shader, SHADER_KIND_MODEL);
+	shader_set_uniform_buffer(&map->tile_shader, "Global", &engine->shader_global_ubo);
+
+	load_hextile_models(map);
+}
+
+void hexmap_destroy_render(struct hexmap *map) {
 	assert(map != NULL);
 	// TODO: Store this...
 	for (usize i = 0; i < count_of(map->models); ++i) {
 		model_destroy(&map->models[i]);
 	}
-	free(map->tiles);
 }
 
 vec2s hexmap_coord_to_world_position(struct hexmap *map, struct hexcoord coord) {
@@ -124,7 +197,7 @@ vec2s hexmap_index_to_world_position(struct hexmap *map, usize index) {
 	float vert = map->tile_offsets.y;
 
 	int q = index % map->w;
-	int r = floorf(index / (float)map->w);
+	int r = index / map->w;
 	float horiz_offset = (r % 2 == 0) ? horiz * 0.5f : 0.0f;
 
 	return (vec2s){
@@ -136,7 +209,7 @@ vec2s hexmap_index_to_world_position(struct hexmap *map, usize index) {
 struct hexcoord hexmap_index_to_coord(struct hexmap *map, usize index) {
 	assert(map != NULL);
 	assert(hexmap_is_valid_index(map, index));
-	return (struct hexcoord){ .x=index % map->w, .y=(int)(index / (float)map->w) };
+	return (struct hexcoord){ .x=index % map->w, .y=index / map->w };
 }
 
 usize hexmap_world_position_to_index(struct hexmap *map, vec2s position) {
@@ -183,6 +256,67 @@ struct hextile *hexmap_tile_at(struct hexmap *map, struct hexcoord at) {
 	return &map->tiles[i];
 }
 
+// Writes the indices of all neighbors of `index` which are inside the
+// map to `neighbors`, in `enum hexmap_neighbor` order. Returns their count.
+usize hexmap_neighbors(struct hexmap *map, usize index, usize neighbors[HEXMAP_MAX_NEIGHBORS]) {
+	assert(map != NULL);
+	assert(hexmap_is_valid_index(map, index));
+
+	static const int dx_odd[]  = {1, 0, -1, -1, -1, 0};
+	static const int dx_even[] = {1, 1, 0, -1, 0, 1};
+	static const int dy[]      = {0, 1, 1, 0, -1, -1};
+
+	const int x = index % map->w;
+	const int y = index / map->w;
+	const int *dx = (y % 2 == 0) ? dx_even : dx_odd;
+
+	usize count = 0;
+	for (enum hexmap_neighbor i = HEXMAP_N_FIRST; i <= HEXMAP_N_LAST; ++i) {
+		const int nx = x + dx[i];
+		const int ny = y + dy[i];
+		if (nx >= 0 && ny >= 0 && nx < map->w && ny < map->h) {
+			neighbors[count++] = (usize)nx + (usize)ny * map->w;
+		}
+	}
+	return count;
+}
+
+void hexmap_set_movement_cost(struct hexmap *map, struct hexcoord coord, u8 movement_cost) {
+	assert(map != NULL);
+	assert(hexmap_is_valid_coord(map, coord));
+	const usize i = hexmap_coord_to_index(map, coord);
+	if (map->movement_cost[i] != movement_cost) {
+		map->movement_cost[i] = movement_cost;
+		update_blocked(map, i);
+		++map->version;
+	}
+}
+
+u8 hexmap_movement_cost(struct hexmap *map, struct hexcoord coord) {
+	assert(map != NULL);
+	assert(hexmap_is_valid_coord(map, coord));
+	return map->movement_cost[hexmap_coord_to_index(map, coord)];
+}
+
+void hexmap_set_occupied_by(struct hexmap *map, struct hexcoord coord, ecs_entity_t entity) {
+	assert(map != NULL);
+	assert(hexmap_is_valid_coord(map, coord));
+	const usize i = hexmap_coord_to_index(map, coord);
+	const int was_blocked = bitset_get(map->blocked, i);
+	map->occupied_by[i] = entity;
+	update_blocked(map, i);
+	// only whether a tile is occupied matters for pathfinding, not by whom.
+	if (was_blocked != bitset_get(map->blocked, i)) {
+		++map->version;
+	}
+}
+
+ecs_entity_t hexmap_occupied_by(struct hexmap *map, struct hexcoord coord) {
+	assert(map != NULL);
+	assert(hexmap_is_valid_coord(map, coord));
+	return map->occupied_by[hexmap_coord_to_index(map, coord)];
+}
+
 void hexmap_draw(struct hexmap *map, struct camera *camera, vec3 player_pos) {
 	usize n_tiles = map->w * map->h;
 
@@ -256,31 +390,6 @@ void hexmap_clear_tile_effect(struct hexmap *map, enum hexmap_tile_effect effect
 	}
 }
 
-void hexmap_generate_edges(struct hexmap *map) {
-	for (usize i = 0; i < (usize)map->w * map->h * HEXMAP_MAX_EDGES; ++i) {
-		map->edges[i] = NO_EDGE;
-	}
-	usize n_tiles = (usize)map->w * map->h;
-	for (int y = 0; y < map->h; ++y) {
-		for (int x = 0; x < map->w; ++x) {
-			// Neighbors
-			struct hexcoord current_coord = { .x=x, .y=y };
-			usize current = hexmap_coord_to_index(map, current_coord);
-			// TODO: Allow leaving from HEXMAP_MOVEMENT_COST_MAX?
-			//if (map->tiles[current].movement_cost >= HEXMAP_MOVEMENT_COST_MAX) {
-			//	continue;
-			//}
-			uint edges_generated = 0;
-			for (enum hexmap_neighbor i = HEXMAP_N_FIRST; i <= HEXMAP_N_LAST; ++i) {
-				struct hexcoord neighbor_coord = hexmap_get_neighbor_coord(map, current_coord, i);
-				if (hexmap_is_valid_coord(map, neighbor_coord)) {
-					map->edges[current + edges_generated++ * n_tiles] = hexmap_coord_to_index(map, neighbor_coord);
-				}
-			}
-		}
-	}
-}
-
 void hexmap_generate_flowfield(struct hexmap *map, struct hexcoord start_coord, usize flowfield_len, usize *flowfield) {
 	assert(map != NULL);
 	assert(hexmap_is_valid_coord(map, start_coord));
@@ -288,36 +397,143 @@ void hexmap_generate_flowfield(struct hexmap *map, struct hexcoord start_coord,
 	// TODO: this param just makes sure i allocate enough memory, meh...
 	assert(flowfield_len == (usize)map->w * map->h);
 
-	usize start = hexmap_coord_to_index(map, start_coord);
+	flowfield_generate(map, hexmap_coord_to_index(map, start_coord), flowfield, NULL);
+}
 
-	usize map_size = (usize)map->w * map->h;
-	RINGBUFFER(usize, frontier, map_size);
-	RINGBUFFER_APPEND(frontier, start);
+void hexmap_flowfield_init(struct hexmap_flowfield *flowfield, struct hexmap *map, struct hexcoord origin) {
+	assert(flowfield != NULL);
+	assert(map != NULL);
+	assert(hexmap_is_valid_coord(map, origin));
 
-	// Readability, came_from[tile] means the index of the tile 1 step closer to the `start_coord`.
-	usize *came_from = flowfield;
+	const usize map_size = (usize)map->w * map->h;
+	flowfield->origin = origin;
+	flowfield->came_from = malloc(map_size * sizeof(*flowfield->came_from));
+	flowfield->distance = malloc(map_size * sizeof(*flowfield->distance));
+	flowfield->blocked = malloc(bitset_words(map_size) * sizeof(*flowfield->blocked));
+	memcpy(flowfield->blocked, map->blocked, bitset_words(map_size) * sizeof(*flowfield->blocked));
+	flowfield->version = map->version;
+
+	flowfield_generate(map, hexmap_coord_to_index(map, origin), flowfield->came_from, flowfield->distance);
+}
 
-	for (usize i = 0; i < map_size; ++i)
-		came_from[i] = NODE_NOT_VISITED;
-	came_from[start] = NODE_NONE;
+void hexmap_flowfield_destroy(struct hexmap_flowfield *flowfield) {
+	assert(flowfield != NULL);
+	free(flowfield->blocked);
+	free(flowfield->distance);
+	free(flowfield->came_from);
+	*flowfield = (struct hexmap_flowfield){ 0 };
+}
 
-	usize NUMBER_OF_ITERATIONS = 0;
-	while (frontier.len > 0) {
-		usize current_node_i = RINGBUFFER_CONSUME(frontier);
-		// Check all neighboring nodes.
-		usize edge_i = 0;
-		while (map->edges[current_node_i + edge_i * map_size] < map_size && edge_i < HEXMAP_MAX_EDGES) {
-			usize next_i = map->edges[current_node_i + edge_i * map_size];
-			++edge_i;
-			if (hexmap_is_tile_obstacle(map, hexmap_index_to_coord(map, next_i))) {
-				continue;
+// Brings the flowfield up to date with the map. Only tiles around those
+// which got blocked or unblocked since the last update are searched again.
+void hexmap_flowfield_update(struct hexmap_flowfield *flowfield, struct hexmap *map) {
+	assert(flowfield != NULL);
+	assert(map != NULL);
+	if (flowfield->version == map->version) {
+		return;
+	}
+	flowfield->version = map->version;
+
+	const usize map_size = (usize)map->w * map->h;
+	const usize origin = hexmap_coord_to_index(map, flowfield->origin);
+	const usize words = bitset_words(map_size);
+	struct hexmap_path_workspace *ws = &map->path_workspace;
+	hexmap_path_workspace_begin(ws, map_size);
+
+	// Tiles which lost their path. The origin never does, blocked or not.
+	usize invalid_len = 0;
+	for (usize w = 0; w < words; ++w) {
+		const uint64_t now_blocked = map->blocked[w] & ~flowfield->blocked[w];
+		for (usize bit = 0; now_blocked != 0 && bit < 64; ++bit) {
+			const usize tile = w * 64 + bit;
+			if (((now_blocked >> bit) & 1) && tile != origin) {
+				flowfield_invalidate(flowfield, map, tile, &invalid_len);
 			}
-			if (came_from[next_i] == NODE_NOT_VISITED) {
-				RINGBUFFER_APPEND(frontier, next_i);
-				came_from[next_i] = current_node_i;
+		}
+	}
+
+	// Reconnect these and the tiles which got free to the rest.
+	for (usize i = 0; i < invalid_len; ++i) {
+		flowfield_reconnect(flowfield, map, ws->frontier[i]);
+	}
+	for (usize w = 0; w < words; ++w) {
+		const uint64_t now_free = flowfield->blocked[w] & ~map->blocked[w];
+		for (usize bit = 0; now_free != 0 && bit < 64; ++bit) {
+			if ((now_free >> bit) & 1) {
+				flowfield_reconnect(flowfield, map, w * 64 + bit);
+			}
+		}
+		flowfield->blocked[w] = map->blocked[w];
+	}
+
+	// Spread shorter distances outwards, like the regular search.
+	const uint32_t generation = ws->generation;
+	while (ws->open.len > 0) {
+		const usize current = heap_pop(&ws->open, NULL);
+		ws->closed[current] = generation;
+		++ws->expanded;
+
+		usize neighbors[HEXMAP_MAX_NEIGHBORS];
+		const usize neighbors_len = hexmap_neighbors(map, current, neighbors);
+		for (usize n = 0; n < neighbors_len; ++n) {
+			const usize next = neighbors[n];
+			if (bitset_get(map->blocked, next)) continue;
+			if (flowfield->distance[current] + 1 >= flowfield->distance[next]) continue;
+			assert(ws->closed[next] != generation);
+
+			flowfield->distance[next] = flowfield->distance[current] + 1;
+			flowfield->came_from[next] = current;
+			if (ws->visited[next] == generation) {
+				heap_decrease(&ws->open, next, flowfield->distance[next]);
+			} else {
+				heap_push(&ws->open, next, flowfield->distance[next]);
+				ws->visited[next] = generation;
 			}
 		}
-		assert(NUMBER_OF_ITERATIONS++ < map_size);
+	}
+}
+
+void hexmap_path_workspace_init(struct hexmap_path_workspace *ws, usize capacity) {
+	assert(ws != NULL);
+	ws->capacity   = capacity;
+	ws->generation = 0;
+	ws->visited    = calloc(capacity, sizeof(*ws->visited));
+	ws->closed     = calloc(capacity, sizeof(*ws->closed));
+	ws->came_from  = malloc(capacity * sizeof(*ws->came_from));
+	ws->cost       = malloc(capacity * sizeof(*ws->cost));
+	ws->frontier   = malloc(capacity * sizeof(*ws->frontier));
+	heap_init(&ws->open, capacity);
+	ws->expanded   = 0;
+}
+
+void hexmap_path_workspace_destroy(struct hexmap_path_workspace *ws) {
+	assert(ws != NULL);
+	heap_destroy(&ws->open);
+	free(ws->frontier);
+	free(ws->cost);
+	free(ws->came_from);
+	free(ws->closed);
+	free(ws->visited);
+	*ws = (struct hexmap_path_workspace){ 0 };
+}
+
+// Starts a new query over ids in [0, capacity), invalidating everything
+// stored by the previous one.
+void hexmap_path_workspace_begin(struct hexmap_path_workspace *ws, usize capacity) {
+	assert(ws != NULL);
+	if (ws->capacity < capacity) {
+		hexmap_path_workspace_destroy(ws);
+		hexmap_path_workspace_init(ws, capacity);
+	}
+	heap_clear(&ws->open);
+	ws->expanded = 0;
+
+	++ws->generation;
+	if (ws->generation == 0) {
+		// Stamps wrapped around, old entries could look valid again.
+		memset(ws->visited, 0, ws->capacity * sizeof(*ws->visited));
+		memset(ws->closed, 0, ws->capacity * sizeof(*ws->closed));
+		ws->generation = 1;
 	}
 }
 
@@ -327,14 +543,25 @@ enum hexmap_path_result hexmap_path_find(struct hexmap *map, struct hexcoord sta
 
 enum hexmap_path_result hexmap_path_find_ex(struct hexmap *map, struct hexcoord start_coord, struct hexcoord goal_coord, enum path_find_flags flags, struct hexmap_path *output_path) {
 	assert(map != NULL);
+	return hexmap_path_find_with(map, &map->path_workspace, NULL, start_coord, goal_coord, flags, output_path);
+}
+
+// Same as hexmap_path_find_ex(), but uses the given scratch memory. The
+// resulting path is allocated from `arena`, or malloc'd if it is NULL.
+// Arena allocated paths stay valid until the arena is reset.
+enum hexmap_path_result hexmap_path_find_with(struct hexmap *map, struct hexmap_path_workspace *ws, struct arena *arena, struct hexcoord start_coord, struct hexcoord goal_coord, enum path_find_flags flags, struct hexmap_path *output_path) {
+	assert(map != NULL);
+	assert(ws != NULL);
 	assert(output_path != NULL); // Maybe allow NULL, just to check if any path exists?
-	assert((flags == PATH_FLAGS_NONE || flags == PATH_FLAGS_FIND_NEIGHBOR) && "flag not implemented?");
+	assert((flags & ~(PATH_FLAGS_FIND_NEIGHBOR | PATH_FLAGS_UNWEIGHTED)) == 0 && "flag not implemented?");
 
 	output_path->distance_in_tiles = 0;
+	output_path->cost              = 0;
 	output_path->start             = start_coord;
 	output_path->goal              = goal_coord;
 	output_path->result            = HEXMAP_PATH_ERROR;
 	output_path->tiles             = NULL;
+	output_path->owns_tiles        = 0;
 
 	// start & goal need to be valid
 	const int is_valid_start = hexmap_is_valid_coord(map, start_coord);
@@ -351,83 +578,20 @@ enum hexmap_path_result hexmap_path_find_ex(struct hexmap *map, struct hexcoord
 	}
 
 	const usize start    = hexmap_coord_to_index(map, start_coord);
-	usize goal           = hexmap_coord_to_index(map, goal_coord);
+	const usize goal     = hexmap_coord_to_index(map, goal_coord);
 	const usize map_size = (usize)map->w * map->h;
-	RINGBUFFER(usize, frontier, map_size);
-	RINGBUFFER_APPEND(frontier, start);
-
-	usize came_from[map_size];
-	for (usize i = 0; i < map_size; ++i)
-		came_from[i] = NODE_NOT_VISITED;
-	came_from[start] = NODE_NONE;
 
-	{ // store relevant nodes in the `came_from` flowfield
-		usize NUMBER_OF_ITERATIONS = 0;
-		while (frontier.len > 0) {
-			usize current_node_i = RINGBUFFER_CONSUME(frontier);
-			// Early Exit
-			if (current_node_i == goal) {
-				break;
-			}
-			// Check all neighboring nodes.
-			usize edge_i = 0;
-			while (map->edges[current_node_i + edge_i * map_size] < map_size && edge_i < HEXMAP_MAX_EDGES) {
-				usize next_i = map->edges[current_node_i + edge_i * map_size];
-				++edge_i;
-				// If goal is a neighbor of the current tile, we update
-				// the output path goal to it. No need to search further.
-				if ((flags & PATH_FLAGS_FIND_NEIGHBOR) && next_i == goal) {
-					goal = current_node_i;
-					output_path->goal = hexmap_index_to_coord(map, current_node_i);
-					goto goal_reached;
-				}
-				if (hexmap_is_tile_obstacle(map, hexmap_index_to_coord(map, next_i))) {
-					continue;
-				}
-				if (came_from[next_i] == NODE_NOT_VISITED) {
-					RINGBUFFER_APPEND(frontier, next_i);
-					came_from[next_i] = current_node_i;
-				}
-			}
-			assert(NUMBER_OF_ITERATIONS++ < map_size);
-		}
+	hexmap_path_workspace_begin(ws, map_size);
+	if (flags & PATH_FLAGS_UNWEIGHTED) {
+		path_find_unweighted(map, ws, start, goal, flags, output_path);
+	} else {
+		path_find_weighted(map, ws, start, goal, flags, output_path);
 	}
-goal_reached:
 
-	// allocate enough memory to store the longest possible path (visits each node once)
-	output_path->tiles = malloc(map_size * sizeof(*output_path->tiles));
+	// the search might have moved the goal, see PATH_FLAGS_FIND_NEIGHBOR.
+	const usize reached_goal = hexmap_coord_to_index(map, output_path->goal);
+	path_build_from_workspace(map, ws, arena, start, reached_goal, output_path);
 
-	{ // walk back to build final path
-		usize walk_back_iter = goal;
-		usize NUMBER_OF_ITERATIONS = 0;
-		output_path->distance_in_tiles = 0;
-		while (walk_back_iter != start && walk_back_iter != NODE_NOT_VISITED) {
-			assert(walk_back_iter != NODE_NONE);
-			assert(walk_back_iter != NODE_NOT_VISITED);
-			assert(walk_back_iter < map_size);
-			output_path->tiles[output_path->distance_in_tiles] = walk_back_iter;
-			walk_back_iter = came_from[walk_back_iter];
-			++output_path->distance_in_tiles;
-			assert(NUMBER_OF_ITERATIONS++ < map_size);
-		}
-		if (walk_back_iter == start) {
-			// We do not want to count the start tile as part of the resulting path,
-			// but it might be nice to have?
-			// TODO: Store the start in hexmap_find_path() result?
-			output_path->tiles[output_path->distance_in_tiles] = start;
-			//++output_path->distance_in_tiles;
-			assert(output_path->tiles[0] == goal);
-			assert(output_path->tiles[output_path->distance_in_tiles] == start);
-			output_path->result = HEXMAP_PATH_OK;
-		} else {
-			free(output_path->tiles);
-			output_path->tiles = NULL;
-			output_path->distance_in_tiles = 0;
-			output_path->result = (walk_back_iter == NODE_NOT_VISITED)
-				? HEXMAP_PATH_INCOMPLETE_FLOWFIELD
-				: HEXMAP_PATH_ERROR;
-		}
-	}
 	return output_path->result;
 }
 
@@ -436,13 +600,16 @@ void hexmap_path_destroy(struct hexmap_path *path) {
 	switch (path->result) {
 	case HEXMAP_PATH_OK:
 		// `path->tiles` can be NULL.
-		free(path->tiles);
+		if (path->owns_tiles) {
+			free(path->tiles);
+		}
 		break;
 	case HEXMAP_PATH_ERROR:
 	case HEXMAP_PATH_INCOMPLETE_FLOWFIELD:
 		break;
 	};
 	path->tiles = NULL;
+	path->owns_tiles = 0;
 	path->distance_in_tiles = 0;
 	path->result = HEXMAP_PATH_ERROR;
 	path->start = path->goal = (struct hexcoord){ .x=-1, .y=-1 };
@@ -458,7 +625,7 @@ usize hexmap_path_at(struct hexmap_path *path, usize index) {
 // Calculate the distance from the `flowfield` origin to the `goal`.
 // Returns the distance in tiles in case of success.
 // On error, returns (usize)-1.
-usize hexmap_flowfield_distance(struct hexmap *map, struct hexcoord goal_coord, usize flowfield_len, usize flowfield[flowfield_len]) {
+usize hexmap_flowfield_distance(struct hexmap *map, struct hexcoord goal_coord, usize flowfield_len, const usize flowfield[flowfield_len]) {
 	assert(map != NULL);
 	assert(hexmap_is_valid_coord(map, goal_coord));
 	assert(flowfield_len == (usize)map->w * map->h);
@@ -476,7 +643,7 @@ usize hexmap_flowfield_distance(struct hexmap *map, struct hexcoord goal_coord,
 	const usize max_distance = (usize)map->w * map->h;
 
 	usize goal = hexmap_coord_to_index(map, goal_coord);
-	usize *came_from = flowfield;
+	const usize *came_from = flowfield;
 	if (came_from[goal] == NODE_NOT_VISITED) {
 		// invalid target
 		return (usize)-1;
@@ -495,18 +662,410 @@ usize hexmap_flowfield_distance(struct hexmap *map, struct hexcoord goal_coord,
 	return distance;
 }
 
+// Cost of the cheapest path from every tile to the nearest of `sources`,
+// plus the cost of that source. Computed in a single search outwards from
+// all sources, so one map answers the query for any number of agents.
+// Blocked tiles still get a value if they are next to a reachable tile,
+// that way agents standing on them can descend the map, but the search
+// never continues through them. Sources are always expanded, even if they
+// are occupied, e.g. by the unit they stand for.
+void hexmap_generate_dijkstra_map(struct hexmap *map, usize sources_len, const struct hexmap_dijkstra_source sources[sources_len], usize dijkstra_map_len, uint32_t *dijkstra_map) {
+	assert(map != NULL);
+	assert(sources_len == 0 || sources != NULL);
+	assert(dijkstra_map != NULL);
+	assert(dijkstra_map_len == (usize)map->w * map->h);
+
+	struct hexmap_path_workspace *ws = &map->path_workspace;
+	hexmap_path_workspace_begin(ws, dijkstra_map_len);
+	const uint32_t generation = ws->generation;
+
+	for (usize i = 0; i < dijkstra_map_len; ++i) {
+		dijkstra_map[i] = HEXMAP_DIJKSTRA_UNREACHABLE;
+	}
+
+	// `visited` marks tiles in the open set, or expanded ones if also `closed`.
+	for (usize i = 0; i < sources_len; ++i) {
+		assert(hexmap_is_valid_coord(map, sources[i].coord));
+		assert(sources[i].cost < HEXMAP_DIJKSTRA_UNREACHABLE);
+		const usize source = hexmap_coord_to_index(map, sources[i].coord);
+		if (sources[i].cost >= dijkstra_map[source]) continue;
+
+		if (ws->visited[source] == generation) {
+			heap_decrease(&ws->open, source, sources[i].cost);
+		} else {
+			heap_push(&ws->open, source, sources[i].cost);
+			ws->visited[source] = generation;
+		}
+		dijkstra_map[source] = sources[i].cost;
+	}
+
+	while (ws->open.len > 0) {
+		const usize current = heap_pop(&ws->open, NULL);
+		ws->closed[current] = generation;
+		++ws->expanded;
+
+		// Moving from a neighbor onto `current` costs as much as entering `current`.
+		const u32 step_cost = tile_cost(map, current);
+		const uint32_t next_cost = (dijkstra_map[current] < HEXMAP_DIJKSTRA_UNREACHABLE - step_cost)
+			? dijkstra_map[current] + step_cost
+			: HEXMAP_DIJKSTRA_UNREACHABLE - 1;
+
+		usize neighbors[HEXMAP_MAX_NEIGHBORS];
+		const usize neighbors_len = hexmap_neighbors(map, current, neighbors);
+		for (usize n = 0; n < neighbors_len; ++n) {
+			const usize next = neighbors[n];
+			if (ws->closed[next] == generation) continue;
+			if (next_cost >= dijkstra_map[next]) continue;
+
+			dijkstra_map[next] = next_cost;
+			if (bitset_get(map->blocked, next)) continue;
+
+			if (ws->visited[next] == generation) {
+				heap_decrease(&ws->open, next, next_cost);
+			} else {
+				heap_push(&ws->open, next, next_cost);
+				ws->visited[next] = generation;
+			}
+		}
+	}
+}
+
+// Returns the walkable neighbor of `index` with the lowest value in the
+// `dijkstra_map`, or `index` itself if no neighbor gets any closer.
+usize hexmap_dijkstra_map_step(struct hexmap *map, const uint32_t *dijkstra_map, usize index) {
+	assert(map != NULL);
+	assert(dijkstra_map != NULL);
+	assert(hexmap_is_valid_index(map, index));
+
+	usize best = index;
+	usize neighbors[HEXMAP_MAX_NEIGHBORS];
+	const usize neighbors_len = hexmap_neighbors(map, index, neighbors);
+	for (usize n = 0; n < neighbors_len; ++n) {
+		const usize next = neighbors[n];
+		if (bitset_get(map->blocked, next)) continue;
+		if (dijkstra_map[next] < dijkstra_map[best]) {
+			best = next;
+		}
+	}
+
+	return best;
+}
+
+// Descends the `dijkstra_map` from `start` for at most `max_tiles` steps.
+// The result can be used like the one of hexmap_path_find(), it fails
+// with HEXMAP_PATH_ERROR if `start` is already at a local minimum.
+enum hexmap_path_result hexmap_dijkstra_map_path(struct hexmap *map, const uint32_t *dijkstra_map, struct hexcoord start_coord, usize max_tiles, struct hexmap_path *output_path) {
+	assert(map != NULL);
+	assert(dijkstra_map != NULL);
+	assert(output_path != NULL);
+	assert(hexmap_is_valid_coord(map, start_coord));
+
+	const usize start = hexmap_coord_to_index(map, start_coord);
+	output_path->start = start_coord;
+	output_path->goal = start_coord;
+	output_path->distance_in_tiles = 0;
+	output_path->cost = 0;
+	output_path->tiles = NULL;
+	output_path->owns_tiles = 0;
+
+	// Each step strictly lowers the value, so the walk can not loop.
+	usize goal = start;
+	while (output_path->distance_in_tiles < max_tiles) {
+		const usize next = hexmap_dijkstra_map_step(map, dijkstra_map, goal);
+		if (next == goal) break;
+		output_path->cost += tile_cost(map, next);
+		++output_path->distance_in_tiles;
+		goal = next;
+	}
+
+	if (output_path->distance_in_tiles == 0) {
+		output_path->result = HEXMAP_PATH_ERROR;
+		return output_path->result;
+	}
+
+	// Stored goal first, like the paths of the regular search.
+	const usize tiles_len = output_path->distance_in_tiles + 1;
+	output_path->tiles = malloc(tiles_len * sizeof(*output_path->tiles));
+	output_path->owns_tiles = 1;
+	usize index = start;
+	for (usize i = tiles_len; i-- > 0;) {
+		output_path->tiles[i] = index;
+		if (i > 0) {
+			index = hexmap_dijkstra_map_step(map, dijkstra_map, index);
+		}
+	}
+	assert(output_path->tiles[0] == goal);
+
+	output_path->goal = hexmap_index_to_coord(map, goal);
+	output_path->result = HEXMAP_PATH_OK;
+	return output_path->result;
+}
+
 int hexmap_is_tile_obstacle(struct hexmap *map, struct hexcoord coord) {
 	assert(map != NULL);
 	assert(hexmap_is_valid_coord(map, coord));
-	usize i = hexmap_coord_to_index(map, coord);
-	return map->tiles[i].movement_cost >= HEXMAP_MOVEMENT_COST_MAX
-		|| map->tiles[i].occupied_by != 0;
+	return bitset_get(map->blocked, hexmap_coord_to_index(map, coord));
 }
 
 ////////////
 // STATIC //
 ////////////
 
+// Cost to enter a tile. Obstacles are handled by hexmap_is_tile_obstacle(),
+// costs below 1 count as 1 to keep the search heuristic admissible.
+static u32 tile_cost(struct hexmap *map, usize index) {
+	const u32 cost = map->movement_cost[index];
+	return (cost > 0) ? cost : 1;
+}
+
+static void update_blocked(struct hexmap *map, usize index) {
+	const int is_blocked = map->movement_cost[index] >= HEXMAP_MOVEMENT_COST_MAX
+		|| map->occupied_by[index] != 0;
+	bitset_assign(map->blocked, index, is_blocked);
+}
+
+// Breadth first search from `start`. `came_from[tile]` is the index of the
+// tile 1 step closer to `start`, `distance` is optional.
+static void flowfield_generate(struct hexmap *map, usize start, usize *came_from, u32 *distance) {
+	const usize map_size = (usize)map->w * map->h;
+	// Each tile is queued at most once, the workspace queue never wraps.
+	struct hexmap_path_workspace *ws = &map->path_workspace;
+	hexmap_path_workspace_begin(ws, map_size);
+	usize frontier_head = 0, frontier_tail = 0;
+	ws->frontier[frontier_tail++] = start;
+
+	for (usize i = 0; i < map_size; ++i)
+		came_from[i] = NODE_NOT_VISITED;
+	came_from[start] = NODE_NONE;
+	if (distance != NULL) {
+		for (usize i = 0; i < map_size; ++i)
+			distance[i] = HEXMAP_FLOWFIELD_UNREACHABLE;
+		distance[start] = 0;
+	}
+
+	usize NUMBER_OF_ITERATIONS = 0;
+	while (frontier_head < frontier_tail) {
+		usize current_node_i = ws->frontier[frontier_head++];
+		++ws->expanded;
+		// Check all neighboring nodes.
+		usize neighbors[HEXMAP_MAX_NEIGHBORS];
+		const usize neighbors_len = hexmap_neighbors(map, current_node_i, neighbors);
+		for (usize n = 0; n < neighbors_len; ++n) {
+			usize next_i = neighbors[n];
+			if (bitset_get(map->blocked, next_i)) {
+				continue;
+			}
+			if (came_from[next_i] == NODE_NOT_VISITED) {
+				ws->frontier[frontier_tail++] = next_i;
+				came_from[next_i] = current_node_i;
+				if (distance != NULL) {
+					distance[next_i] = distance[current_node_i] + 1;
+				}
+			}
+		}
+		assert(NUMBER_OF_ITERATIONS++ < map_size);
+	}
+}
+
+// Disconnects `tile` and every tile whose path leads through it. These
+// are appended to the workspace `frontier`. Since paths only take single
+// steps, all tiles depending on `tile` are its neighbors or theirs.
+static void flowfield_invalidate(struct hexmap_flowfield *flowfield, struct hexmap *map, usize tile, usize *invalid_len) {
+	struct hexmap_path_workspace *ws = &map->path_workspace;
+	if (flowfield->distance[tile] == HEXMAP_FLOWFIELD_UNREACHABLE) {
+		return;
+	}
+
+	usize head = *invalid_len;
+	flowfield->distance[tile] = HEXMAP_FLOWFIELD_UNREACHABLE;
+	ws->frontier[(*invalid_len)++] = tile;
+	while (head < *invalid_len) {
+		const usize current = ws->frontier[head++];
+		usize neighbors[HEXMAP_MAX_NEIGHBORS];
+		const usize neighbors_len = hexmap_neighbors(map, current, neighbors);
+		for (usize n = 0; n < neighbors_len; ++n) {
+			const usize next = neighbors[n];
+			if (flowfield->came_from[next] != current || flowfield->distance[next] == HEXMAP_FLOWFIELD_UNREACHABLE) continue;
+			flowfield->distance[next] = HEXMAP_FLOWFIELD_UNREACHABLE;
+			ws->frontier[(*invalid_len)++] = next;
+		}
+		flowfield->came_from[current] = NODE_NOT_VISITED;
+	}
+}
+
+// Connects an unreachable `tile` to its closest reachable neighbor and
+// queues it, hexmap_flowfield_update() spreads the change from there.
+static void flowfield_reconnect(struct hexmap_flowfield *flowfield, struct hexmap *map, usize tile) {
+	struct hexmap_path_workspace *ws = &map->path_workspace;
+	if (bitset_get(map->blocked, tile) || flowfield->distance[tile] != HEXMAP_FLOWFIELD_UNREACHABLE) {
+		return;
+	}
+
+	usize neighbors[HEXMAP_MAX_NEIGHBORS];
+	const usize neighbors_len = hexmap_neighbors(map, tile, neighbors);
+	for (usize n = 0; n < neighbors_len; ++n) {
+		const usize next = neighbors[n];
+		if (flowfield->distance[next] == HEXMAP_FLOWFIELD_UNREACHABLE) continue;
+		if (flowfield->distance[next] + 1 < flowfield->distance[tile]) {
+			flowfield->distance[tile] = flowfield->distance[next] + 1;
+			flowfield->came_from[tile] = next;
+		}
+	}
+
+	if (flowfield->distance[tile] != HEXMAP_FLOWFIELD_UNREACHABLE) {
+		heap_push(&ws->open, tile, flowfield->distance[tile]);
+		ws->visited[tile] = ws->generation;
+	}
+}
+
+// Breadth first search, every tile costs the same.
+static void path_find_unweighted(struct hexmap *map, struct hexmap_path_workspace *ws, usize start, usize goal, enum path_find_flags flags, struct hexmap_path *output_path) {
+	const usize map_size = (usize)map->w * map->h;
+	const uint32_t generation = ws->generation;
+
+	// Each tile is queued at most once, the queue never wraps.
+	usize frontier_head = 0, frontier_tail = 0;
+	ws->frontier[frontier_tail++] = start;
+	ws->visited[start] = generation;
+	ws->came_from[start] = NODE_NONE;
+
+	{ // store relevant nodes in the `came_from` flowfield
+		usize NUMBER_OF_ITERATIONS = 0;
+		while (frontier_head < frontier_tail) {
+			usize current_node_i = ws->frontier[frontier_head++];
+			++ws->expanded;
+			// Early Exit
+			if (current_node_i == goal) {
+				break;
+			}
+			// Check all neighboring nodes.
+			usize neighbors[HEXMAP_MAX_NEIGHBORS];
+			const usize neighbors_len = hexmap_neighbors(map, current_node_i, neighbors);
+			for (usize n = 0; n < neighbors_len; ++n) {
+				usize next_i = neighbors[n];
+				// If goal is a neighbor of the current tile, we update
+				// the output path goal to it. No need to search further.
+				if ((flags & PATH_FLAGS_FIND_NEIGHBOR) && next_i == goal) {
+					output_path->goal = hexmap_index_to_coord(map, current_node_i);
+					return;
+				}
+				if (bitset_get(map->blocked, next_i)) {
+					continue;
+				}
+				if (ws->visited[next_i] != generation) {
+					ws->frontier[frontier_tail++] = next_i;
+					ws->visited[next_i] = generation;
+					ws->came_from[next_i] = current_node_i;
+				}
+			}
+			assert(NUMBER_OF_ITERATIONS++ < map_size);
+		}
+	}
+}
+
+// A* over `movement_cost`, with the hex distance as heuristic. Since each
+// step costs at least 1, the heuristic is consistent and every tile is
+// expanded at most once.
+static void path_find_weighted(struct hexmap *map, struct hexmap_path_workspace *ws, usize start, usize goal, enum path_find_flags flags, struct hexmap_path *output_path) {
+	const uint32_t generation = ws->generation;
+	const struct hexcoord goal_coord = hexmap_index_to_coord(map, goal);
+	const int find_neighbor = IS_FLAG_SET(flags, PATH_FLAGS_FIND_NEIGHBOR);
+
+	// A tile is open if it was visited, but is not closed yet.
+	ws->visited[start] = generation;
+	ws->came_from[start] = NODE_NONE;
+	ws->cost[start] = 0;
+	heap_push(&ws->open, start, 0);
+
+	while (ws->open.len > 0) {
+		const usize current = heap_pop(&ws->open, NULL);
+		ws->closed[current] = generation;
+		++ws->expanded;
+
+		const struct hexcoord current_coord = hexmap_index_to_coord(map, current);
+		if (current == goal) {
+			break;
+		}
+		// With PATH_FLAGS_FIND_NEIGHBOR, any tile next to the goal is good enough.
+		if (find_neighbor && hexcoord_distance(current_coord, goal_coord) == 1) {
+			output_path->goal = current_coord;
+			break;
+		}
+
+		usize neighbors[HEXMAP_MAX_NEIGHBORS];
+		const usize neighbors_len = hexmap_neighbors(map, current, neighbors);
+		for (usize n = 0; n < neighbors_len; ++n) {
+			const usize next = neighbors[n];
+			if (ws->closed[next] == generation) continue;
+			if (bitset_get(map->blocked, next)) continue;
+
+			const int is_open = (ws->visited[next] == generation);
+			const u32 next_cost = ws->cost[current] + tile_cost(map, next);
+			if (is_open && next_cost >= ws->cost[next]) continue;
+
+			int heuristic = hexcoord_distance(hexmap_index_to_coord(map, next), goal_coord);
+			if (find_neighbor && heuristic > 0) {
+				heuristic -= 1;
+			}
+
+			ws->visited[next] = generation;
+			ws->cost[next] = next_cost;
+			ws->came_from[next] = current;
+			if (is_open) {
+				heap_decrease(&ws->open, next, next_cost + heuristic);
+			} else {
+				heap_push(&ws->open, next, next_cost + heuristic);
+			}
+		}
+	}
+}
+
+// Walks back from `goal` to `start` to build the final path. The path is
+// measured first, so exactly as much memory as needed is allocated.
+static void path_build_from_workspace(struct hexmap *map, struct hexmap_path_workspace *ws, struct arena *arena, usize start, usize goal, struct hexmap_path *output_path) {
+	const usize map_size = (usize)map->w * map->h;
+	const uint32_t generation = ws->generation;
+
+	output_path->distance_in_tiles = 0;
+	output_path->cost = 0;
+	if (ws->visited[goal] != generation) {
+		output_path->result = HEXMAP_PATH_INCOMPLETE_FLOWFIELD;
+		return;
+	}
+
+	usize walk_back_iter = goal;
+	usize NUMBER_OF_ITERATIONS = 0;
+	while (walk_back_iter != start) {
+		assert(walk_back_iter < map_size);
+		assert(ws->visited[walk_back_iter] == generation);
+		output_path->cost += tile_cost(map, walk_back_iter);
+		walk_back_iter = ws->came_from[walk_back_iter];
+		++output_path->distance_in_tiles;
+		assert(NUMBER_OF_ITERATIONS++ < map_size);
+	}
+
+	// We do not want to count the start tile as part of the resulting path,
+	// but it might be nice to have?
+	// TODO: Store the start in hexmap_find_path() result?
+	const usize tiles_len = output_path->distance_in_tiles + 1;
+	if (arena != NULL) {
+		output_path->tiles = arena_alloc(arena, tiles_len * sizeof(*output_path->tiles));
+		output_path->owns_tiles = 0;
+	} else {
+		output_path->tiles = malloc(tiles_len * sizeof(*output_path->tiles));
+		output_path->owns_tiles = 1;
+	}
+
+	walk_back_iter = goal;
+	for (usize i = 0; i < tiles_len; ++i) {
+		output_path->tiles[i] = walk_back_iter;
+		walk_back_iter = ws->came_from[walk_back_iter];
+	}
+	assert(output_path->tiles[0] == goal);
+	assert(output_path->tiles[output_path->distance_in_tiles] == start);
+	output_path->result = HEXMAP_PATH_OK;
+}
+
 static void load_hextile_models(struct hexmap *map) {
 	assert(map != NULL);
 	const char *models[] = {
@@ -5,13 +5,14 @@
 #include <cglm/vec2.h>
 #include <cglm/vec3.h>
 #include "util/util.h"
+#include "util/heap.h"
 #include "gl/camera.h"
 #include "gl/model.h"
 #include "gl/shader.h"
 
 struct engine;
+struct arena;
 
-#define HEXMAP_MAX_EDGES     6
 #define HEXMAP_MAX_NEIGHBORS 6
 
 #define HEXMAP_MOVEMENT_COST_MAX 200
@@ -32,7 +33,10 @@ enum hexmap_path_result {
 
 enum path_find_flags {
 	PATH_FLAGS_NONE          = 0,
+	// stop at the tile next to the goal, e.g. when the goal is occupied.
 	PATH_FLAGS_FIND_NEIGHBOR = 1 << 0,
+	// breadth first search, ignores `movement_cost` (besides obstacles).
+	PATH_FLAGS_UNWEIGHTED    = 1 << 1,
 };
 
 enum hexmap_neighbor {
@@ -47,12 +51,12 @@ enum hexmap_neighbor {
 	HEXMAP_N_LAST  = HEXMAP_NE
 };
 
+// Visual state of a tile. Everything the pathfinder reads is
+// stored separately in `struct hexmap`.
 struct hextile {
 	u16 tile;
 	i16 rotation;
 	u8 highlight;
-	u8 movement_cost;
-	ecs_entity_t occupied_by;
 };
 
 struct hexcoord {
@@ -60,6 +64,22 @@ struct hexcoord {
 	int y;
 };
 
+// Scratch memory for path queries, reused between queries. An entry is
+// only valid if its stamp equals `generation`, so a new query just bumps
+// `generation` instead of clearing everything.
+struct hexmap_path_workspace {
+	usize capacity;
+	uint32_t generation;
+	uint32_t *visited; // `came_from` and `cost` are valid
+	uint32_t *closed;  // tile was already expanded
+	usize *came_from;
+	u32 *cost;
+	usize *frontier;
+	struct heap open;
+	// tiles expanded by the last query, for benchmarks.
+	usize expanded;
+};
+
 struct hexmap {
 	// General
 	int w, h;
@@ -67,7 +87,18 @@ struct hexmap {
 
 	// Tiles
 	struct hextile *tiles;
-	usize *edges;
+
+	// Pathfinding, one entry per tile. Neighbors are computed from the
+	// offset coordinates, see hexmap_neighbors().
+	// Only change these with hexmap_set_movement_cost() and
+	// hexmap_set_occupied_by(), they keep `blocked` up to date.
+	u8 *movement_cost;
+	ecs_entity_t *occupied_by;
+	// bitset, tile is either impassable or occupied.
+	uint64_t *blocked;
+	// increases whenever `movement_cost` or `blocked` change.
+	uint64_t version;
+	struct hexmap_path_workspace path_workspace;
 
 	// Rendering
 	shader_t tile_shader;
@@ -78,22 +109,46 @@ struct hexmap {
 	usize highlight_tile_index;
 };
 
+// Flowfield that is repaired instead of regenerated when tiles change.
+// `came_from` has the same layout as the output of hexmap_generate_flowfield().
+struct hexmap_flowfield {
+	struct hexcoord origin;
+	usize *came_from;
+	// steps to `origin`, HEXMAP_FLOWFIELD_UNREACHABLE if there is no path.
+	u32 *distance;
+	// `map->blocked` as of the last update.
+	uint64_t *blocked;
+	uint64_t version;
+};
+
+#define HEXMAP_FLOWFIELD_UNREACHABLE ((u32)-1)
+
 struct hexmap_path {
 	enum hexmap_path_result result;
 	struct hexcoord start;
 	struct hexcoord goal;
 	usize distance_in_tiles;
+	// sum of `movement_cost` of all tiles entered along the path
+	usize cost;
 	usize *tiles;
+	// `tiles` was malloc'd, otherwise it belongs to an arena.
+	int owns_tiles;
 };
 
 // coordinates
 int hexcoord_equal(struct hexcoord a, struct hexcoord b);
+int hexcoord_distance(struct hexcoord a, struct hexcoord b);
 int hexmap_is_valid_coord(struct hexmap *, struct hexcoord);
 int hexmap_is_valid_index(struct hexmap *, usize index);
 
-//
-void hexmap_init(struct hexmap *, struct engine *);
+// map data, does not need a rendering context.
+void hexmap_init(struct hexmap *, int w, int h);
+int hexmap_init_from_file(struct hexmap *, const char *path);
 void hexmap_destroy(struct hexmap *);
+
+// rendering
+void hexmap_init_render(struct hexmap *, struct engine *);
+void hexmap_destroy_render(struct hexmap *);
 void hexmap_draw(struct hexmap *, struct camera *, vec3 player_pos);
 
 // coordinate systems
@@ -105,18 +160,41 @@ usize           hexmap_world_position_to_index(struct hexmap *, vec2s position);
 struct hexcoord hexmap_world_position_to_coord(struct hexmap *, vec2s position);
 struct hexcoord hexmap_get_neighbor_coord     (struct hexmap *, struct hexcoord tile, enum hexmap_neighbor neighbor);
 struct hextile *hexmap_tile_at                (struct hexmap *, struct hexcoord at);
+usize           hexmap_neighbors              (struct hexmap *, usize index, usize neighbors[HEXMAP_MAX_NEIGHBORS]);
+
+// tile state
+void         hexmap_set_movement_cost(struct hexmap *, struct hexcoord, u8 movement_cost);
+u8           hexmap_movement_cost    (struct hexmap *, struct hexcoord);
+void         hexmap_set_occupied_by  (struct hexmap *, struct hexcoord, ecs_entity_t);
+ecs_entity_t hexmap_occupied_by      (struct hexmap *, struct hexcoord);
 
 void hexmap_set_tile_effect(struct hexmap *, struct hexcoord, enum hexmap_tile_effect);
 void hexmap_clear_tile_effect(struct hexmap *, enum hexmap_tile_effect);
 
 
 // flowfield
-void hexmap_generate_edges(struct hexmap *map);
 void hexmap_generate_flowfield(struct hexmap *map, struct hexcoord start_coord, usize flowfield_len, usize *flowfield);
-usize hexmap_flowfield_distance(struct hexmap *map, struct hexcoord goal, usize flowfield_len, usize flowfield[flowfield_len]);
+usize hexmap_flowfield_distance(struct hexmap *map, struct hexcoord goal, usize flowfield_len, const usize flowfield[flowfield_len]);
+void hexmap_flowfield_init(struct hexmap_flowfield *, struct hexmap *, struct hexcoord origin);
+void hexmap_flowfield_destroy(struct hexmap_flowfield *);
+void hexmap_flowfield_update(struct hexmap_flowfield *, struct hexmap *);
+// dijkstra maps
+#define HEXMAP_DIJKSTRA_UNREACHABLE UINT32_MAX
+struct hexmap_dijkstra_source {
+	struct hexcoord coord;
+	// added to the distance of every tile, sources with a lower cost attract more.
+	uint32_t cost;
+};
+void hexmap_generate_dijkstra_map(struct hexmap *, usize sources_len, const struct hexmap_dijkstra_source sources[sources_len], usize dijkstra_map_len, uint32_t *dijkstra_map);
+usize hexmap_dijkstra_map_step(struct hexmap *, const uint32_t *dijkstra_map, usize index);
+enum hexmap_path_result hexmap_dijkstra_map_path(struct hexmap *, const uint32_t *dijkstra_map, struct hexcoord start, usize max_tiles, struct hexmap_path *);
 // pathfinding
+void hexmap_path_workspace_init(struct hexmap_path_workspace *, usize capacity);
+void hexmap_path_workspace_destroy(struct hexmap_path_workspace *);
+void hexmap_path_workspace_begin(struct hexmap_path_workspace *, usize capacity);
 enum hexmap_path_result hexmap_path_find(struct hexmap *, struct hexcoord start, struct hexcoord goal, struct hexmap_path *);
 enum hexmap_path_result hexmap_path_find_ex(struct hexmap *, struct hexcoord start, struct hexcoord goal, enum path_find_flags, struct hexmap_path *);
+enum hexmap_path_result hexmap_path_find_with(struct hexmap *, struct hexmap_path_workspace *, struct arena *, struct hexcoord start, struct hexcoord goal, enum path_find_flags, struct hexmap_path *);
 void hexmap_path_destroy(struct hexmap_path *);
 usize hexmap_path_at(struct hexmap_path *, usize index);
 
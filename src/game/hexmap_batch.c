@@ -0,0 +1,153 @@
+#include "game/hexmap_batch.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util/bitset.h"
+
+/////////////
+// PRIVATE //
+/////////////
+
+static int worker_run(void *);
+static void work_on_batch(struct hexmap_path_workers *, struct hexmap_path_workspace *);
+static void snapshot_map(struct hexmap_path_workers *, struct hexmap *);
+
+////////////
+// PUBLIC //
+////////////
+
+// Starts `threads_len` worker threads, the calling thread helps out as
+// well. With 0 threads, or if no thread could be started (e.g. on the
+// web), batches simply run on the calling thread.
+void hexmap_path_workers_init(struct hexmap_path_workers *workers, int threads_len) {
+	assert(workers != NULL);
+	assert(threads_len >= 0);
+
+	*workers = (struct hexmap_path_workers){ 0 };
+	workers->work_ready = SDL_CreateSemaphore(0);
+	workers->work_done = SDL_CreateSemaphore(0);
+	assert(workers->work_ready != NULL && workers->work_done != NULL);
+
+	// workspaces grow on first use
+	workers->workspaces_len = threads_len + 1;
+	workers->workspaces = malloc(workers->workspaces_len * sizeof(*workers->workspaces));
+	for (int i = 0; i < workers->workspaces_len; ++i) {
+		hexmap_path_workspace_init(&workers->workspaces[i], 1);
+	}
+
+	workers->threads = malloc(threads_len * sizeof(*workers->threads));
+	for (int i = 0; i < threads_len; ++i) {
+		SDL_Thread *thread = SDL_CreateThread(worker_run, "hexmap_path_worker", workers);
+		if (thread == NULL) {
+			SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Could not start path worker: %s", SDL_GetError());
+			break;
+		}
+		workers->threads[workers->threads_len++] = thread;
+	}
+}
+
+void hexmap_path_workers_destroy(struct hexmap_path_workers *workers) {
+	assert(workers != NULL);
+
+	workers->quit = 1;
+	for (int i = 0; i < workers->threads_len; ++i) {
+		SDL_SemPost(workers->work_ready);
+	}
+	for (int i = 0; i < workers->threads_len; ++i) {
+		SDL_WaitThread(workers->threads[i], NULL);
+	}
+	free(workers->threads);
+
+	for (int i = 0; i < workers->workspaces_len; ++i) {
+		hexmap_path_workspace_destroy(&workers->workspaces[i]);
+	}
+	free(workers->workspaces);
+	free(workers->movement_cost);
+	free(workers->blocked);
+
+	SDL_DestroySemaphore(workers->work_done);
+	SDL_DestroySemaphore(workers->work_ready);
+	*workers = (struct hexmap_path_workers){ 0 };
+}
+
+void hexmap_path_find_batch(struct hexmap_path_workers *workers, struct hexmap *map, usize requests_len, const struct hexmap_path_request requests[requests_len], struct hexmap_path results[requests_len]) {
+	assert(workers != NULL);
+	assert(map != NULL);
+	assert(requests_len == 0 || (requests != NULL && results != NULL));
+	assert(requests_len < (usize)SDL_MAX_SINT32);
+	if (requests_len == 0) {
+		return;
+	}
+
+	snapshot_map(workers, map);
+	workers->requests_len = requests_len;
+	workers->requests = requests;
+	workers->results = results;
+	SDL_AtomicSet(&workers->next_request, 0);
+
+	// Waking a thread for less than one request is not worth it.
+	const int wake_len = (requests_len - 1 < (usize)workers->threads_len) ? (int)requests_len - 1 : workers->threads_len;
+	for (int i = 0; i < wake_len; ++i) {
+		SDL_SemPost(workers->work_ready);
+	}
+	work_on_batch(workers, &workers->workspaces[workers->threads_len]);
+	for (int i = 0; i < wake_len; ++i) {
+		SDL_SemWait(workers->work_done);
+	}
+
+	workers->requests = NULL;
+	workers->results = NULL;
+}
+
+////////////
+// STATIC //
+////////////
+
+static int worker_run(void *userdata) {
+	struct hexmap_path_workers *workers = userdata;
+
+	// Threads take the workspaces in the order they start.
+	const int index = SDL_AtomicAdd(&workers->threads_started, 1);
+	struct hexmap_path_workspace *ws = &workers->workspaces[index];
+
+	for (;;) {
+		SDL_SemWait(workers->work_ready);
+		if (workers->quit) break;
+		work_on_batch(workers, ws);
+		SDL_SemPost(workers->work_done);
+	}
+
+	return 0;
+}
+
+// Takes requests one at a time until none are left.
+static void work_on_batch(struct hexmap_path_workers *workers, struct hexmap_path_workspace *ws) {
+	for (;;) {
+		const usize i = (usize)SDL_AtomicAdd(&workers->next_request, 1);
+		if (i >= workers->requests_len) break;
+
+		const struct hexmap_path_request *request = &workers->requests[i];
+		hexmap_path_find_with(&workers->map, ws, NULL, request->start, request->goal, request->flags, &workers->results[i]);
+	}
+}
+
+// The searches only read the size, the movement costs and the obstacles.
+static void snapshot_map(struct hexmap_path_workers *workers, struct hexmap *map) {
+	const usize map_size = (usize)map->w * map->h;
+	if (map_size > workers->snapshot_capacity) {
+		workers->movement_cost = realloc(workers->movement_cost, map_size * sizeof(*workers->movement_cost));
+		workers->blocked = realloc(workers->blocked, bitset_words(map_size) * sizeof(*workers->blocked));
+		assert(workers->movement_cost != NULL && workers->blocked != NULL);
+		workers->snapshot_capacity = map_size;
+	}
+	memcpy(workers->movement_cost, map->movement_cost, map_size * sizeof(*workers->movement_cost));
+	memcpy(workers->blocked, map->blocked, bitset_words(map_size) * sizeof(*workers->blocked));
+
+	workers->map = *map;
+	workers->map.movement_cost = workers->movement_cost;
+	workers->map.blocked = workers->blocked;
+	// nothing else is copied.
+	workers->map.tiles = NULL;
+	workers->map.occupied_by = NULL;
+}
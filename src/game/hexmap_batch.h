@@ -0,0 +1,54 @@
+#ifndef HEXMAP_BATCH_H
+#define HEXMAP_BATCH_H
+
+#include <SDL.h>
+#include "game/hexmap.h"
+
+// Answers many path queries at once on a fixed pool of worker threads.
+//
+// Every thread has its own scratch memory. The batch searches a copy of
+// the map's movement costs and obstacles taken when it starts, so the map
+// may change meanwhile. Each result is written to the slot of its request,
+// so the output is the same no matter how the requests are split between
+// threads.
+
+struct hexmap_path_request {
+	struct hexcoord start;
+	struct hexcoord goal;
+	enum path_find_flags flags;
+};
+
+struct hexmap_path_workers {
+	int threads_len;
+	SDL_Thread **threads;
+	SDL_atomic_t threads_started;
+	// one per thread, the last one belongs to the calling thread.
+	int workspaces_len;
+	struct hexmap_path_workspace *workspaces;
+	SDL_sem *work_ready;
+	SDL_sem *work_done;
+	int quit;
+
+	// copy of the map for the current batch, `movement_cost` and
+	// `blocked` point to the buffers below.
+	struct hexmap map;
+	usize snapshot_capacity;
+	u8 *movement_cost;
+	uint64_t *blocked;
+
+	// current batch
+	usize requests_len;
+	const struct hexmap_path_request *requests;
+	struct hexmap_path *results;
+	SDL_atomic_t next_request;
+};
+
+void hexmap_path_workers_init(struct hexmap_path_workers *, int threads_len);
+void hexmap_path_workers_destroy(struct hexmap_path_workers *);
+
+// Blocks until all requests are done. Results are malloc'd and have to be
+// destroyed with hexmap_path_destroy().
+void hexmap_path_find_batch(struct hexmap_path_workers *, struct hexmap *, usize requests_len, const struct hexmap_path_request requests[requests_len], struct hexmap_path results[requests_len]);
+
+#endif
+
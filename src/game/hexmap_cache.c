@@ -0,0 +1,194 @@
+#include "game/hexmap_cache.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util/util.h"
+
+/////////////
+// PRIVATE //
+/////////////
+
+static struct hexmap_cache_entry *find_entry(struct hexmap_cache *, enum hexmap_cache_kind, usize origin, usize goal, enum path_find_flags);
+static struct hexmap_cache_entry *find_outdated_flowfield(struct hexmap_cache *, usize origin);
+static struct hexmap_cache_entry *replace_entry(struct hexmap_cache *, enum hexmap_cache_kind);
+static void destroy_entry(struct hexmap_cache_entry *);
+static void copy_path(const struct hexmap_path *from, struct hexmap_path *to);
+
+////////////
+// PUBLIC //
+////////////
+
+void hexmap_cache_init(struct hexmap_cache *cache, struct hexmap *map, usize capacity) {
+	assert(cache != NULL);
+	assert(map != NULL);
+	assert(capacity > 0);
+	cache->map = map;
+	cache->capacity = capacity;
+	cache->entries = calloc(capacity, sizeof(*cache->entries));
+	cache->use_clock = 0;
+	cache->hits = 0;
+	cache->repairs = 0;
+	cache->misses = 0;
+}
+
+void hexmap_cache_destroy(struct hexmap_cache *cache) {
+	assert(cache != NULL);
+	hexmap_cache_clear(cache);
+	free(cache->entries);
+	cache->entries = NULL;
+	cache->capacity = 0;
+}
+
+void hexmap_cache_clear(struct hexmap_cache *cache) {
+	assert(cache != NULL);
+	for (usize i = 0; i < cache->capacity; ++i) {
+		destroy_entry(&cache->entries[i]);
+	}
+}
+
+// Same as hexmap_path_find_ex(). The result is a copy and has to be
+// destroyed with hexmap_path_destroy() as usual.
+enum hexmap_path_result hexmap_cache_path_find(struct hexmap_cache *cache, struct hexcoord start, struct hexcoord goal, enum path_find_flags flags, struct hexmap_path *output_path) {
+	assert(cache != NULL);
+	assert(output_path != NULL);
+	struct hexmap *map = cache->map;
+
+	if (!hexmap_is_valid_coord(map, start) || !hexmap_is_valid_coord(map, goal)) {
+		return hexmap_path_find_ex(map, start, goal, flags, output_path);
+	}
+
+	const usize origin = hexmap_coord_to_index(map, start);
+	const usize target = hexmap_coord_to_index(map, goal);
+	++cache->use_clock;
+
+	struct hexmap_cache_entry *entry = find_entry(cache, HEXMAP_CACHE_PATH, origin, target, flags);
+	if (entry != NULL) {
+		++cache->hits;
+	} else {
+		++cache->misses;
+		entry = replace_entry(cache, HEXMAP_CACHE_PATH);
+		entry->origin = origin;
+		entry->goal = target;
+		entry->flags = flags;
+		hexmap_path_find_ex(map, start, goal, flags, &entry->path);
+	}
+	entry->last_used = cache->use_clock;
+
+	copy_path(&entry->path, output_path);
+	return output_path->result;
+}
+
+// Flowfield as generated by hexmap_generate_flowfield(). The memory
+// belongs to the cache and is valid until the next call into it.
+const usize *hexmap_cache_flowfield(struct hexmap_cache *cache, struct hexcoord origin_coord) {
+	assert(cache != NULL);
+	struct hexmap *map = cache->map;
+	assert(hexmap_is_valid_coord(map, origin_coord));
+
+	const usize origin = hexmap_coord_to_index(map, origin_coord);
+	++cache->use_clock;
+
+	struct hexmap_cache_entry *entry = find_entry(cache, HEXMAP_CACHE_FLOWFIELD, origin, 0, PATH_FLAGS_NONE);
+	if (entry != NULL) {
+		++cache->hits;
+	} else if ((entry = find_outdated_flowfield(cache, origin)) != NULL) {
+		++cache->repairs;
+		hexmap_flowfield_update(&entry->flowfield, map);
+		entry->version = map->version;
+	} else {
+		++cache->misses;
+		entry = replace_entry(cache, HEXMAP_CACHE_FLOWFIELD);
+		entry->origin = origin;
+		entry->goal = 0;
+		entry->flags = PATH_FLAGS_NONE;
+		hexmap_flowfield_init(&entry->flowfield, map, origin_coord);
+	}
+	entry->last_used = cache->use_clock;
+
+	return entry->flowfield.came_from;
+}
+
+// Share of lookups answered from the cache, between 0 and 1.
+// Repaired flowfields do not count as hits.
+float hexmap_cache_hit_rate(struct hexmap_cache *cache) {
+	assert(cache != NULL);
+	const usize lookups = cache->hits + cache->repairs + cache->misses;
+	return (lookups > 0) ? (float)cache->hits / lookups : 0.0f;
+}
+
+////////////
+// STATIC //
+////////////
+
+static struct hexmap_cache_entry *find_entry(struct hexmap_cache *cache, enum hexmap_cache_kind kind, usize origin, usize goal, enum path_find_flags flags) {
+	for (usize i = 0; i < cache->capacity; ++i) {
+		struct hexmap_cache_entry *entry = &cache->entries[i];
+		if (entry->kind != kind || entry->version != cache->map->version) continue;
+		if (entry->origin != origin || entry->goal != goal || entry->flags != flags) continue;
+
+		return entry;
+	}
+
+	return NULL;
+}
+
+static struct hexmap_cache_entry *find_outdated_flowfield(struct hexmap_cache *cache, usize origin) {
+	for (usize i = 0; i < cache->capacity; ++i) {
+		struct hexmap_cache_entry *entry = &cache->entries[i];
+		if (entry->kind == HEXMAP_CACHE_FLOWFIELD && entry->origin == origin) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+// Picks an empty entry or an outdated path, or else the least recently
+// used entry. Outdated flowfields are kept, they can still be repaired.
+static struct hexmap_cache_entry *replace_entry(struct hexmap_cache *cache, enum hexmap_cache_kind kind) {
+	struct hexmap_cache_entry *entry = &cache->entries[0];
+	for (usize i = 0; i < cache->capacity; ++i) {
+		struct hexmap_cache_entry *candidate = &cache->entries[i];
+		if (candidate->kind == HEXMAP_CACHE_EMPTY
+				|| (candidate->kind == HEXMAP_CACHE_PATH && candidate->version != cache->map->version)) {
+			entry = candidate;
+			break;
+		}
+		if (candidate->last_used < entry->last_used) {
+			entry = candidate;
+		}
+	}
+
+	destroy_entry(entry);
+	entry->kind = kind;
+	entry->version = cache->map->version;
+	return entry;
+}
+
+static void destroy_entry(struct hexmap_cache_entry *entry) {
+	switch (entry->kind) {
+	case HEXMAP_CACHE_PATH:
+		hexmap_path_destroy(&entry->path);
+		break;
+	case HEXMAP_CACHE_FLOWFIELD:
+		hexmap_flowfield_destroy(&entry->flowfield);
+		break;
+	case HEXMAP_CACHE_EMPTY:
+		break;
+	}
+	entry->kind = HEXMAP_CACHE_EMPTY;
+}
+
+static void copy_path(const struct hexmap_path *from, struct hexmap_path *to) {
+	*to = *from;
+	to->owns_tiles = 0;
+	if (from->tiles != NULL) {
+		// tiles are stored goal first, including the start.
+		const usize tiles_len = from->distance_in_tiles + 1;
+		to->tiles = malloc(tiles_len * sizeof(*to->tiles));
+		memcpy(to->tiles, from->tiles, tiles_len * sizeof(*to->tiles));
+		to->owns_tiles = 1;
+	}
+}
+
@@ -0,0 +1,51 @@
+#ifndef HEXMAP_CACHE_H
+#define HEXMAP_CACHE_H
+
+#include "game/hexmap.h"
+
+// Remembers recent paths and flowfields of a hexmap. Entries are tagged
+// with the `version` of the map, so any change to the board invalidates
+// them. Outdated flowfields are repaired instead of being regenerated.
+// Full caches replace the least recently used entry.
+
+enum hexmap_cache_kind {
+	HEXMAP_CACHE_EMPTY = 0,
+	HEXMAP_CACHE_PATH,
+	HEXMAP_CACHE_FLOWFIELD,
+};
+
+struct hexmap_cache_entry {
+	enum hexmap_cache_kind kind;
+	usize origin;
+	usize goal;
+	enum path_find_flags flags;
+	uint64_t version;
+	uint64_t last_used;
+
+	struct hexmap_path path;
+	struct hexmap_flowfield flowfield;
+};
+
+struct hexmap_cache {
+	struct hexmap *map;
+	usize capacity;
+	struct hexmap_cache_entry *entries;
+	uint64_t use_clock;
+
+	// statistics
+	usize hits;
+	usize repairs;
+	usize misses;
+};
+
+void hexmap_cache_init(struct hexmap_cache *, struct hexmap *, usize capacity);
+void hexmap_cache_destroy(struct hexmap_cache *);
+void hexmap_cache_clear(struct hexmap_cache *);
+
+enum hexmap_path_result hexmap_cache_path_find(struct hexmap_cache *, struct hexcoord start, struct hexcoord goal, enum path_find_flags, struct hexmap_path *);
+const usize *hexmap_cache_flowfield(struct hexmap_cache *, struct hexcoord origin);
+
+float hexmap_cache_hit_rate(struct hexmap_cache *);
+
+#endif
+
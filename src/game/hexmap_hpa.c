@@ -0,0 +1,682 @@
+#include "game/hexmap_hpa.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stb_ds.h>
+#include "util/util.h"
+#include "util/bitset.h"
+
+/////////////
+// PRIVATE //
+/////////////
+
+#define COST_UNREACHABLE UINT32_MAX
+static const usize NODE_NONE = (usize)-2;
+
+// Two neighboring walkable tiles in different clusters.
+struct crossing {
+	usize a, b;
+	usize parent;
+};
+
+static u32 tile_cost(struct hexmap *, usize index);
+static int is_same_or_neighbor(struct hexmap *, usize a, usize b);
+static usize cluster_of(struct hexmap_hpa *, usize tile);
+static usize local_index(struct hexmap_hpa *, usize cluster, usize tile);
+static usize local_to_tile(struct hexmap_hpa *, usize cluster, usize local);
+static void cluster_bounds(struct hexmap_hpa *, usize cluster, int *x0, int *y0, int *x1, int *y1);
+static void cluster_search(struct hexmap_hpa *, usize cluster, usize source, int reverse, usize target);
+static usize find_node_slot(struct hexmap_hpa *, usize cluster, usize tile);
+static void add_entrances(struct hexmap_hpa *, usize cluster, usize other);
+static void rebuild_cluster(struct hexmap_hpa *, usize cluster);
+static void mark_tile_dirty(struct hexmap_hpa *, usize tile);
+static void sync_with_map(struct hexmap_hpa *);
+static void rebuild_dirty_clusters(struct hexmap_hpa *);
+static void abstract_relax(struct hexmap_hpa *, usize id, usize tile, u32 cost, usize from, struct hexcoord goal);
+
+////////////
+// PUBLIC //
+////////////
+
+void hexmap_hpa_init(struct hexmap_hpa *hpa, struct hexmap *map, int cluster_size) {
+	assert(hpa != NULL);
+	assert(map != NULL);
+	assert(cluster_size >= 2);
+
+	hpa->map = map;
+	hpa->cluster_size = cluster_size;
+	hpa->clusters_w = (map->w + cluster_size - 1) / cluster_size;
+	hpa->clusters_h = (map->h + cluster_size - 1) / cluster_size;
+	// entrances are unique border tiles
+	hpa->node_stride = 4 * (usize)cluster_size - 4;
+
+	const usize clusters_len = (usize)hpa->clusters_w * hpa->clusters_h;
+	hpa->clusters = calloc(clusters_len, sizeof(*hpa->clusters));
+	for (usize i = 0; i < clusters_len; ++i) {
+		hpa->clusters[i].is_dirty = 1;
+	}
+	hpa->is_entrance = calloc(bitset_words((usize)map->w * map->h), sizeof(*hpa->is_entrance));
+	hpa->movement_cost = malloc((usize)map->w * map->h * sizeof(*hpa->movement_cost));
+	memcpy(hpa->movement_cost, map->movement_cost, (usize)map->w * map->h * sizeof(*hpa->movement_cost));
+	hpa->blocked = malloc(bitset_words((usize)map->w * map->h) * sizeof(*hpa->blocked));
+	memcpy(hpa->blocked, map->blocked, bitset_words((usize)map->w * map->h) * sizeof(*hpa->blocked));
+	hpa->version = map->version;
+
+	hexmap_path_workspace_init(&hpa->local, (usize)cluster_size * cluster_size);
+	// followed by the goal and the neighbors of the start
+	hexmap_path_workspace_init(&hpa->abstract, clusters_len * hpa->node_stride + 1 + HEXMAP_MAX_NEIGHBORS);
+	hpa->start_costs = malloc(hpa->node_stride * sizeof(*hpa->start_costs));
+	hpa->goal_costs = malloc(hpa->node_stride * sizeof(*hpa->goal_costs));
+
+	rebuild_dirty_clusters(hpa);
+}
+
+void hexmap_hpa_destroy(struct hexmap_hpa *hpa) {
+	assert(hpa != NULL);
+	const usize clusters_len = (usize)hpa->clusters_w * hpa->clusters_h;
+	for (usize i = 0; i < clusters_len; ++i) {
+		stbds_arrfree(hpa->clusters[i].nodes);
+		free(hpa->clusters[i].intra);
+	}
+	free(hpa->clusters);
+	free(hpa->is_entrance);
+	free(hpa->movement_cost);
+	free(hpa->blocked);
+	free(hpa->start_costs);
+	free(hpa->goal_costs);
+	hexmap_path_workspace_destroy(&hpa->local);
+	hexmap_path_workspace_destroy(&hpa->abstract);
+}
+
+enum hexmap_path_result hexmap_hpa_find(struct hexmap_hpa *hpa, struct hexcoord start_coord, struct hexcoord goal_coord, struct hexmap_hpa_path *output_path) {
+	assert(hpa != NULL);
+	assert(output_path != NULL);
+	struct hexmap *map = hpa->map;
+
+	output_path->result = HEXMAP_PATH_ERROR;
+	output_path->cost = 0;
+	output_path->waypoints = NULL;
+
+	if (!hexmap_is_valid_coord(map, start_coord) || !hexmap_is_valid_coord(map, goal_coord)) {
+		return output_path->result;
+	}
+
+	rebuild_dirty_clusters(hpa);
+
+	const usize start = hexmap_coord_to_index(map, start_coord);
+	const usize goal = hexmap_coord_to_index(map, goal_coord);
+	if (start == goal) {
+		stbds_arrput(output_path->waypoints, start);
+		output_path->result = HEXMAP_PATH_OK;
+		return output_path->result;
+	}
+	if (bitset_get(map->blocked, goal)) {
+		output_path->result = HEXMAP_PATH_INCOMPLETE_FLOWFIELD;
+		return output_path->result;
+	}
+
+	const usize start_cluster = cluster_of(hpa, start);
+	const usize goal_cluster = cluster_of(hpa, goal);
+	struct hexmap_hpa_cluster *sc = &hpa->clusters[start_cluster];
+	struct hexmap_hpa_cluster *gc = &hpa->clusters[goal_cluster];
+
+	// Connect start and goal to the entrances of their clusters.
+	cluster_search(hpa, start_cluster, start, 0, NODE_NONE);
+	for (usize i = 0; i < (usize)stbds_arrlen(sc->nodes); ++i) {
+		const usize l = local_index(hpa, start_cluster, sc->nodes[i]);
+		hpa->start_costs[i] = (hpa->local.visited[l] == hpa->local.generation) ? hpa->local.cost[l] : COST_UNREACHABLE;
+	}
+	u32 direct_cost = COST_UNREACHABLE;
+	if (start_cluster == goal_cluster) {
+		const usize l = local_index(hpa, goal_cluster, goal);
+		if (hpa->local.visited[l] == hpa->local.generation) {
+			direct_cost = hpa->local.cost[l];
+		}
+	}
+
+	cluster_search(hpa, goal_cluster, goal, 1, NODE_NONE);
+	for (usize i = 0; i < (usize)stbds_arrlen(gc->nodes); ++i) {
+		const usize l = local_index(hpa, goal_cluster, gc->nodes[i]);
+		hpa->goal_costs[i] = (hpa->local.visited[l] == hpa->local.generation) ? hpa->local.cost[l] : COST_UNREACHABLE;
+	}
+
+	// A* over the entrances
+	struct hexmap_path_workspace *ws = &hpa->abstract;
+	const usize goal_id = (usize)hpa->clusters_w * hpa->clusters_h * hpa->node_stride;
+	const usize start_neighbor_id = goal_id + 1;
+	hexmap_path_workspace_begin(ws, start_neighbor_id + HEXMAP_MAX_NEIGHBORS);
+
+	for (usize i = 0; i < (usize)stbds_arrlen(sc->nodes); ++i) {
+		if (hpa->start_costs[i] == COST_UNREACHABLE) continue;
+		abstract_relax(hpa, start_cluster * hpa->node_stride + i, sc->nodes[i], hpa->start_costs[i], NODE_NONE, goal_coord);
+	}
+	if (direct_cost != COST_UNREACHABLE) {
+		abstract_relax(hpa, goal_id, NODE_NONE, direct_cost, NODE_NONE, goal_coord);
+	}
+
+	// The start is often occupied by whoever wants to move, so it is never
+	// an entrance. Step into neighboring clusters directly instead.
+	usize start_neighbors[HEXMAP_MAX_NEIGHBORS];
+	const usize start_neighbors_len = hexmap_neighbors(map, start, start_neighbors);
+	for (usize n = 0; n < start_neighbors_len; ++n) {
+		const usize next = start_neighbors[n];
+		const usize next_cluster = cluster_of(hpa, next);
+		if (next_cluster == start_cluster || bitset_get(map->blocked, next)) continue;
+
+		const struct hexmap_hpa_cluster *c = &hpa->clusters[next_cluster];
+		const u32 step_cost = tile_cost(map, next);
+		cluster_search(hpa, next_cluster, next, 0, NODE_NONE);
+		for (usize i = 0; i < (usize)stbds_arrlen(c->nodes); ++i) {
+			const usize l = local_index(hpa, next_cluster, c->nodes[i]);
+			if (hpa->local.visited[l] != hpa->local.generation) continue;
+			abstract_relax(hpa, next_cluster * hpa->node_stride + i, c->nodes[i], step_cost + hpa->local.cost[l], start_neighbor_id + n, goal_coord);
+		}
+		if (next_cluster == goal_cluster) {
+			const usize l = local_index(hpa, goal_cluster, goal);
+			if (hpa->local.visited[l] == hpa->local.generation) {
+				abstract_relax(hpa, goal_id, NODE_NONE, step_cost + hpa->local.cost[l], start_neighbor_id + n, goal_coord);
+			}
+		}
+	}
+
+	while (ws->open.len > 0) {
+		const usize id = heap_pop(&ws->open, NULL);
+		ws->closed[id] = ws->generation;
+		if (id == goal_id) {
+			break;
+		}
+
+		const usize cluster = id / hpa->node_stride;
+		const usize slot = id % hpa->node_stride;
+		const struct hexmap_hpa_cluster *c = &hpa->clusters[cluster];
+		const usize nodes_len = stbds_arrlen(c->nodes);
+		const usize tile = c->nodes[slot];
+		const u32 cost = ws->cost[id];
+
+		if (cluster == goal_cluster && hpa->goal_costs[slot] != COST_UNREACHABLE) {
+			abstract_relax(hpa, goal_id, NODE_NONE, cost + hpa->goal_costs[slot], id, goal_coord);
+		}
+		for (usize i = 0; i < nodes_len; ++i) {
+			const uint32_t intra = c->intra[slot * nodes_len + i];
+			if (i == slot || intra == COST_UNREACHABLE) continue;
+			abstract_relax(hpa, cluster * hpa->node_stride + i, c->nodes[i], cost + intra, id, goal_coord);
+		}
+
+		usize neighbors[HEXMAP_MAX_NEIGHBORS];
+		const usize neighbors_len = hexmap_neighbors(map, tile, neighbors);
+		for (usize n = 0; n < neighbors_len; ++n) {
+			const usize next = neighbors[n];
+			const usize next_cluster = cluster_of(hpa, next);
+			if (next_cluster == cluster || !bitset_get(hpa->is_entrance, next)) continue;
+
+			const usize next_slot = find_node_slot(hpa, next_cluster, next);
+			abstract_relax(hpa, next_cluster * hpa->node_stride + next_slot, next, cost + tile_cost(map, next), id, goal_coord);
+		}
+	}
+
+	if (ws->closed[goal_id] != ws->generation) {
+		output_path->result = HEXMAP_PATH_INCOMPLETE_FLOWFIELD;
+		return output_path->result;
+	}
+
+	// Walk back, then reverse into start to goal order.
+	stbds_arrput(output_path->waypoints, goal);
+	for (usize id = ws->came_from[goal_id]; id != NODE_NONE; id = ws->came_from[id]) {
+		if (id >= start_neighbor_id) {
+			const usize tile = start_neighbors[id - start_neighbor_id];
+			if (tile != goal) {
+				stbds_arrput(output_path->waypoints, tile);
+			}
+			break;
+		}
+		const usize tile = hpa->clusters[id / hpa->node_stride].nodes[id % hpa->node_stride];
+		if (tile != goal && tile != start) {
+			stbds_arrput(output_path->waypoints, tile);
+		}
+	}
+	stbds_arrput(output_path->waypoints, start);
+
+	const usize waypoints_len = stbds_arrlen(output_path->waypoints);
+	for (usize i = 0; i < waypoints_len / 2; ++i) {
+		const usize tmp = output_path->waypoints[i];
+		output_path->waypoints[i] = output_path->waypoints[waypoints_len - i - 1];
+		output_path->waypoints[waypoints_len - i - 1] = tmp;
+	}
+
+	output_path->cost = ws->cost[goal_id];
+	output_path->result = HEXMAP_PATH_OK;
+	return output_path->result;
+}
+
+usize hexmap_hpa_segments(struct hexmap_hpa_path *path) {
+	assert(path != NULL);
+	const usize waypoints_len = stbds_arrlen(path->waypoints);
+	return (waypoints_len > 1) ? waypoints_len - 1 : 0;
+}
+
+// Turns a single segment of `path` into tiles. Fails if the map changed
+// in a way that cuts the segment since hexmap_hpa_find().
+enum hexmap_path_result hexmap_hpa_refine(struct hexmap_hpa *hpa, struct hexmap_hpa_path *path, usize segment, struct hexmap_path *output_path) {
+	assert(hpa != NULL);
+	assert(path != NULL);
+	assert(path->result == HEXMAP_PATH_OK);
+	assert(segment < hexmap_hpa_segments(path));
+	assert(output_path != NULL);
+	struct hexmap *map = hpa->map;
+
+	const usize from = path->waypoints[segment];
+	const usize to = path->waypoints[segment + 1];
+
+	output_path->start = hexmap_index_to_coord(map, from);
+	output_path->goal = hexmap_index_to_coord(map, to);
+	output_path->distance_in_tiles = 0;
+	output_path->cost = 0;
+	output_path->tiles = NULL;
+	output_path->owns_tiles = 0;
+	output_path->result = HEXMAP_PATH_INCOMPLETE_FLOWFIELD;
+	if (bitset_get(map->blocked, to)) {
+		return output_path->result;
+	}
+
+	const usize cluster = cluster_of(hpa, from);
+	if (cluster != cluster_of(hpa, to)) {
+		// crossing into the next cluster
+		assert(is_same_or_neighbor(map, from, to));
+		output_path->tiles = malloc(2 * sizeof(*output_path->tiles));
+		output_path->tiles[0] = to;
+		output_path->tiles[1] = from;
+		output_path->owns_tiles = 1;
+		output_path->distance_in_tiles = 1;
+		output_path->cost = tile_cost(map, to);
+		output_path->result = HEXMAP_PATH_OK;
+		return output_path->result;
+	}
+
+	cluster_search(hpa, cluster, from, 0, to);
+	struct hexmap_path_workspace *ws = &hpa->local;
+	const usize to_local = local_index(hpa, cluster, to);
+	if (ws->visited[to_local] != ws->generation) {
+		return output_path->result;
+	}
+
+	usize distance = 0;
+	for (usize l = to_local; ws->came_from[l] != NODE_NONE; l = ws->came_from[l]) {
+		++distance;
+	}
+
+	output_path->tiles = malloc((distance + 1) * sizeof(*output_path->tiles));
+	output_path->owns_tiles = 1;
+	usize l = to_local;
+	for (usize i = 0; i <= distance; ++i) {
+		output_path->tiles[i] = local_to_tile(hpa, cluster, l);
+		l = ws->came_from[l];
+	}
+	output_path->distance_in_tiles = distance;
+	output_path->cost = ws->cost[to_local];
+	output_path->result = HEXMAP_PATH_OK;
+	return output_path->result;
+}
+
+void hexmap_hpa_path_destroy(struct hexmap_hpa_path *path) {
+	assert(path != NULL);
+	stbds_arrfree(path->waypoints);
+	path->waypoints = NULL;
+	path->cost = 0;
+	path->result = HEXMAP_PATH_ERROR;
+}
+
+enum hexmap_path_result hexmap_hpa_path_find(struct hexmap_hpa *hpa, struct hexcoord start_coord, struct hexcoord goal_coord, struct hexmap_path *output_path) {
+	assert(hpa != NULL);
+	assert(output_path != NULL);
+
+	output_path->start = start_coord;
+	output_path->goal = goal_coord;
+	output_path->distance_in_tiles = 0;
+	output_path->cost = 0;
+	output_path->tiles = NULL;
+	output_path->owns_tiles = 0;
+
+	struct hexmap_hpa_path abstract;
+	output_path->result = hexmap_hpa_find(hpa, start_coord, goal_coord, &abstract);
+	if (output_path->result != HEXMAP_PATH_OK || hexmap_hpa_segments(&abstract) == 0) {
+		hexmap_hpa_path_destroy(&abstract);
+		return output_path->result;
+	}
+
+	// tiles after the start, in walking order
+	usize *steps = NULL;
+	for (usize s = 0; s < hexmap_hpa_segments(&abstract); ++s) {
+		struct hexmap_path segment;
+		if (hexmap_hpa_refine(hpa, &abstract, s, &segment) != HEXMAP_PATH_OK) {
+			output_path->result = segment.result;
+			break;
+		}
+		for (usize i = 0; i < segment.distance_in_tiles; ++i) {
+			stbds_arrput(steps, hexmap_path_at(&segment, i));
+		}
+		output_path->cost += segment.cost;
+		hexmap_path_destroy(&segment);
+	}
+
+	if (output_path->result == HEXMAP_PATH_OK) {
+		// same layout as hexmap_path_find(), goal first and start last.
+		const usize steps_len = stbds_arrlen(steps);
+		output_path->tiles = malloc((steps_len + 1) * sizeof(*output_path->tiles));
+		output_path->owns_tiles = 1;
+		for (usize i = 0; i < steps_len; ++i) {
+			output_path->tiles[i] = steps[steps_len - i - 1];
+		}
+		output_path->tiles[steps_len] = abstract.waypoints[0];
+		output_path->distance_in_tiles = steps_len;
+	} else {
+		output_path->cost = 0;
+	}
+
+	stbds_arrfree(steps);
+	hexmap_hpa_path_destroy(&abstract);
+	return output_path->result;
+}
+
+////////////
+// STATIC //
+////////////
+
+// Same as in hexmap.c, costs below 1 count as 1.
+static u32 tile_cost(struct hexmap *map, usize index) {
+	const u32 cost = map->movement_cost[index];
+	return (cost > 0) ? cost : 1;
+}
+
+static int is_same_or_neighbor(struct hexmap *map, usize a, usize b) {
+	return a == b || hexcoord_distance(hexmap_index_to_coord(map, a), hexmap_index_to_coord(map, b)) == 1;
+}
+
+static usize cluster_of(struct hexmap_hpa *hpa, usize tile) {
+	const usize x = tile % hpa->map->w;
+	const usize y = tile / hpa->map->w;
+	return x / hpa->cluster_size + (y / hpa->cluster_size) * hpa->clusters_w;
+}
+
+static usize local_index(struct hexmap_hpa *hpa, usize cluster, usize tile) {
+	const usize x = tile % hpa->map->w - (cluster % hpa->clusters_w) * hpa->cluster_size;
+	const usize y = tile / hpa->map->w - (cluster / hpa->clusters_w) * hpa->cluster_size;
+	return x + y * hpa->cluster_size;
+}
+
+static usize local_to_tile(struct hexmap_hpa *hpa, usize cluster, usize local) {
+	const usize x = (cluster % hpa->clusters_w) * hpa->cluster_size + local % hpa->cluster_size;
+	const usize y = (cluster / hpa->clusters_w) * hpa->cluster_size + local / hpa->cluster_size;
+	return x + y * hpa->map->w;
+}
+
+// Inclusive tile coordinates covered by `cluster`, clusters at the
+// right and bottom edge of the map can be smaller.
+static void cluster_bounds(struct hexmap_hpa *hpa, usize cluster, int *x0, int *y0, int *x1, int *y1) {
+	*x0 = (cluster % hpa->clusters_w) * hpa->cluster_size;
+	*y0 = (cluster / hpa->clusters_w) * hpa->cluster_size;
+	*x1 = *x0 + hpa->cluster_size - 1;
+	*y1 = *y0 + hpa->cluster_size - 1;
+	if (*x1 >= hpa->map->w) *x1 = hpa->map->w - 1;
+	if (*y1 >= hpa->map->h) *y1 = hpa->map->h - 1;
+}
+
+// Dijkstra from `source` which never leaves `cluster`, results are left in
+// `hpa->local`. With `reverse` the costs are those of walking to `source`.
+// Stops early once `target` is reached, unless it is NODE_NONE.
+static void cluster_search(struct hexmap_hpa *hpa, usize cluster, usize source, int reverse, usize target) {
+	struct hexmap *map = hpa->map;
+	struct hexmap_path_workspace *ws = &hpa->local;
+	hexmap_path_workspace_begin(ws, (usize)hpa->cluster_size * hpa->cluster_size);
+	const uint32_t generation = ws->generation;
+
+	const usize source_local = local_index(hpa, cluster, source);
+	ws->visited[source_local] = generation;
+	ws->came_from[source_local] = NODE_NONE;
+	ws->cost[source_local] = 0;
+	heap_push(&ws->open, source_local, 0);
+
+	while (ws->open.len > 0) {
+		const usize current_local = heap_pop(&ws->open, NULL);
+		ws->closed[current_local] = generation;
+		const usize current = local_to_tile(hpa, cluster, current_local);
+		if (current == target) {
+			break;
+		}
+
+		usize neighbors[HEXMAP_MAX_NEIGHBORS];
+		const usize neighbors_len = hexmap_neighbors(map, current, neighbors);
+		for (usize n = 0; n < neighbors_len; ++n) {
+			const usize next = neighbors[n];
+			if (cluster_of(hpa, next) != cluster) continue;
+			if (bitset_get(map->blocked, next)) continue;
+			const usize next_local = local_index(hpa, cluster, next);
+			if (ws->closed[next_local] == generation) continue;
+
+			// walking backwards, the cost is paid when entering `current`.
+			const u32 next_cost = ws->cost[current_local] + tile_cost(map, reverse ? current : next);
+			const int is_open = (ws->visited[next_local] == generation);
+			if (is_open && next_cost >= ws->cost[next_local]) continue;
+
+			ws->visited[next_local] = generation;
+			ws->cost[next_local] = next_cost;
+			ws->came_from[next_local] = current_local;
+			if (is_open) {
+				heap_decrease(&ws->open, next_local, next_cost);
+			} else {
+				heap_push(&ws->open, next_local, next_cost);
+			}
+		}
+	}
+}
+
+static usize find_node_slot(struct hexmap_hpa *hpa, usize cluster, usize tile) {
+	const struct hexmap_hpa_cluster *c = &hpa->clusters[cluster];
+	for (usize i = 0; i < (usize)stbds_arrlen(c->nodes); ++i) {
+		if (c->nodes[i] == tile) {
+			return i;
+		}
+	}
+	assert(0 && "entrance bit set, but tile is not a node of its cluster.");
+	return 0;
+}
+
+static usize crossing_find(struct crossing *crossings, usize i) {
+	while (crossings[i].parent != i) {
+		crossings[i].parent = crossings[crossings[i].parent].parent;
+		i = crossings[i].parent;
+	}
+	return i;
+}
+
+// Adds the entrances between `cluster` and `other` to the nodes of
+// `cluster`. Crossings which are next to each other on both sides are
+// grouped, each group gets one entrance in the middle, long groups one
+// at each end instead.
+static void add_entrances(struct hexmap_hpa *hpa, usize cluster, usize other) {
+	struct hexmap *map = hpa->map;
+	struct hexmap_hpa_cluster *c = &hpa->clusters[cluster];
+
+	// Always scan from the same side, so both clusters agree on the entrances.
+	const usize a = (cluster < other) ? cluster : other;
+	const usize b = (cluster < other) ? other : cluster;
+
+	struct crossing *crossings = NULL;
+	int x0, y0, x1, y1;
+	cluster_bounds(hpa, a, &x0, &y0, &x1, &y1);
+	for (int y = y0; y <= y1; ++y) {
+		for (int x = x0; x <= x1; ++x) {
+			if (x != x0 && x != x1 && y != y0 && y != y1) continue;
+			const usize tile = x + y * map->w;
+			if (bitset_get(map->blocked, tile)) continue;
+
+			usize neighbors[HEXMAP_MAX_NEIGHBORS];
+			const usize neighbors_len = hexmap_neighbors(map, tile, neighbors);
+			for (usize n = 0; n < neighbors_len; ++n) {
+				if (cluster_of(hpa, neighbors[n]) != b || bitset_get(map->blocked, neighbors[n])) continue;
+				const usize len = stbds_arrlen(crossings);
+				stbds_arrput(crossings, ((struct crossing){ .a=tile, .b=neighbors[n], .parent=len }));
+			}
+		}
+	}
+
+	const usize crossings_len = stbds_arrlen(crossings);
+	for (usize i = 0; i < crossings_len; ++i) {
+		for (usize j = 0; j < i; ++j) {
+			if (!is_same_or_neighbor(map, crossings[i].a, crossings[j].a)
+			 || !is_same_or_neighbor(map, crossings[i].b, crossings[j].b)) {
+				continue;
+			}
+			// keep the first crossing of a group as its root
+			const usize root_i = crossing_find(crossings, i);
+			const usize root_j = crossing_find(crossings, j);
+			if (root_i < root_j) {
+				crossings[root_j].parent = root_i;
+			} else {
+				crossings[root_i].parent = root_j;
+			}
+		}
+	}
+
+	enum { LONG_GROUP = 6 };
+	for (usize i = 0; i < crossings_len; ++i) {
+		if (crossing_find(crossings, i) != i) continue;
+
+		usize group_len = 0, last = i, middle = i;
+		for (usize j = i; j < crossings_len; ++j) {
+			if (crossing_find(crossings, j) == i) {
+				last = j;
+				++group_len;
+			}
+		}
+		for (usize j = i, k = 0; j < crossings_len; ++j) {
+			if (crossing_find(crossings, j) == i && k++ == group_len / 2) {
+				middle = j;
+				break;
+			}
+		}
+
+		usize picked[2];
+		usize picked_len = 0;
+		if (group_len >= LONG_GROUP) {
+			picked[picked_len++] = i;
+			picked[picked_len++] = last;
+		} else {
+			picked[picked_len++] = middle;
+		}
+		for (usize p = 0; p < picked_len; ++p) {
+			const usize tile = (cluster == a) ? crossings[picked[p]].a : crossings[picked[p]].b;
+			if (!bitset_get(hpa->is_entrance, tile)) {
+				bitset_set(hpa->is_entrance, tile);
+				stbds_arrput(c->nodes, tile);
+			}
+		}
+	}
+
+	stbds_arrfree(crossings);
+}
+
+static void rebuild_cluster(struct hexmap_hpa *hpa, usize cluster) {
+	struct hexmap_hpa_cluster *c = &hpa->clusters[cluster];
+	for (usize i = 0; i < (usize)stbds_arrlen(c->nodes); ++i) {
+		bitset_clear(hpa->is_entrance, c->nodes[i]);
+	}
+	stbds_arrsetlen(c->nodes, 0);
+
+	const int cx = cluster % hpa->clusters_w;
+	const int cy = cluster / hpa->clusters_w;
+	for (int y = cy - 1; y <= cy + 1; ++y) {
+		for (int x = cx - 1; x <= cx + 1; ++x) {
+			if (x < 0 || y < 0 || x >= hpa->clusters_w || y >= hpa->clusters_h) continue;
+			if (x == cx && y == cy) continue;
+			add_entrances(hpa, cluster, x + y * hpa->clusters_w);
+		}
+	}
+
+	const usize nodes_len = stbds_arrlen(c->nodes);
+	assert(nodes_len <= hpa->node_stride);
+	free(c->intra);
+	c->intra = malloc(nodes_len * nodes_len * sizeof(*c->intra));
+	for (usize from = 0; from < nodes_len; ++from) {
+		cluster_search(hpa, cluster, c->nodes[from], 0, NODE_NONE);
+		for (usize to = 0; to < nodes_len; ++to) {
+			const usize l = local_index(hpa, cluster, c->nodes[to]);
+			c->intra[from * nodes_len + to] = (hpa->local.visited[l] == hpa->local.generation)
+				? hpa->local.cost[l]
+				: COST_UNREACHABLE;
+		}
+	}
+	c->is_dirty = 0;
+}
+
+// A changed tile invalidates its cluster, border tiles also change the
+// entrances of the neighboring clusters.
+static void mark_tile_dirty(struct hexmap_hpa *hpa, usize tile) {
+	const struct hexcoord coord = hexmap_index_to_coord(hpa->map, tile);
+	const int cx = coord.x / hpa->cluster_size;
+	const int cy = coord.y / hpa->cluster_size;
+	const usize cluster = cx + cy * hpa->clusters_w;
+	hpa->clusters[cluster].is_dirty = 1;
+
+	int x0, y0, x1, y1;
+	cluster_bounds(hpa, cluster, &x0, &y0, &x1, &y1);
+	if (coord.x != x0 && coord.x != x1 && coord.y != y0 && coord.y != y1) {
+		return;
+	}
+	for (int y = cy - 1; y <= cy + 1; ++y) {
+		for (int x = cx - 1; x <= cx + 1; ++x) {
+			if (x < 0 || y < 0 || x >= hpa->clusters_w || y >= hpa->clusters_h) continue;
+			hpa->clusters[x + y * hpa->clusters_w].is_dirty = 1;
+		}
+	}
+}
+
+// Compares costs and obstacles with those of the last sync, and marks the
+// clusters of every changed tile.
+static void sync_with_map(struct hexmap_hpa *hpa) {
+	struct hexmap *map = hpa->map;
+	if (hpa->version == map->version) {
+		return;
+	}
+
+	const usize map_size = (usize)map->w * map->h;
+	for (usize i = 0; i < map_size; ++i) {
+		if (hpa->movement_cost[i] != map->movement_cost[i] || bitset_get(hpa->blocked, i) != bitset_get(map->blocked, i)) {
+			mark_tile_dirty(hpa, i);
+		}
+	}
+	memcpy(hpa->movement_cost, map->movement_cost, map_size * sizeof(*hpa->movement_cost));
+	memcpy(hpa->blocked, map->blocked, bitset_words(map_size) * sizeof(*hpa->blocked));
+	hpa->version = map->version;
+}
+
+static void rebuild_dirty_clusters(struct hexmap_hpa *hpa) {
+	sync_with_map(hpa);
+
+	const usize clusters_len = (usize)hpa->clusters_w * hpa->clusters_h;
+	for (usize i = 0; i < clusters_len; ++i) {
+		if (hpa->clusters[i].is_dirty) {
+			rebuild_cluster(hpa, i);
+		}
+	}
+}
+
+// Lowers the cost of an abstract node, `tile` is NODE_NONE for the goal.
+static void abstract_relax(struct hexmap_hpa *hpa, usize id, usize tile, u32 cost, usize from, struct hexcoord goal) {
+	struct hexmap_path_workspace *ws = &hpa->abstract;
+	if (ws->closed[id] == ws->generation) return;
+
+	const int is_open = (ws->visited[id] == ws->generation);
+	if (is_open && cost >= ws->cost[id]) return;
+
+	const u32 heuristic = (tile == NODE_NONE) ? 0 : hexcoord_distance(hexmap_index_to_coord(hpa->map, tile), goal);
+	ws->visited[id] = ws->generation;
+	ws->cost[id] = cost;
+	ws->came_from[id] = from;
+	if (is_open) {
+		heap_decrease(&ws->open, id, cost + heuristic);
+	} else {
+		heap_push(&ws->open, id, cost + heuristic);
+	}
+}
+
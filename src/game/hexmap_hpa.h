@@ -0,0 +1,70 @@
+#ifndef HEXMAP_HPA_H
+#define HEXMAP_HPA_H
+
+#include "game/hexmap.h"
+
+// Hierarchical pathfinding (HPA*) on top of a `struct hexmap`.
+//
+// The map is split into square clusters. Walkable tiles on cluster
+// borders which connect to a neighboring cluster become entrances, and
+// the costs between all entrances of a cluster are precomputed. Queries
+// only search this abstract graph, the resulting waypoints are refined
+// into tiles one segment at a time.
+//
+// Paths are not always optimal, since only a few entrances per border
+// are kept. Changes of `movement_cost` or occupancy are picked up through
+// `map->version`, affected clusters are rebuilt before the next query.
+
+struct hexmap_hpa_cluster {
+	// stb_ds array, tile indices of the entrances.
+	usize *nodes;
+	// nodes_len * nodes_len costs, `intra[from * nodes_len + to]`.
+	uint32_t *intra;
+	int is_dirty;
+};
+
+struct hexmap_hpa {
+	struct hexmap *map;
+	int cluster_size;
+	int clusters_w, clusters_h;
+	struct hexmap_hpa_cluster *clusters;
+	// upper bound of entrances per cluster, abstract node ids are
+	// `cluster * node_stride + slot`.
+	usize node_stride;
+	// bitset, tile is an entrance.
+	uint64_t *is_entrance;
+	// `map->movement_cost` and `map->blocked` as of the last sync.
+	u8 *movement_cost;
+	uint64_t *blocked;
+	uint64_t version;
+
+	// scratch memory
+	struct hexmap_path_workspace local;
+	struct hexmap_path_workspace abstract;
+	uint32_t *start_costs;
+	uint32_t *goal_costs;
+};
+
+// Result of hexmap_hpa_find(). Consecutive waypoints are either
+// neighbors or in the same cluster.
+struct hexmap_hpa_path {
+	enum hexmap_path_result result;
+	usize cost;
+	// stb_ds array of tile indices, starts with the start tile.
+	usize *waypoints;
+};
+
+void hexmap_hpa_init(struct hexmap_hpa *, struct hexmap *, int cluster_size);
+void hexmap_hpa_destroy(struct hexmap_hpa *);
+
+enum hexmap_path_result hexmap_hpa_find(struct hexmap_hpa *, struct hexcoord start, struct hexcoord goal, struct hexmap_hpa_path *);
+usize hexmap_hpa_segments(struct hexmap_hpa_path *);
+enum hexmap_path_result hexmap_hpa_refine(struct hexmap_hpa *, struct hexmap_hpa_path *, usize segment, struct hexmap_path *);
+void hexmap_hpa_path_destroy(struct hexmap_hpa_path *);
+
+// Finds and refines the whole path, the result can be used like the
+// one of hexmap_path_find().
+enum hexmap_path_result hexmap_hpa_path_find(struct hexmap_hpa *, struct hexcoord start, struct hexcoord goal, struct hexmap_path *);
+
+#endif
+
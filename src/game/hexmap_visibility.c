@@ -0,0 +1,258 @@
+#include "game/hexmap_visibility.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util/bitset.h"
+
+/////////////
+// PRIVATE //
+/////////////
+
+static struct hexmap_visibility_offset to_axial(struct hexcoord);
+static struct hexcoord from_axial(struct hexmap_visibility_offset);
+static int offset_distance(struct hexmap_visibility_offset);
+static struct hexmap_visibility_offset line_at(struct hexmap_visibility_offset to, int distance, int step);
+static void sync_with_map(struct hexmap_visibility *);
+static void mark_viewers_dirty(struct hexmap_visibility *, usize changed_tile);
+static const uint64_t *visible_from(struct hexmap_visibility *, usize tile);
+
+////////////
+// PUBLIC //
+////////////
+
+void hexmap_visibility_init(struct hexmap_visibility *vis, struct hexmap *map, int radius) {
+	assert(vis != NULL);
+	assert(map != NULL);
+	assert(radius >= 1);
+
+	vis->map = map;
+	vis->radius = radius;
+
+	// All offsets within the radius and the tiles on the line to each of
+	// them. Lines do not depend on where the viewer stands.
+	const int side = 2 * radius + 1;
+	vis->offsets_len = 3 * (usize)radius * (radius + 1) + 1;
+	vis->offsets = malloc(vis->offsets_len * sizeof(*vis->offsets));
+	vis->line_begin = malloc((vis->offsets_len + 1) * sizeof(*vis->line_begin));
+	vis->lines = malloc(vis->offsets_len * radius * sizeof(*vis->lines));
+	vis->offset_index = malloc((usize)side * side * sizeof(*vis->offset_index));
+	for (int i = 0; i < side * side; ++i) {
+		vis->offset_index[i] = -1;
+	}
+
+	usize offset_i = 0, lines_len = 0;
+	for (int dq = -radius; dq <= radius; ++dq) {
+		const int dr_min = (-dq - radius > -radius) ? -dq - radius : -radius;
+		const int dr_max = (-dq + radius < radius) ? -dq + radius : radius;
+		for (int dr = dr_min; dr <= dr_max; ++dr) {
+			const struct hexmap_visibility_offset offset = { .dq = dq, .dr = dr };
+			const int distance = offset_distance(offset);
+			vis->offsets[offset_i] = offset;
+			vis->line_begin[offset_i] = lines_len;
+			vis->offset_index[(dr + radius) * side + (dq + radius)] = offset_i;
+			for (int step = 1; step < distance; ++step) {
+				vis->lines[lines_len++] = line_at(offset, distance, step);
+			}
+			++offset_i;
+		}
+	}
+	assert(offset_i == vis->offsets_len);
+	vis->line_begin[offset_i] = lines_len;
+
+	// Nothing is computed until it is queried.
+	const usize map_size = (usize)map->w * map->h;
+	vis->words_per_tile = bitset_words(vis->offsets_len);
+	vis->visible = malloc(map_size * vis->words_per_tile * sizeof(*vis->visible));
+	vis->is_dirty = malloc(bitset_words(map_size) * sizeof(*vis->is_dirty));
+	memset(vis->is_dirty, 0xFF, bitset_words(map_size) * sizeof(*vis->is_dirty));
+	vis->blocked = malloc(bitset_words(map_size) * sizeof(*vis->blocked));
+	memcpy(vis->blocked, map->blocked, bitset_words(map_size) * sizeof(*vis->blocked));
+	vis->version = map->version;
+}
+
+void hexmap_visibility_destroy(struct hexmap_visibility *vis) {
+	assert(vis != NULL);
+	free(vis->blocked);
+	free(vis->is_dirty);
+	free(vis->visible);
+	free(vis->offset_index);
+	free(vis->lines);
+	free(vis->line_begin);
+	free(vis->offsets);
+	*vis = (struct hexmap_visibility){ 0 };
+}
+
+// Whether `to` can be seen from `from`. Obstacles block the view of what
+// is behind them, but are visible themselves.
+int hexmap_visibility_can_see(struct hexmap_visibility *vis, struct hexcoord from, struct hexcoord to) {
+	assert(vis != NULL);
+	assert(hexmap_is_valid_coord(vis->map, from));
+	assert(hexmap_is_valid_coord(vis->map, to));
+
+	const struct hexmap_visibility_offset a = to_axial(from);
+	const struct hexmap_visibility_offset b = to_axial(to);
+	const struct hexmap_visibility_offset offset = { .dq = b.dq - a.dq, .dr = b.dr - a.dr };
+	if (offset_distance(offset) > vis->radius) {
+		return hexmap_has_line_of_sight(vis->map, from, to);
+	}
+
+	sync_with_map(vis);
+	const uint64_t *visible = visible_from(vis, hexmap_coord_to_index(vis->map, from));
+	const int side = 2 * vis->radius + 1;
+	const isize offset_i = vis->offset_index[(offset.dr + vis->radius) * side + (offset.dq + vis->radius)];
+	assert(offset_i >= 0);
+	return bitset_get(visible, offset_i);
+}
+
+// Writes all tiles within `radius` of any of the `viewers` which at least
+// one of them can see to the `visible` bitset, e.g. for fog of war. It
+// needs `bitset_words(map->w * map->h)` words.
+void hexmap_visibility_field_of_view(struct hexmap_visibility *vis, usize viewers_len, const struct hexcoord viewers[viewers_len], uint64_t *visible) {
+	assert(vis != NULL);
+	assert(viewers_len == 0 || viewers != NULL);
+	assert(visible != NULL);
+	struct hexmap *map = vis->map;
+
+	memset(visible, 0, bitset_words((usize)map->w * map->h) * sizeof(*visible));
+	sync_with_map(vis);
+
+	for (usize v = 0; v < viewers_len; ++v) {
+		assert(hexmap_is_valid_coord(map, viewers[v]));
+		const struct hexmap_visibility_offset viewer = to_axial(viewers[v]);
+		const uint64_t *visible_from_viewer = visible_from(vis, hexmap_coord_to_index(map, viewers[v]));
+
+		for (usize i = 0; i < vis->offsets_len; ++i) {
+			if (!bitset_get(visible_from_viewer, i)) continue;
+			const struct hexmap_visibility_offset target = { .dq = viewer.dq + vis->offsets[i].dq, .dr = viewer.dr + vis->offsets[i].dr };
+			bitset_set(visible, hexmap_coord_to_index(map, from_axial(target)));
+		}
+	}
+}
+
+// Tiles between `from` and `to` are the hexes closest to the straight
+// line connecting their centers. Tiles outside of the map never block.
+int hexmap_has_line_of_sight(struct hexmap *map, struct hexcoord from, struct hexcoord to) {
+	assert(map != NULL);
+	assert(hexmap_is_valid_coord(map, from));
+	assert(hexmap_is_valid_coord(map, to));
+
+	const struct hexmap_visibility_offset a = to_axial(from);
+	const struct hexmap_visibility_offset b = to_axial(to);
+	const struct hexmap_visibility_offset offset = { .dq = b.dq - a.dq, .dr = b.dr - a.dr };
+	const int distance = offset_distance(offset);
+	for (int step = 1; step < distance; ++step) {
+		const struct hexmap_visibility_offset at = line_at(offset, distance, step);
+		const struct hexcoord coord = from_axial((struct hexmap_visibility_offset){ .dq = a.dq + at.dq, .dr = a.dr + at.dr });
+		if (hexmap_is_valid_coord(map, coord) && hexmap_is_tile_obstacle(map, coord)) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+////////////
+// STATIC //
+////////////
+
+// offset (even rows shifted right) to axial coordinates, see hexcoord_distance().
+static struct hexmap_visibility_offset to_axial(struct hexcoord coord) {
+	return (struct hexmap_visibility_offset){ .dq = coord.x - (coord.y + (coord.y & 1)) / 2, .dr = coord.y };
+}
+
+static struct hexcoord from_axial(struct hexmap_visibility_offset axial) {
+	return (struct hexcoord){ .x = axial.dq + (axial.dr + (axial.dr & 1)) / 2, .y = axial.dr };
+}
+
+static int offset_distance(struct hexmap_visibility_offset offset) {
+	return (abs(offset.dq) + abs(offset.dr) + abs(offset.dq + offset.dr)) / 2;
+}
+
+// Hex at `step` of `distance` steps on the line from the origin to `to`.
+// The line is nudged slightly, so it never runs exactly between two hexes.
+static struct hexmap_visibility_offset line_at(struct hexmap_visibility_offset to, int distance, int step) {
+	const float t = (float)step / distance;
+	const float q = to.dq * t + 1e-4f;
+	const float r = to.dr * t + 1e-4f;
+	const float s = -q - r;
+
+	float round_q = roundf(q), round_r = roundf(r);
+	const float round_s = roundf(s);
+	const float diff_q = fabsf(round_q - q), diff_r = fabsf(round_r - r), diff_s = fabsf(round_s - s);
+	if (diff_q > diff_r && diff_q > diff_s) {
+		round_q = -round_r - round_s;
+	} else if (diff_r > diff_s) {
+		round_r = -round_q - round_s;
+	}
+
+	return (struct hexmap_visibility_offset){ .dq = (int)round_q, .dr = (int)round_r };
+}
+
+// Compares the obstacles with those of the last sync, and marks every
+// viewer which could look across a changed tile.
+static void sync_with_map(struct hexmap_visibility *vis) {
+	struct hexmap *map = vis->map;
+	if (vis->version == map->version) {
+		return;
+	}
+
+	const usize words = bitset_words((usize)map->w * map->h);
+	for (usize w = 0; w < words; ++w) {
+		const uint64_t changed = vis->blocked[w] ^ map->blocked[w];
+		if (changed == 0) continue;
+		for (usize bit = 0; bit < 64; ++bit) {
+			if ((changed >> bit) & 1) {
+				mark_viewers_dirty(vis, w * 64 + bit);
+			}
+		}
+		vis->blocked[w] = map->blocked[w];
+	}
+	vis->version = map->version;
+}
+
+// A tile can only be in between viewer and target if it is closer than
+// `radius` to the viewer.
+static void mark_viewers_dirty(struct hexmap_visibility *vis, usize changed_tile) {
+	struct hexmap *map = vis->map;
+	const struct hexmap_visibility_offset changed = to_axial(hexmap_index_to_coord(map, changed_tile));
+	for (usize i = 0; i < vis->offsets_len; ++i) {
+		if (offset_distance(vis->offsets[i]) >= vis->radius) continue;
+
+		const struct hexcoord viewer = from_axial((struct hexmap_visibility_offset){ .dq = changed.dq - vis->offsets[i].dq, .dr = changed.dr - vis->offsets[i].dr });
+		if (hexmap_is_valid_coord(map, viewer)) {
+			bitset_set(vis->is_dirty, hexmap_coord_to_index(map, viewer));
+		}
+	}
+}
+
+// Visible set of `tile`, recomputed first if it is outdated.
+static const uint64_t *visible_from(struct hexmap_visibility *vis, usize tile) {
+	struct hexmap *map = vis->map;
+	uint64_t *visible = &vis->visible[tile * vis->words_per_tile];
+	if (!bitset_get(vis->is_dirty, tile)) {
+		return visible;
+	}
+
+	const struct hexmap_visibility_offset viewer = to_axial(hexmap_index_to_coord(map, tile));
+	memset(visible, 0, vis->words_per_tile * sizeof(*visible));
+	for (usize i = 0; i < vis->offsets_len; ++i) {
+		const struct hexmap_visibility_offset target = { .dq = viewer.dq + vis->offsets[i].dq, .dr = viewer.dr + vis->offsets[i].dr };
+		if (!hexmap_is_valid_coord(map, from_axial(target))) continue;
+
+		int is_visible = 1;
+		for (usize l = vis->line_begin[i]; l < vis->line_begin[i + 1]; ++l) {
+			const struct hexcoord between = from_axial((struct hexmap_visibility_offset){ .dq = viewer.dq + vis->lines[l].dq, .dr = viewer.dr + vis->lines[l].dr });
+			if (hexmap_is_valid_coord(map, between) && bitset_get(map->blocked, hexmap_coord_to_index(map, between))) {
+				is_visible = 0;
+				break;
+			}
+		}
+		bitset_assign(visible, i, is_visible);
+	}
+	bitset_clear(vis->is_dirty, tile);
+
+	return visible;
+}
+
@@ -0,0 +1,51 @@
+#ifndef HEXMAP_VISIBILITY_H
+#define HEXMAP_VISIBILITY_H
+
+#include "game/hexmap.h"
+
+// Line of sight on a `struct hexmap`, tiles for which
+// hexmap_is_tile_obstacle() is true block the view.
+//
+// For every tile, the set of visible tiles within `radius` is cached as
+// a bitset, so most queries are a single bit lookup. Changes to the map
+// are picked up through its `version`, only tiles whose view could have
+// changed are recomputed, and only once they are queried again.
+
+// axial coordinates, relative to the viewer.
+struct hexmap_visibility_offset {
+	int dq, dr;
+};
+
+struct hexmap_visibility {
+	struct hexmap *map;
+	int radius;
+
+	// tiles within `radius`, the tiles in between the viewer and
+	// `offsets[i]` are `lines[line_begin[i] .. line_begin[i + 1])`.
+	usize offsets_len;
+	struct hexmap_visibility_offset *offsets;
+	usize *line_begin;
+	struct hexmap_visibility_offset *lines;
+	// (2 * radius + 1)^2 table from axial offset to index into `offsets`.
+	isize *offset_index;
+
+	// `words_per_tile` bitset words per tile, bit `i` is `offsets[i]`.
+	usize words_per_tile;
+	uint64_t *visible;
+	// bitsets, one bit per tile.
+	uint64_t *is_dirty;
+	uint64_t *blocked;
+	uint64_t version;
+};
+
+void hexmap_visibility_init(struct hexmap_visibility *, struct hexmap *, int radius);
+void hexmap_visibility_destroy(struct hexmap_visibility *);
+
+int hexmap_visibility_can_see(struct hexmap_visibility *, struct hexcoord from, struct hexcoord to);
+void hexmap_visibility_field_of_view(struct hexmap_visibility *, usize viewers_len, const struct hexcoord viewers[viewers_len], uint64_t *visible);
+
+// Traces the line without any caching, works for any distance.
+int hexmap_has_line_of_sight(struct hexmap *, struct hexcoord from, struct hexcoord to);
+
+#endif
+
@@ -1,6 +1,9 @@
 #include "isoterrain.h"
 
 #include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <assert.h>
 #include <SDL_opengles2.h>
 #include <cJSON.h>
 #include "util/fs.h"
@@ -16,6 +19,11 @@
 static const int texture_tile_width  = 16;
 static const int texture_tile_height = 17;
 
+// every block is baked into two triangles of (x, y, u, v) vertices.
+#define BAKED_COMPONENTS_PER_VERTEX 4
+#define BAKED_VERTICES_PER_BLOCK 6
+#define BAKED_FLOATS_PER_BLOCK (BAKED_COMPONENTS_PER_VERTEX * BAKED_VERTICES_PER_BLOCK)
+
 //
 // private functions
 //
@@ -34,6 +42,119 @@ static void pos_to_index(struct isoterrain_s *terrain, int x, int y, int z, int
 	*index = x + (y * terrain->width) + (z * terrain->width * terrain->height);
 }
 
+// blocks are baked in painters order: layer by layer, and within a layer
+// row by row along the screen diagonal `d = y - x`, far rows first. all blocks
+// of a row share the same screen height, which makes rows cheap to cull.
+static int row_first_x(struct isoterrain_s *terrain, int row) {
+	const int x = row - (terrain->height - 1);
+	return (x > 0) ? x : 0;
+}
+
+static int row_last_x(struct isoterrain_s *terrain, int row) {
+	return (row < terrain->width - 1) ? row : terrain->width - 1;
+}
+
+static usize block_to_slot(struct isoterrain_s *terrain, int x, int y, int z) {
+	const int row = (terrain->height - 1) - (y - x);
+	return terrain->baked.row_offsets[z * terrain->baked.rows_per_layer + row] + (x - row_first_x(terrain, row));
+}
+
+static void bake_block(struct isoterrain_s *terrain, int x, int y, int z) {
+	float *vertices = &terrain->baked.vertices[block_to_slot(terrain, x, y, z) * BAKED_FLOATS_PER_BLOCK];
+
+	const iso_block block = *isoterrain_get_block(terrain, x, y, z);
+	if (block == -1) {
+		// degenerate triangles
+		memset(vertices, 0, BAKED_FLOATS_PER_BLOCK * sizeof(float));
+		return;
+	}
+
+	// blockid to texcoord
+	ivec2s tile_uv = { .x = block % 16, .y = floor(block / 15.0f) };
+	vec2 block_pos;
+	isoterrain_pos_block_to_screen(terrain, x, y, z, block_pos);
+
+	const float px = block_pos[0];
+	const float py = terrain->projected_height - block_pos[1];
+	const float w = texture_tile_width;
+	const float h = texture_tile_height;
+
+	const float srw = (float)texture_tile_width / terrain->tileset_texture.width;
+	const float srh = (float)texture_tile_height / terrain->tileset_texture.height;
+	const float srx = srw * tile_uv.x;
+	const float sry = srh * tile_uv.y;
+
+	// same winding as the 2d pipeline
+	const float block_vertices[BAKED_FLOATS_PER_BLOCK] = {
+		/*2*/ px + 0.0f, py + h,     srx + 0.0f, sry + srh,
+		/*1*/ px + w,    py + 0.0f,  srx + srw,  sry + 0.0f,
+		/*0*/ px + 0.0f, py + 0.0f,  srx + 0.0f, sry + 0.0f,
+		/*2*/ px + 0.0f, py + h,     srx + 0.0f, sry + srh,
+		/*3*/ px + w,    py + h,     srx + srw,  sry + srh,
+		/*1*/ px + w,    py + 0.0f,  srx + srw,  sry + 0.0f,
+	};
+	memcpy(vertices, block_vertices, sizeof(block_vertices));
+}
+
+static void bake_all_blocks(struct isoterrain_s *terrain) {
+	for (int iz = 0; iz < terrain->layers; ++iz) {
+		for (int iy = 0; iy < terrain->height; ++iy) {
+			for (int ix = 0; ix < terrain->width; ++ix) {
+				bake_block(terrain, ix, iy, iz);
+			}
+		}
+	}
+}
+
+static usize baked_block_count(struct isoterrain_s *terrain) {
+	return terrain->baked.row_offsets[terrain->layers * terrain->baked.rows_per_layer];
+}
+
+static void upload_dirty_blocks(struct isoterrain_s *terrain) {
+	const usize sizeof_block = BAKED_FLOATS_PER_BLOCK * sizeof(float);
+
+	glBindBuffer(GL_ARRAY_BUFFER, terrain->baked.vertex_buffer);
+	if (terrain->baked.needs_rebuild) {
+		bake_all_blocks(terrain);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, baked_block_count(terrain) * sizeof_block, terrain->baked.vertices);
+		terrain->baked.needs_rebuild = 0;
+	} else if (terrain->baked.dirty_first < terrain->baked.dirty_last) {
+		const usize first = terrain->baked.dirty_first;
+		const usize count = terrain->baked.dirty_last - first;
+		glBufferSubData(GL_ARRAY_BUFFER, first * sizeof_block, count * sizeof_block, &terrain->baked.vertices[first * BAKED_FLOATS_PER_BLOCK]);
+	}
+
+	terrain->baked.dirty_first = SIZE_MAX;
+	terrain->baked.dirty_last = 0;
+}
+
+// calculates the terrain-space rectangle covered by the viewport.
+static void get_view_rect(struct engine *engine, vec2 OUT_min, vec2 OUT_max) {
+	mat4 view_projection, inverse;
+	glm_mat4_mul(engine->u_projection, engine->u_view, view_projection);
+	glm_mat4_inv(view_projection, inverse);
+
+	OUT_min[0] = OUT_min[1] = FLT_MAX;
+	OUT_max[0] = OUT_max[1] = -FLT_MAX;
+	const float corners[4][2] = { {-1.0f, -1.0f}, {1.0f, -1.0f}, {-1.0f, 1.0f}, {1.0f, 1.0f} };
+	for (usize i = 0; i < count_of(corners); ++i) {
+		vec4 corner = { corners[i][0], corners[i][1], 0.0f, 1.0f };
+		vec4 world;
+		glm_mat4_mulv(inverse, corner, world);
+		glm_vec4_scale(world, 1.0f / world[3], world);
+
+		OUT_min[0] = glm_min(OUT_min[0], world[0]);
+		OUT_min[1] = glm_min(OUT_min[1], world[1]);
+		OUT_max[0] = glm_max(OUT_max[0], world[0]);
+		OUT_max[1] = glm_max(OUT_max[1], world[1]);
+	}
+}
+
+static void draw_block_range(usize first, usize count) {
+	if (count == 0) return;
+	glDrawArrays(GL_TRIANGLES, first * BAKED_VERTICES_PER_BLOCK, count * BAKED_VERTICES_PER_BLOCK);
+}
+
 iso_block *isoterrain_get_block(struct isoterrain_s *terrain, int x, int y, int z) {
 	if (x < 0 || y < 0 || z < 0 || x >= terrain->width || y >= terrain->height || z >= terrain->layers) {
 		return NULL;
@@ -53,6 +174,9 @@ void isoterrain_init(struct isoterrain_s *terrain, int w, int h, int layers) {
 	terrain->height = h;
 	terrain->layers = layers;
 	terrain->blocks = malloc(w * h * layers * sizeof(iso_block));
+	for (int i = 0; i < w * h * layers; ++i) {
+		terrain->blocks[i] = -1;
+	}
 
 	isoterrain_get_projected_size(terrain, &terrain->projected_width, &terrain->projected_height);
 
@@ -62,8 +186,30 @@ void isoterrain_init(struct isoterrain_s *terrain, int w, int h, int layers) {
 	settings.filter_mag = GL_NEAREST;
 	texture_init_from_image(&terrain->tileset_texture, "res/environment/tiles.png", &settings);
 
-	pipeline_init(&terrain->pipeline, &terrain->shader, 1024);
-	terrain->pipeline.texture = &terrain->tileset_texture;
+	// baked vertex data
+	terrain->baked.rows_per_layer = w + h - 1;
+	terrain->baked.row_offsets = malloc((layers * terrain->baked.rows_per_layer + 1) * sizeof(*terrain->baked.row_offsets));
+	usize offset = 0;
+	for (int iz = 0; iz < layers; ++iz) {
+		for (int row = 0; row < terrain->baked.rows_per_layer; ++row) {
+			terrain->baked.row_offsets[iz * terrain->baked.rows_per_layer + row] = offset;
+			offset += row_last_x(terrain, row) - row_first_x(terrain, row) + 1;
+		}
+	}
+	terrain->baked.row_offsets[layers * terrain->baked.rows_per_layer] = offset;
+	assert(offset == (usize)(w * h * layers));
+
+	terrain->baked.vertices = malloc(offset * BAKED_FLOATS_PER_BLOCK * sizeof(float));
+	terrain->baked.needs_rebuild = 1;
+	terrain->baked.dirty_first = SIZE_MAX;
+	terrain->baked.dirty_last = 0;
+
+	glGenBuffers(1, &terrain->baked.vertex_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, terrain->baked.vertex_buffer);
+	glBufferData(GL_ARRAY_BUFFER, offset * BAKED_FLOATS_PER_BLOCK * sizeof(float), NULL, GL_DYNAMIC_DRAW);
+
+	terrain->baked.a_pos = glGetAttribLocation(terrain->shader.program, "a_pos");
+	terrain->baked.a_texcoord = glGetAttribLocation(terrain->shader.program, "a_texcoord");
 }
 
 void isoterrain_init_from_file(struct isoterrain_s *terrain, const char *path_to_script) {
@@ -107,7 +253,9 @@ void isoterrain_init_from_file(struct isoterrain_s *terrain, const char *path_to
 
 void isoterrain_destroy(struct isoterrain_s *terrain) {
 	free(terrain->blocks);
-	pipeline_destroy(&terrain->pipeline);
+	free(terrain->baked.vertices);
+	free(terrain->baked.row_offsets);
+	glDeleteBuffers(1, &terrain->baked.vertex_buffer);
 }
 
 //
@@ -139,36 +287,52 @@ cJSON *isoterrain_to_json(struct isoterrain_s *terrain) {
 //
 
 void isoterrain_draw(struct isoterrain_s *terrain, struct engine *engine) {
-	pipeline_reset(&terrain->pipeline);
+	upload_dirty_blocks(terrain);
 
-	// draw left to right, top to bottom
-	for (int iz = 0; iz < terrain->layers; ++iz) {
-		for (int ix = 0; ix < terrain->width; ++ix) {
-			for (int iy = terrain->height - 1; iy >= 0; --iy) {
-				iso_block *block = isoterrain_get_block(terrain, ix, iy, iz);
-				if (*block == -1) continue;
-
-				// blockid to texcoord
-				ivec2s tile_uv = { .x = *block % 16, .y = floor(*block / 15.0f) };
-				vec3 block_pos = GLM_VEC3_ZERO_INIT;
-				isoterrain_pos_block_to_screen(terrain, ix, iy, iz, block_pos);
-
-				drawcmd_t cmd = DRAWCMD_INIT;
-				cmd.size.x = texture_tile_width;
-				cmd.size.y = texture_tile_height;
-				cmd.position.x = block_pos[0];
-				cmd.position.y = (terrain->projected_height - block_pos[1]);
-				cmd.position.z = 0.0f;
-				drawcmd_set_texture_subrect_tile(&cmd, &terrain->tileset_texture, 16, 17, tile_uv.x, tile_uv.y); // tile_uv
-				pipeline_emit(&terrain->pipeline, &cmd);
-			}
-		}
-	}
+	vec2 view_min, view_max;
+	get_view_rect(engine, view_min, view_max);
 
 	glDisable(GL_DEPTH_TEST);
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	pipeline_draw(&terrain->pipeline, engine);
+
+	shader_use(&terrain->shader);
+	shader_set_uniform_mat4(&terrain->shader, "u_projection", (float *)engine->u_projection);
+	shader_set_uniform_mat4(&terrain->shader, "u_view", (float *)engine->u_view);
+	shader_set_uniform_texture(&terrain->shader, "u_texture", GL_TEXTURE0, &terrain->tileset_texture);
+
+	const GLsizei stride = BAKED_COMPONENTS_PER_VERTEX * sizeof(GLfloat);
+	glBindBuffer(GL_ARRAY_BUFFER, terrain->baked.vertex_buffer);
+	glEnableVertexAttribArray(terrain->baked.a_pos);
+	glVertexAttribPointer(terrain->baked.a_pos, 2, GL_FLOAT, GL_FALSE, stride, (void*)0);
+	glEnableVertexAttribArray(terrain->baked.a_texcoord);
+	glVertexAttribPointer(terrain->baked.a_texcoord, 2, GL_FLOAT, GL_FALSE, stride, (void*)(2 * sizeof(GLfloat)));
+
+	// draw the visible part of each row, merging adjacent ranges
+	usize range_first = 0, range_count = 0;
+	for (int iz = 0; iz < terrain->layers; ++iz) {
+		for (int row = 0; row < terrain->baked.rows_per_layer; ++row) {
+			const int d = (terrain->height - 1) - row;
+			const float py = terrain->projected_height - (d + 2.0f * iz) * 4.0f;
+			if (py + texture_tile_height < view_min[1] || py > view_max[1]) continue;
+
+			// screen x of a block in this row is (2x + d) * 8
+			const int x_first = row_first_x(terrain, row);
+			const int x_min = glm_max(x_first, ceilf(((view_min[0] - texture_tile_width) / 8.0f - d) * 0.5f));
+			const int x_max = glm_min(row_last_x(terrain, row), floorf((view_max[0] / 8.0f - d) * 0.5f));
+			if (x_min > x_max) continue;
+
+			const usize first = terrain->baked.row_offsets[iz * terrain->baked.rows_per_layer + row] + (x_min - x_first);
+			const usize count = x_max - x_min + 1;
+			if (first != range_first + range_count) {
+				draw_block_range(range_first, range_count);
+				range_first = first;
+				range_count = 0;
+			}
+			range_count += count;
+		}
+	}
+	draw_block_range(range_first, range_count);
 }
 
 //
@@ -190,7 +354,16 @@ void isoterrain_set_block(struct isoterrain_s *terrain, int x, int y, int z, iso
 
 	int index;
 	pos_to_index(terrain, x, y, z, &index);
+	if (terrain->blocks[index] == block) return;
 	terrain->blocks[index] = block;
+
+	// the whole buffer is baked on the next draw anyway
+	if (terrain->baked.needs_rebuild) return;
+
+	bake_block(terrain, x, y, z);
+	const usize slot = block_to_slot(terrain, x, y, z);
+	if (slot < terrain->baked.dirty_first) terrain->baked.dirty_first = slot;
+	if (slot + 1 > terrain->baked.dirty_last) terrain->baked.dirty_last = slot + 1;
 }
 
 void isoterrain_pos_block_to_screen(struct isoterrain_s *terrain, int x, int y, int z, vec2 OUT_pos) {
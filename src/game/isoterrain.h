@@ -7,6 +7,7 @@
 #include "gl/vbuffer.h"
 #include "gl/shader.h"
 #include "gl/graphics2d.h"
+#include "util/util.h"
 
 typedef int iso_block;
 typedef struct cJSON cJSON;
@@ -23,7 +24,21 @@ struct isoterrain_s {
 	shader_t shader;
 	texture_t tileset_texture;
 
-	pipeline_t pipeline;
+	// baked vertex data. blocks are stored in draw order, one slot per
+	// block, grouped in rows of equal screen height (see isoterrain.c).
+	// only slots touched by isoterrain_set_block() are re-uploaded.
+	struct {
+		unsigned int vertex_buffer;
+		float *vertices;
+		usize *row_offsets;
+		int rows_per_layer;
+
+		int needs_rebuild;
+		usize dirty_first, dirty_last;
+
+		int a_pos;
+		int a_texcoord;
+	} baked;
 };
 
 // create & destroy
@@ -39,6 +54,8 @@ void isoterrain_draw(struct isoterrain_s *, struct engine *engine);
 
 // api
 void isoterrain_get_projected_size(struct isoterrain_s *, int *width, int *height);
+// writing through the returned pointer bypasses the baked vertex cache,
+// use isoterrain_set_block() to modify blocks.
 iso_block *isoterrain_get_block(struct isoterrain_s *, int x, int y, int z);
 void isoterrain_set_block(struct isoterrain_s *, int x, int y, int z, iso_block block);
 void isoterrain_pos_block_to_screen(struct isoterrain_s *, int x, int y, int z, vec2 OUT_pos);
@@ -1,16 +1,112 @@
 #include "terrain.h"
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include <nanovg.h>
 #include <stb_ds.h>
 #include <stb_perlin.h>
 #include <time.h>
 #include "engine.h"
+#include "gl/opengles3.h"
 
 static inline int get_cell_state(unsigned char value, unsigned char isovalue) {
 	return value >= isovalue ? 1 : 0;
 }
 
+#define TERRAIN_VERTEX_COMPONENTS 6
+
+static void push_vertex(float **vertices, float x, float y, const float color[4]) {
+	float *v = stbds_arraddnptr(*vertices, TERRAIN_VERTEX_COMPONENTS);
+	v[0] = x;
+	v[1] = y;
+	v[2] = color[0];
+	v[3] = color[1];
+	v[4] = color[2];
+	v[5] = color[3];
+}
+
+static void density_color(unsigned char density, float color[4]) {
+	const float shade = 50.0f * (1.0f - density / 255.0f);
+	color[0] = (180.0f - shade) / 255.0f;
+	color[1] = (120.0f - shade) / 255.0f;
+	color[2] = (100.0f - shade) / 255.0f;
+	color[3] = 1.0f;
+}
+
+// triangulates the solid part of a cell. walking around the cell and
+// keeping solid corners and edges with a sign change always gives a convex
+// polygon (saddles are resolved as connected, like the edges), so a fan works.
+static void polygonize_cell_fill(struct terrain_s *terrain, int x, int y, const int cell[4]) {
+	static const float corners[4][2] = { {0.0f, 0.0f}, {1.0f, 0.0f}, {1.0f, 1.0f}, {0.0f, 1.0f} };
+
+	float polygon[8][2];
+	float colors[8][4];
+	int polygon_len = 0;
+
+	float iso_color[4];
+	density_color(terrain->isovalue, iso_color);
+
+	for (int i = 0; i < 4; ++i) {
+		const int next = (i + 1) % 4;
+		if (cell[i]) {
+			polygon[polygon_len][0] = x + corners[i][0];
+			polygon[polygon_len][1] = y + corners[i][1];
+			density_color(*terrain_density_at(terrain, x + corners[i][0], y + corners[i][1]), colors[polygon_len]);
+			++polygon_len;
+		}
+		if (cell[i] != cell[next]) {
+			polygon[polygon_len][0] = x + (corners[i][0] + corners[next][0]) * 0.5f;
+			polygon[polygon_len][1] = y + (corners[i][1] + corners[next][1]) * 0.5f;
+			memcpy(colors[polygon_len], iso_color, sizeof(iso_color));
+			++polygon_len;
+		}
+	}
+
+	for (int i = 1; i + 1 < polygon_len; ++i) {
+		push_vertex(&terrain->fill_vertices, polygon[0][0],     polygon[0][1],     colors[0]);
+		push_vertex(&terrain->fill_vertices, polygon[i][0],     polygon[i][1],     colors[i]);
+		push_vertex(&terrain->fill_vertices, polygon[i + 1][0], polygon[i + 1][1], colors[i + 1]);
+	}
+}
+
+static void upload_meshes(struct terrain_s *terrain) {
+	static const float outline_color[4] = { 0.3f, 0.12f, 0.09f, 1.0f };
+
+	const int edges_len = stbds_arrlen(terrain->polygon_edges);
+	stbds_arrsetlen(terrain->outline_vertices, 0);
+	for (int i = 0; i < edges_len; i += 2) {
+		push_vertex(&terrain->outline_vertices, terrain->polygon_edges[i], terrain->polygon_edges[i + 1], outline_color);
+	}
+
+	vbuffer_set_data(&terrain->fill_vbuffer, stbds_arrlen(terrain->fill_vertices) * sizeof(float), terrain->fill_vertices);
+	vbuffer_set_data(&terrain->outline_vbuffer, stbds_arrlen(terrain->outline_vertices) * sizeof(float), terrain->outline_vertices);
+}
+
+static void init_vbuffer(vbuffer_t *vbuf, shader_t *shader) {
+	const GLint stride = TERRAIN_VERTEX_COMPONENTS * sizeof(float);
+	vbuffer_init(vbuf);
+	vbuffer_set_attrib(vbuf, shader, "a_pos",   2, GL_FLOAT, stride, (void*)0);
+	vbuffer_set_attrib(vbuf, shader, "a_color", 4, GL_FLOAT, stride, (void*)(2 * sizeof(float)));
+}
+
+static void draw_density_points(struct terrain_s *terrain, struct engine *engine) {
+	for (int y = 0; y < terrain->height; ++y) {
+		for (int x = 0; x < terrain->width; ++x) {
+			const unsigned char density = *terrain_density_at(terrain, x, y);
+			float radius = ((float)density / 255.0f);
+			nvgBeginPath(engine->vg);
+			if (get_cell_state(*terrain_density_at(terrain, x, y), terrain->isovalue) == 0) {
+				radius = 0.1f;
+				nvgFillColor(engine->vg, nvgRGB(200, 200, 200));
+			} else {
+				nvgFillColor(engine->vg, nvgRGB(180 - 50.0f * (1.0f - radius), 120 - 50.0f * (1.0f - radius), 100 - 50.0f * (1.0f - radius)));
+			}
+			nvgCircle(engine->vg, terrain->x_offset + x * terrain->x_scale, terrain->y_offset + y * terrain->y_scale, 8.0f * radius);
+			nvgFill(engine->vg);
+		}
+	}
+}
+
 static inline void get_cell_endpoint(int x0, int y0, int x1, int y1, int *ox, int *oy) {
 	*ox = x0 + (x1 - x0) * 0.5f;
 	*oy = y0 + (y1 - y0) * 0.5f;
@@ -27,6 +123,13 @@ void terrain_init(struct terrain_s *terrain, int w, int h) {
 	terrain->y_offset = 10.0f;
 	terrain->x_scale = 16.0f;
 	terrain->y_scale = 16.0f;
+	terrain->fill_vertices = NULL;
+	terrain->outline_vertices = NULL;
+	terrain->debug_draw_density = 0;
+
+	shader_init_from_dir(&terrain->shader, "res/shader/terrain/");
+	init_vbuffer(&terrain->fill_vbuffer, &terrain->shader);
+	init_vbuffer(&terrain->outline_vbuffer, &terrain->shader);
 
 	const int seed = time(NULL);
 	for (int y = 0; y < terrain->height; ++y) {
@@ -50,41 +153,39 @@ void terrain_init(struct terrain_s *terrain, int w, int h) {
 void terrain_destroy(struct terrain_s *terrain) {
 	free(terrain->density);
 	stbds_arrfree(terrain->polygon_edges);
+	stbds_arrfree(terrain->fill_vertices);
+	stbds_arrfree(terrain->outline_vertices);
+
+	vbuffer_destroy(&terrain->fill_vbuffer);
+	vbuffer_destroy(&terrain->outline_vbuffer);
+	shader_destroy(&terrain->shader);
 }
 
 void terrain_draw(struct terrain_s *terrain, struct engine *engine) {
-	for (int y = 0; y < terrain->height; ++y) {
-		for (int x = 0; x < terrain->width; ++x) {
-			const unsigned char density = *terrain_density_at(terrain, x, y);
-			float radius = ((float)density / 255.0f);
-			nvgBeginPath(engine->vg);
-			if (get_cell_state(*terrain_density_at(terrain, x, y), terrain->isovalue) == 0) {
-				radius = 0.1f;
-				nvgFillColor(engine->vg, nvgRGB(200, 200, 200));
-			} else {
-				nvgFillColor(engine->vg, nvgRGB(180 - 50.0f * (1.0f - radius), 120 - 50.0f * (1.0f - radius), 100 - 50.0f * (1.0f - radius)));
-			}
-			nvgCircle(engine->vg, terrain->x_offset + x * terrain->x_scale, terrain->y_offset + y * terrain->y_scale, 8.0f * radius);
-			nvgFill(engine->vg);
-		}
-	}
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-	if (terrain->polygon_edges != NULL) {
-		const int len = stbds_arrlen(terrain->polygon_edges);
-		for (int i = 0; i < len; i += 4) {
-			const float *edges = &(terrain->polygon_edges[i]);
-			nvgBeginPath(engine->vg);
-			nvgMoveTo(engine->vg, terrain->x_offset + edges[0] * terrain->x_scale, terrain->y_offset + edges[1] * terrain->y_scale);
-			nvgLineTo(engine->vg, terrain->x_offset + edges[2] * terrain->x_scale, terrain->y_offset + edges[3] * terrain->y_scale);
-			nvgStrokeColor(engine->vg, nvgRGBAf(0.3f, 0.12f, 0.09f, 1.0f));
-			nvgStrokeWidth(engine->vg, 2.0f);
-			nvgStroke(engine->vg);
-		}
-	}
+	shader_use(&terrain->shader);
+	shader_set_uniform_mat4(&terrain->shader, "u_projection", (float *)engine->u_projection);
+	shader_set_uniform_mat4(&terrain->shader, "u_view", (float *)engine->u_view);
+	shader_set_uniform_vec2(&terrain->shader, "u_offset", (vec2){ terrain->x_offset, terrain->y_offset });
+	shader_set_uniform_vec2(&terrain->shader, "u_scale", (vec2){ terrain->x_scale, terrain->y_scale });
+
+	vbuffer_draw_ex(&terrain->fill_vbuffer, GL_TRIANGLES, stbds_arrlen(terrain->fill_vertices) / TERRAIN_VERTEX_COMPONENTS);
+	// GLES only guarantees a line width of 1.0
+	vbuffer_draw_ex(&terrain->outline_vbuffer, GL_LINES, stbds_arrlen(terrain->outline_vertices) / TERRAIN_VERTEX_COMPONENTS);
+
+	shader_use(NULL);
 
+	if (terrain->debug_draw_density) {
+		draw_density_points(terrain, engine);
+	}
 }
 
 void terrain_polygonize(struct terrain_s *terrain) {
+	stbds_arrsetlen(terrain->polygon_edges, 0);
+	stbds_arrsetlen(terrain->fill_vertices, 0);
+
 	for (int y = 0; y < terrain->height - 1; ++y) {
 		for (int x = 0; x < terrain->width - 1; ++x) {
 			const int cell[4] = {
@@ -96,6 +197,8 @@ void terrain_polygonize(struct terrain_s *terrain) {
 	
 			float x0, y0, x1, y1;
 			float x2, y2, x3, y3;
+			polygonize_cell_fill(terrain, x, y, cell);
+
 			const int cell_type = (cell[0] << 3) | (cell[1] << 2) | (cell[2] << 1) | (cell[3] << 0);
 			switch (cell_type) {
 			case 0:
@@ -184,6 +287,8 @@ void terrain_polygonize(struct terrain_s *terrain) {
 			}
 		}
 	}
+
+	upload_meshes(terrain);
 }
 
 unsigned char *terrain_density_at(struct terrain_s *terrain, int x, int y) {
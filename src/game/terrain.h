@@ -1,6 +1,9 @@
 #ifndef TERRAIN_H
 #define TERRAIN_H
 
+#include "gl/shader.h"
+#include "gl/vbuffer.h"
+
 struct engine;
 
 struct terrain_s {
@@ -13,6 +16,16 @@ struct terrain_s {
 	// rendering
 	float x_offset, y_offset;
 	float x_scale, y_scale;
+
+	// meshes built by terrain_polygonize(), vertices are x, y, r, g, b, a
+	shader_t shader;
+	float *fill_vertices;
+	float *outline_vertices;
+	vbuffer_t fill_vbuffer;
+	vbuffer_t outline_vbuffer;
+
+	// debug: draw every density sample with nanovg
+	int debug_draw_density;
 };
 
 void terrain_init(struct terrain_s *terrain, int w, int h);
@@ -20,6 +33,7 @@ void terrain_destroy(struct terrain_s *terrain);
 
 void terrain_draw(struct terrain_s *terrain, struct engine *engine);
 
+// rebuilds polygon_edges and the meshes, call after changing the density.
 void terrain_polygonize(struct terrain_s *terrain);
 unsigned char *terrain_density_at(struct terrain_s *terrain, int x, int y);
 
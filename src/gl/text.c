@@ -2,7 +2,10 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
 #include <assert.h>
+#include <limits.h>
+#include <stb_ds.h>
 #include <SDL2/SDL.h>
 #include <SDL_opengles2.h>
 #include <cglm/types.h>
@@ -10,31 +13,431 @@
 #include <hb-ft.h>
 #include "engine.h"
 #include "gl/texture.h"
+#include "gl/shader.h"
 
 static long DEFAULT_DPI = 96;
 
+#if FREETYPE_MAJOR > 2 || (FREETYPE_MAJOR == 2 && FREETYPE_MINOR >= 11)
+#define FONTATLAS_HAS_SDF 1
+#else
+#define FONTATLAS_HAS_SDF 0
+#endif
+
 // font atlas
 
-static void fa_append_glyph_memory(fontatlas_t *fa) {
-	++fa->num_glyphs;
-	fa->glyphs = realloc(fa->glyphs, sizeof(fontatlas_glyph_t) * fa->num_glyphs);
+//
+// glyph table
+//
+
+static usize fa_glyph_hash(unsigned long code, unsigned int style) {
+	u64 key = ((u64)code << 2) | style;
+	key *= 0x9E3779B97F4A7C15ull;
+	return (usize)(key >> 32);
+}
+
+static unsigned int *fa_find_glyph_slot(fontatlas_t *fa, unsigned long code, unsigned int style) {
+	if (fa->glyph_table_capacity == 0) return NULL;
+
+	const usize mask = fa->glyph_table_capacity - 1;
+	for (usize slot = fa_glyph_hash(code, style) & mask; fa->glyph_table[slot] != 0; slot = (slot + 1) & mask) {
+		fontatlas_glyph_t *g = &fa->glyphs[fa->glyph_table[slot] - 1];
+		if (g->code == code && g->style == style) {
+			return &fa->glyph_table[slot];
+		}
+	}
+
+	return NULL;
 }
 
 static fontatlas_glyph_t *fa_find_glyph(fontatlas_t *fa, unsigned long glyph, unsigned char style) {
-	// TODO: binary search for ascii/all chars?
-	//       we read a lot more often than writing, so reordering
-	//       should be better than linear search on every read.
-	//       measure this once it becomes relevant...
+	unsigned int *slot = fa_find_glyph_slot(fa, glyph, style);
+	if (slot == NULL) return NULL;
+
+	return &fa->glyphs[*slot - 1];
+}
+
+static void fa_table_put(fontatlas_t *fa, unsigned int glyph_index) {
+	const fontatlas_glyph_t *g = &fa->glyphs[glyph_index];
+	const usize mask = fa->glyph_table_capacity - 1;
+	usize slot = fa_glyph_hash(g->code, g->style) & mask;
+	while (fa->glyph_table[slot] != 0) {
+		slot = (slot + 1) & mask;
+	}
+	fa->glyph_table[slot] = glyph_index + 1;
+}
+
+static void fa_table_grow(fontatlas_t *fa) {
+	fa->glyph_table_capacity = (fa->glyph_table_capacity == 0) ? 256 : fa->glyph_table_capacity * 2;
+	free(fa->glyph_table);
+	fa->glyph_table = calloc(fa->glyph_table_capacity, sizeof(*fa->glyph_table));
+	for (unsigned int i = 0; i < fa->num_glyphs; ++i) {
+		fa_table_put(fa, i);
+	}
+}
+
+static fontatlas_glyph_t *fa_insert_glyph(fontatlas_t *fa, const fontatlas_glyph_t *glyph) {
+	assert(fa_find_glyph(fa, glyph->code, glyph->style) == NULL);
+
+	if (fa->num_glyphs == fa->glyphs_capacity) {
+		fa->glyphs_capacity = (fa->glyphs_capacity == 0) ? 128 : fa->glyphs_capacity * 2;
+		fa->glyphs = realloc(fa->glyphs, sizeof(fontatlas_glyph_t) * fa->glyphs_capacity);
+	}
+
+	const unsigned int index = fa->num_glyphs++;
+	fa->glyphs[index] = *glyph;
+
+	// keep load factor below 1/2
+	if (fa->num_glyphs * 2 > fa->glyph_table_capacity) {
+		fa_table_grow(fa);
+	} else {
+		fa_table_put(fa, index);
+	}
+
+	return &fa->glyphs[index];
+}
+
+static void fa_remove_glyph(fontatlas_t *fa, unsigned int glyph_index) {
+	fontatlas_glyph_t *g = &fa->glyphs[glyph_index];
+	unsigned int *found = fa_find_glyph_slot(fa, g->code, g->style);
+	assert(found != NULL);
+
+	// backward shift deletion, keeps probe sequences intact without tombstones
+	const usize mask = fa->glyph_table_capacity - 1;
+	usize hole = found - fa->glyph_table;
+	fa->glyph_table[hole] = 0;
+	for (usize next = (hole + 1) & mask; fa->glyph_table[next] != 0; next = (next + 1) & mask) {
+		const fontatlas_glyph_t *moved = &fa->glyphs[fa->glyph_table[next] - 1];
+		const usize ideal = fa_glyph_hash(moved->code, moved->style) & mask;
+		// can the entry at `next` be moved into the hole? (cyclic range check)
+		const int ideal_in_range = (hole <= next)
+			? (hole < ideal && ideal <= next)
+			: (hole < ideal || ideal <= next);
+		if (!ideal_in_range) {
+			fa->glyph_table[hole] = fa->glyph_table[next];
+			fa->glyph_table[next] = 0;
+			hole = next;
+		}
+	}
+
+	// fill the gap in storage with the last glyph
+	const unsigned int last = fa->num_glyphs - 1;
+	if (glyph_index != last) {
+		unsigned int *last_slot = fa_find_glyph_slot(fa, fa->glyphs[last].code, fa->glyphs[last].style);
+		assert(last_slot != NULL);
+		*last_slot = glyph_index + 1;
+		fa->glyphs[glyph_index] = fa->glyphs[last];
+	}
+	--fa->num_glyphs;
+}
+
+//
+// rect packing
+//
+
+// returns the y coordinate a rect of size w*h can be placed at when its
+// left edge is aligned with skyline node `index`, or -1 if it doesn't fit.
+static int fa_skyline_fit(fontatlas_t *fa, usize index, int w, int h) {
+	const int x = fa->skyline[index].x;
+	if (x + w > (int)fa->texture_atlas.width) return -1;
+
+	int y = 0;
+	for (int remaining = w; remaining > 0; ++index) {
+		assert(index < (usize)stbds_arrlen(fa->skyline));
+		if (fa->skyline[index].y > y) y = fa->skyline[index].y;
+		if (y + h > (int)fa->texture_atlas.height) return -1;
+		remaining -= fa->skyline[index].width;
+	}
+
+	return y;
+}
+
+static int fa_skyline_pack(fontatlas_t *fa, int w, int h, int *OUT_x, int *OUT_y) {
+	// bottom-left heuristic: lowest top edge, then narrowest node
+	int best_index = -1, best_bottom = INT_MAX, best_width = INT_MAX, best_y = 0;
+	for (usize i = 0; i < (usize)stbds_arrlen(fa->skyline); ++i) {
+		const int y = fa_skyline_fit(fa, i, w, h);
+		if (y < 0) continue;
+
+		if (y + h < best_bottom || (y + h == best_bottom && fa->skyline[i].width < best_width)) {
+			best_index = i;
+			best_bottom = y + h;
+			best_width = fa->skyline[i].width;
+			best_y = y;
+		}
+	}
+
+	if (best_index < 0) return 0;
+
+	struct fontatlas_skyline_node_s node = { .x = fa->skyline[best_index].x, .y = best_y + h, .width = w };
+	stbds_arrins(fa->skyline, best_index, node);
+
+	// shrink or remove the nodes now covered by the new one
+	for (usize i = best_index + 1; i < (usize)stbds_arrlen(fa->skyline);) {
+		const struct fontatlas_skyline_node_s *prev = &fa->skyline[i - 1];
+		const int overlap = (prev->x + prev->width) - fa->skyline[i].x;
+		if (overlap <= 0) break;
+
+		fa->skyline[i].x += overlap;
+		fa->skyline[i].width -= overlap;
+		if (fa->skyline[i].width > 0) break;
+		stbds_arrdel(fa->skyline, i);
+	}
+
+	// merge neighbors of equal height
+	for (usize i = 0; i + 1 < (usize)stbds_arrlen(fa->skyline);) {
+		if (fa->skyline[i].y == fa->skyline[i + 1].y) {
+			fa->skyline[i].width += fa->skyline[i + 1].width;
+			stbds_arrdel(fa->skyline, i + 1);
+		} else {
+			++i;
+		}
+	}
+
+	*OUT_x = node.x;
+	*OUT_y = best_y;
+	return 1;
+}
+
+// returns a rect to the free list, merging it with free neighbors
+// that share a full edge.
+static void fa_free_rect(fontatlas_t *fa, ivec4s rect) {
+	for (usize i = 0; i < (usize)stbds_arrlen(fa->free_rects);) {
+		const ivec4s r = fa->free_rects[i];
+		const int same_row    = (r.y == rect.y && r.w == rect.w);
+		const int same_column = (r.x == rect.x && r.z == rect.z);
+		if (same_row && (r.x + r.z == rect.x || rect.x + rect.z == r.x)) {
+			rect.x = (r.x < rect.x) ? r.x : rect.x;
+			rect.z += r.z;
+		} else if (same_column && (r.y + r.w == rect.y || rect.y + rect.w == r.y)) {
+			rect.y = (r.y < rect.y) ? r.y : rect.y;
+			rect.w += r.w;
+		} else {
+			++i;
+			continue;
+		}
+
+		// merged rect could now touch a rect we already looked at
+		stbds_arrdel(fa->free_rects, i);
+		i = 0;
+	}
+
+	stbds_arrput(fa->free_rects, rect);
+}
+
+// evicts the least recently used glyph which wasn't used by the current write.
+static int fa_evict_glyph(fontatlas_t *fa) {
+	int lru = -1;
 	for (unsigned int i = 0; i < fa->num_glyphs; ++i) {
-		fontatlas_glyph_t *g = &fa->glyphs[i];
-		if (g->code == glyph && g->style == style) {
-			return g;
+		const fontatlas_glyph_t *g = &fa->glyphs[i];
+		if (g->texture_rect.z == 0 || g->last_used == fa->use_clock) continue;
+		if (lru < 0 || g->last_used < fa->glyphs[lru].last_used) {
+			lru = i;
+		}
+	}
+
+	if (lru < 0) return 0;
+
+	const ivec4s *rect = &fa->glyphs[lru].texture_rect;
+	ivec4s freed = { .x = rect->x, .y = rect->y, .z = rect->z + fa->atlas_padding, .w = rect->w + fa->atlas_padding };
+	fa_remove_glyph(fa, lru);
+	fa_free_rect(fa, freed);
+	++fa->atlas_generation;
+	return 1;
+}
+
+// finds space for a w*h bitmap, evicting old glyphs if the atlas is full.
+static int fa_allocate_rect(fontatlas_t *fa, int w, int h, ivec4s *OUT_rect) {
+	const int padded_w = w + fa->atlas_padding;
+	const int padded_h = h + fa->atlas_padding;
+
+	do {
+		int x, y;
+		if (fa_skyline_pack(fa, padded_w, padded_h, &x, &y)) {
+			*OUT_rect = (ivec4s){ .x = x, .y = y, .z = w, .w = h };
+			return 1;
+		}
+
+		// smallest evicted rect that fits
+		int best = -1;
+		for (usize i = 0; i < (usize)stbds_arrlen(fa->free_rects); ++i) {
+			const ivec4s *r = &fa->free_rects[i];
+			if (r->z < padded_w || r->w < padded_h) continue;
+			if (best < 0 || r->z * r->w < fa->free_rects[best].z * fa->free_rects[best].w) {
+				best = i;
+			}
+		}
+
+		if (best >= 0) {
+			const ivec4s freed = fa->free_rects[best];
+			stbds_arrdel(fa->free_rects, best);
+
+			// clear leftovers of the evicted glyph, they would bleed in through filtering
+			unsigned char *zeros = calloc(padded_w * padded_h, 1);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, freed.x, freed.y, padded_w, padded_h, GL_ALPHA, GL_UNSIGNED_BYTE, zeros);
+			free(zeros);
+
+			// keep the unused remainder around (guillotine split)
+			if (freed.z > padded_w) {
+				ivec4s right = { .x = freed.x + padded_w, .y = freed.y, .z = freed.z - padded_w, .w = padded_h };
+				stbds_arrput(fa->free_rects, right);
+			}
+			if (freed.w > padded_h) {
+				ivec4s below = { .x = freed.x, .y = freed.y + padded_h, .z = freed.z, .w = freed.w - padded_h };
+				stbds_arrput(fa->free_rects, below);
+			}
+
+			*OUT_rect = (ivec4s){ .x = freed.x, .y = freed.y, .z = w, .w = h };
+			return 1;
+		}
+	} while (fa_evict_glyph(fa));
+
+	return 0;
+}
+
+// rasterizes a single glyph into the atlas. glyphs without a bitmap (or
+// without an entry in the face) are stored with an empty rect, so they
+// aren't looked up in FreeType again.
+static fontatlas_glyph_t *fa_rasterize_glyph(fontatlas_t *fa, unsigned long character, enum fontatlas_font_style style) {
+	FT_Face face = fa->faces[style];
+	if (face == NULL) return NULL;
+
+	fontatlas_glyph_t glyph = {
+		.code = character,
+		.style = style,
+		.texture_rect = { .x = 0, .y = 0, .z = 0, .w = 0 },
+		.bearing = { .x = 0.0f, .y = 0.0f },
+		.last_used = fa->use_clock,
+	};
+
+	FT_UInt glyph_index = FT_Get_Char_Index(face, character);
+	// 0 is "missing glyph" and renders as a box/question mark/space...
+	if (glyph_index == 0) {
+		printf("no glyph for %c(0x%lX) and face %d\n", (char)character, character, style);
+		return fa_insert_glyph(fa, &glyph);
+	}
+
+	FT_Error error;
+	error = FT_Load_Glyph(face, glyph_index, FT_LOAD_DEFAULT | FT_LOAD_TARGET_NORMAL); // FT_LOAD_RENDER??
+	assert(!error);
+
+	FT_Render_Mode render_mode = FT_RENDER_MODE_NORMAL;
+#if FONTATLAS_HAS_SDF
+	if (fa->render_mode == FONTATLAS_RENDER_SDF) {
+		render_mode = FT_RENDER_MODE_SDF;
+	}
+#endif
+	error = FT_Render_Glyph(face->glyph, render_mode);
+	assert(!error);
+
+	const FT_Bitmap *bitmap = &face->glyph->bitmap;
+	glyph.bearing.x = face->glyph->bitmap_left;
+	glyph.bearing.y = face->glyph->bitmap_top;
+
+	if (bitmap->width > 0 && bitmap->rows > 0) {
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glBindTexture(GL_TEXTURE_2D, fa->texture_atlas.texture);
+
+		if (!fa_allocate_rect(fa, bitmap->width, bitmap->rows, &glyph.texture_rect)) {
+			fprintf(stderr, "font atlas is full, can't add glyph 0x%lX.\n", character);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			glBindTexture(GL_TEXTURE_2D, 0);
+			return NULL;
 		}
+
+		// store glyph bitmap
+		glTexSubImage2D(GL_TEXTURE_2D, 0,
+			glyph.texture_rect.x, glyph.texture_rect.y, glyph.texture_rect.z, glyph.texture_rect.w,
+			GL_ALPHA, GL_UNSIGNED_BYTE,
+			bitmap->buffer);
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	return fa_insert_glyph(fa, &glyph);
+}
+
+//
+// run cache
+//
+
+static uint64_t fa_hash_string(const char *str, unsigned int str_len) {
+	// FNV-1a
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (unsigned int i = 0; i < str_len; ++i) {
+		hash ^= (unsigned char)str[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+static struct fontatlas_run_s *fa_find_run(fontatlas_t *fa, const pipeline_t *pipeline, enum fontatlas_write_config config, uint max_width, uint64_t hash, unsigned int str_len, const char *str) {
+	for (usize i = 0; i < FONTATLAS_RUN_CACHE_SIZE; ++i) {
+		struct fontatlas_run_s *run = &fa->runs[i];
+		if (run->str == NULL || run->hash != hash) continue;
+		if (run->str_len != str_len || run->max_width != max_width || run->config != config || run->texture != pipeline->texture) continue;
+		if (run->atlas_generation != fa->atlas_generation) continue;
+		if (memcmp(run->str, str, str_len) != 0) continue;
+
+		return run;
 	}
 
 	return NULL;
 }
 
+// stores the commands of the last layout, replacing the least recently used run.
+static void fa_store_run(fontatlas_t *fa, const pipeline_t *pipeline, enum fontatlas_write_config config, uint max_width, uint64_t hash, unsigned int str_len, const char *str) {
+	struct fontatlas_run_s *run = &fa->runs[0];
+	for (usize i = 1; i < FONTATLAS_RUN_CACHE_SIZE && run->str != NULL; ++i) {
+		if (fa->runs[i].str == NULL || fa->runs[i].last_used < run->last_used) {
+			run = &fa->runs[i];
+		}
+	}
+
+	run->str = realloc(run->str, str_len);
+	memcpy(run->str, str, str_len);
+	run->str_len = str_len;
+	run->hash = hash;
+	run->max_width = max_width;
+	run->config = config;
+	run->texture = pipeline->texture;
+	run->atlas_generation = fa->atlas_generation;
+	run->last_used = fa->use_clock;
+
+	stbds_arrsetlen(run->cmds, pipeline->commands_count);
+	memcpy(run->cmds, pipeline->cmd_buffer, pipeline->commands_count * sizeof(*run->cmds));
+
+	// the glyphs of this layout are exactly those touched by this write.
+	stbds_arrsetlen(run->glyphs, 0);
+	for (unsigned int i = 0; i < fa->num_glyphs; ++i) {
+		if (fa->glyphs[i].last_used == fa->use_clock) {
+			stbds_arrput(run->glyphs, i);
+		}
+	}
+}
+
+// decodes the utf-8 sequence at str, returns its codepoint and length in bytes.
+static uint fa_decode_utf8(const char *str, unsigned int str_len, unsigned int *OUT_len) {
+	const unsigned char *s = (const unsigned char *)str;
+	unsigned int len = 1;
+	uint codepoint = s[0];
+	if      ((s[0] & 0xE0) == 0xC0) { len = 2; codepoint = s[0] & 0x1F; }
+	else if ((s[0] & 0xF0) == 0xE0) { len = 3; codepoint = s[0] & 0x0F; }
+	else if ((s[0] & 0xF8) == 0xF0) { len = 4; codepoint = s[0] & 0x07; }
+
+	if (len > str_len) {
+		*OUT_len = 1;
+		return s[0];
+	}
+
+	for (unsigned int i = 1; i < len; ++i) {
+		codepoint = (codepoint << 6) | (s[i] & 0x3F);
+	}
+
+	*OUT_len = len;
+	return codepoint;
+}
+
 static void apply_styling(uint character, enum fontatlas_font_style *style, drawcmd_t *cmd, int *is_printable) {
 	*is_printable = 0;
 	switch (character) {
@@ -91,7 +494,19 @@ void fontatlas_init(fontatlas_t *fa, struct engine *engine) {
 	}
 	fa->glyphs = NULL;
 	fa->num_glyphs = 0;
+	fa->glyphs_capacity = 0;
+	fa->glyph_table = NULL;
+	fa->glyph_table_capacity = 0;
+	fa->use_clock = 0;
+	fa->atlas_generation = 0;
 	fa->atlas_padding = 2;
+	fa->render_mode = FONTATLAS_RENDER_NORMAL;
+	fa->face_size = 0;
+	for (usize i = 0; i < FONTATLAS_FONT_STYLE_MAX; ++i) {
+		fa->hb_fonts[i] = NULL;
+	}
+	fa->hb_buffer = hb_buffer_create();
+	memset(fa->runs, 0, sizeof(fa->runs));
 	fa->pixel_ratio = engine->window_pixel_ratio;
 
 	struct texture_settings_s settings = TEXTURE_SETTINGS_INIT;
@@ -100,6 +515,11 @@ void fontatlas_init(fontatlas_t *fa, struct engine *engine) {
 	settings.internal_format = GL_ALPHA;
 	texture_init(&fa->texture_atlas, 2048, 2048, &settings);
 
+	fa->skyline = NULL;
+	fa->free_rects = NULL;
+	struct fontatlas_skyline_node_s ground = { .x = 0, .y = 0, .width = fa->texture_atlas.width };
+	stbds_arrput(fa->skyline, ground);
+
 	// TODO: Is this really required? Feels like a wasteful
 	//       way to prevent oversampling artifacts.
 	//       Can FreeType generate empty padding?
@@ -111,19 +531,69 @@ void fontatlas_destroy(fontatlas_t *fa) {
 
 	fa->library_ref = NULL;
 	for (unsigned int i = 0; i < FONTATLAS_FONT_STYLE_MAX; ++i) {
+		if (fa->hb_fonts[i] != NULL) {
+			hb_font_destroy(fa->hb_fonts[i]);
+			fa->hb_fonts[i] = NULL;
+		}
 		FT_Done_Face(fa->faces[i]);
 	}
+	hb_buffer_destroy(fa->hb_buffer);
+	fa->hb_buffer = NULL;
+
+	for (usize i = 0; i < FONTATLAS_RUN_CACHE_SIZE; ++i) {
+		free(fa->runs[i].str);
+		stbds_arrfree(fa->runs[i].cmds);
+		stbds_arrfree(fa->runs[i].glyphs);
+	}
+	memset(fa->runs, 0, sizeof(fa->runs));
 	free(fa->glyphs);
 	fa->glyphs = NULL;
 	fa->num_glyphs = 0;
+	fa->glyphs_capacity = 0;
+	free(fa->glyph_table);
+	fa->glyph_table = NULL;
+	fa->glyph_table_capacity = 0;
+
+	stbds_arrfree(fa->skyline);
+	stbds_arrfree(fa->free_rects);
 
 	texture_destroy(&fa->texture_atlas);
 }
 
+int fontatlas_set_render_mode(fontatlas_t *fa, enum fontatlas_render_mode mode) {
+	assert(fa != NULL);
+	assert(fa->num_glyphs == 0 && "Render mode has to be set before adding glyphs");
+
+	switch (mode) {
+		case FONTATLAS_RENDER_NORMAL:
+			break;
+		case FONTATLAS_RENDER_SDF:
+			if (!FONTATLAS_HAS_SDF) {
+				fprintf(stderr, "FreeType is too old for SDF rendering, keeping normal rendering.\n");
+				fa->render_mode = FONTATLAS_RENDER_NORMAL;
+				return 0;
+			}
+			break;
+	}
+
+	fa->render_mode = mode;
+	return 1;
+}
+
+void fontatlas_setup_shader(fontatlas_t *fa, shader_t *shader) {
+	assert(fa != NULL);
+	assert(shader != NULL);
+
+	shader_set_uniform_int(shader, "u_sdf", fa->render_mode == FONTATLAS_RENDER_SDF);
+	shader_use(NULL);
+}
+
 unsigned int fontatlas_add_face(fontatlas_t *fa, const char *filename, int size) {
 	assert(fa != NULL);
 	assert(filename != NULL);
 	assert(fa->num_glyphs == 0); // TODO: update existing glyphs
+	assert((fa->face_size == 0 || fa->face_size == size) && "All faces need the same size");
+	fa->face_size = size;
 
 	FT_Face face;
 
@@ -151,68 +621,26 @@ unsigned int fontatlas_add_face(fontatlas_t *fa, const char *filename, int size)
 	}
 	assert(fa->faces[style] == NULL && "Font face is already loaded, replacing isn't supported!");
 	fa->faces[style] = face;
+	fa->hb_fonts[style] = hb_ft_font_create_referenced(face);
 
 	return style;
 }
 
-void fontatlas_add_glyph(fontatlas_t *fa, unsigned long character) {
+float fontatlas_scale(fontatlas_t *fa, float size) {
 	assert(fa != NULL);
-	
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-	glBindTexture(GL_TEXTURE_2D, fa->texture_atlas.texture);
+	assert(fa->face_size > 0);
+	return size / fa->face_size;
+}
 
-	// TODO: rect packing instead of this
-	static int free_x = 0;
-	static int free_y = 0;
-	static int height_max = 0;
+void fontatlas_add_glyph(fontatlas_t *fa, unsigned long character) {
+	assert(fa != NULL);
 
 	for (unsigned int style = 0; style < FONTATLAS_FONT_STYLE_MAX; ++style) {
-		FT_Face face = fa->faces[style];
-		if (face == NULL) continue;
+		if (fa->faces[style] == NULL) continue;
+		if (fa_find_glyph(fa, character, style) != NULL) continue;
 
-		FT_UInt glyph_index = FT_Get_Char_Index(face, character);
-		// 0 is "missing glyph" and renders as a box/question mark/space...
-		if (glyph_index == 0) {
-			printf("no glyph for %c(0x%lX) and face %d\n", (char)character, character, style);
-			continue;
-		}
-
-		FT_Error error;
-		error = FT_Load_Glyph(face, glyph_index, FT_LOAD_DEFAULT | FT_LOAD_TARGET_NORMAL); // FT_LOAD_RENDER??
-		assert(!error);
-
-		error = FT_Render_Glyph(face->glyph, FT_RENDER_MODE_NORMAL);
-		assert(!error);
-
-		if (free_x + face->glyph->bitmap.width >= fa->texture_atlas.width) {
-			free_x = 0;
-			free_y += height_max + fa->atlas_padding;
-			height_max = 0;
-		}
-
-		fa_append_glyph_memory(fa);
-		fontatlas_glyph_t *fg = &fa->glyphs[fa->num_glyphs - 1];
-		fg->code = character;
-		fg->texture_rect.x = free_x;
-		fg->texture_rect.y = free_y;
-		fg->texture_rect.z = face->glyph->bitmap.width;
-		fg->texture_rect.w = face->glyph->bitmap.rows;
-		fg->style = style;
-		fg->bearing.x = face->glyph->bitmap_left;
-		fg->bearing.y = face->glyph->bitmap_top;
-
-		// store glyph bitmap
-		glTexSubImage2D(GL_TEXTURE_2D, 0,
-			fg->texture_rect.x, fg->texture_rect.y, fg->texture_rect.z, fg->texture_rect.w,
-			GL_ALPHA, GL_UNSIGNED_BYTE,
-			face->glyph->bitmap.buffer);
-
-		free_x += face->glyph->bitmap.width + fa->atlas_padding;
-		height_max = (fg->texture_rect.w > height_max) ? fg->texture_rect.w : height_max;
+		fa_rasterize_glyph(fa, character, style);
 	}
-
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-	glBindTexture(GL_TEXTURE_2D, 0);
 }
 
 void fontatlas_add_ascii_glyphs(fontatlas_t *fa) {
@@ -225,20 +653,20 @@ fontatlas_glyph_t *fontatlas_get_glyph(fontatlas_t *fa, unsigned long glyph, enu
 	assert(fa != NULL);
 	assert(fa->faces[style] != NULL);
 
-	return fa_find_glyph(fa, glyph, style);
-}
-
-void fontatlas_write_ex(fontatlas_t *fa, pipeline_t *pipeline, enum fontatlas_write_config config, uint max_width, unsigned int str_len, char *str) {
-	assert(fa != NULL);
-	assert(str != NULL);
-	assert(str_len > 0);
-
-	if (max_width == FONTATLAS_UNLIMITED) {
-		max_width = (uint)-1;
+	fontatlas_glyph_t *g = fa_find_glyph(fa, glyph, style);
+	if (g == NULL) {
+		g = fa_rasterize_glyph(fa, glyph, style);
+		if (g == NULL) return NULL;
 	}
 
-	pipeline_reset(pipeline);
+	g->last_used = fa->use_clock;
+	return g;
+}
 
+// shapes and lays out str, emitting the glyphs into pipeline.
+// returns 0 if some glyphs couldn't be added to the atlas.
+static int fa_layout_text(fontatlas_t *fa, pipeline_t *pipeline, uint max_width, unsigned int str_len, const char *str) {
+	int is_complete = 1;
 	const float pixel_ratio = fa->pixel_ratio;
 	enum fontatlas_font_style style = FONTATLAS_REGULAR;
 
@@ -250,8 +678,9 @@ void fontatlas_write_ex(fontatlas_t *fa, pipeline_t *pipeline, enum fontatlas_wr
 	assert(line_height > 0);
 
 	// shaping
-	hb_buffer_t *hb_buffer = hb_buffer_create();
-	hb_font_t *hb_font = hb_ft_font_create_referenced(face);
+	hb_buffer_t *hb_buffer = fa->hb_buffer;
+	hb_font_t *hb_font = fa->hb_fonts[style];
+	hb_buffer_clear_contents(hb_buffer);
 	// TODO: remove unprintable & control characters from buffer...
 	hb_buffer_add_utf8(hb_buffer, str, str_len, 0, str_len);
 	hb_buffer_guess_segment_properties(hb_buffer);
@@ -262,7 +691,7 @@ void fontatlas_write_ex(fontatlas_t *fa, pipeline_t *pipeline, enum fontatlas_wr
 	};
 	hb_shape(hb_font, hb_buffer, no_ligatures, count_of(no_ligatures));
 	unsigned int shaped_len = hb_buffer_get_length(hb_buffer);
-	//hb_glyph_info_t *infos = hb_buffer_get_glyph_infos(hb_buffer, NULL);
+	hb_glyph_info_t *infos = hb_buffer_get_glyph_infos(hb_buffer, NULL);
 	hb_glyph_position_t *positions = hb_buffer_get_glyph_positions(hb_buffer, NULL);
 
 	// control state
@@ -271,11 +700,14 @@ void fontatlas_write_ex(fontatlas_t *fa, pipeline_t *pipeline, enum fontatlas_wr
 	vec2s cursor = { .x=0, .y=line_height };
 	drawcmd_t cmd = DRAWCMD_INIT;
 	for (uint i = 0; i < shaped_len; ++i) {
-		uint character = str[i]; // TODO: infos[i].codepoint?
+		// glyph to source text, infos[i].codepoint is a glyph index after shaping
+		const unsigned int cluster = infos[i].cluster;
+		unsigned int character_len;
+		uint character = fa_decode_utf8(&str[cluster], str_len - cluster, &character_len);
 
 		// handle ccontrol characters
-		const int is_last_char = (i == shaped_len - 1);
-		if (character == '$' && !is_last_char && str[i + 1] != '$') {
+		const int is_last_char = (cluster + character_len >= str_len);
+		if (character == '$' && !is_last_char && str[cluster + character_len] != '$') {
 			goto next_iteration;
 		} else if (last_character == '$') {
 			int is_printable = 0;
@@ -287,10 +719,10 @@ void fontatlas_write_ex(fontatlas_t *fa, pipeline_t *pipeline, enum fontatlas_wr
 		}
 
 		fontatlas_glyph_t *glyph_info = fontatlas_get_glyph(fa, character, style);
+		is_complete = is_complete && (glyph_info != NULL);
 
 		// skip non-drawable characters
-		// TODO: differentiate between non-drawable and just not rasterized (yet?)
-		if (glyph_info) {
+		if (glyph_info && glyph_info->texture_rect.z > 0) {
 			cmd.position.x = cursor.x + (positions[i].x_offset + glyph_info->bearing.x) / pixel_ratio;
 			cmd.position.y = cursor.y + (positions[i].y_offset - glyph_info->bearing.y) / pixel_ratio;
 			cmd.size.x = glyph_info->texture_rect.z / pixel_ratio;
@@ -311,8 +743,40 @@ next_iteration:
 		last_character = character;
 	}
 
-	hb_buffer_destroy(hb_buffer);
-	hb_font_destroy(hb_font);
+	return is_complete;
+}
+
+void fontatlas_write_ex(fontatlas_t *fa, pipeline_t *pipeline, enum fontatlas_write_config config, uint max_width, unsigned int str_len, char *str) {
+	assert(fa != NULL);
+	assert(str != NULL);
+	assert(str_len > 0);
+
+	if (max_width == FONTATLAS_UNLIMITED) {
+		max_width = (uint)-1;
+	}
+
+	pipeline_reset(pipeline);
+	++fa->use_clock;
+
+	// unchanged text is copied from the cache
+	const uint64_t hash = fa_hash_string(str, str_len);
+	struct fontatlas_run_s *run = fa_find_run(fa, pipeline, config, max_width, hash, str_len, str);
+	if (run != NULL) {
+		const int cmds_len = stbds_arrlen(run->cmds);
+		assert(!pipeline->z_sorting_enabled);
+		assert(cmds_len <= pipeline->commands_max);
+		memcpy(pipeline->cmd_buffer, run->cmds, cmds_len * sizeof(*run->cmds));
+		pipeline->commands_count = cmds_len;
+		run->last_used = fa->use_clock;
+		for (int i = 0; i < stbds_arrlen(run->glyphs); ++i) {
+			fa->glyphs[run->glyphs[i]].last_used = fa->use_clock;
+		}
+		return;
+	}
+
+	if (fa_layout_text(fa, pipeline, max_width, str_len, str)) {
+		fa_store_run(fa, pipeline, config, max_width, hash, str_len, str);
+	}
 }
 
 void fontatlas_writef_ex(fontatlas_t *fa, pipeline_t *pipeline, enum fontatlas_write_config config, uint max_width, char *fmt, ...) {
@@ -3,11 +3,13 @@
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
+#include <stdint.h>
 #include <cglm/cglm.h>
 #include "gl/texture.h"
 #include "gl/graphics2d.h"
 
 #define FONTATLAS_UNLIMITED 0
+#define FONTATLAS_RUN_CACHE_SIZE 64
 
 // text experiments
 
@@ -27,6 +29,14 @@ enum fontatlas_font_style {
 	FONTATLAS_FONT_STYLE_MAX
 };
 
+enum fontatlas_render_mode {
+	FONTATLAS_RENDER_NORMAL,
+	// signed distance fields, glyphs stay sharp when scaled. Rasterize the
+	// faces larger and scale the pipeline transform by fontatlas_scale().
+	// requires FreeType 2.11 or newer.
+	FONTATLAS_RENDER_SDF
+};
+
 enum fontatlas_write_config {
 	FONTATLAS_WRITE_DEFAULT = 0,
 	// horizontal
@@ -41,20 +51,69 @@ enum fontatlas_write_config {
 
 struct fontatlas_glyph_s {
 	unsigned long code;
-	ivec4s texture_rect;
+	ivec4s texture_rect; // zero size if the glyph has no bitmap
 	enum fontatlas_font_style style;
 	vec2s bearing;
+	// fontatlas_s.use_clock of the last write that used this glyph
+	unsigned int last_used;
+};
+
+struct fontatlas_skyline_node_s {
+	int x, y, width;
+};
+
+// a laid out string, as written by fontatlas_write_ex()
+struct fontatlas_run_s {
+	uint64_t hash;
+	char *str;
+	unsigned int str_len;
+	uint max_width;
+	enum fontatlas_write_config config;
+	const texture_t *texture;
+	// fontatlas_s.atlas_generation at the time of layout
+	unsigned int atlas_generation;
+	unsigned int last_used;
+
+	drawcmd_t *cmds;
+	// indices into fontatlas_s.glyphs, stable until the next eviction.
+	// touched on every hit, so cached text isn't evicted from the atlas.
+	unsigned int *glyphs;
 };
 
 struct fontatlas_s {
 	FT_Library library_ref;
 	FT_Face faces[FONTATLAS_FONT_STYLE_MAX];
 
+	// harfbuzz state, kept between writes
+	struct hb_font_t *hb_fonts[FONTATLAS_FONT_STYLE_MAX];
+	struct hb_buffer_t *hb_buffer;
+
 	texture_t texture_atlas;
 	int atlas_padding;
-
+	enum fontatlas_render_mode render_mode;
+	// size passed to fontatlas_add_face(), the same for every face.
+	int face_size;
+	// incremented whenever glyphs are evicted, invalidates cached runs
+	unsigned int atlas_generation;
+
+	// rect packing: a skyline over the atlas, plus the (padded) rects
+	// of evicted glyphs which can be reused.
+	struct fontatlas_skyline_node_s *skyline;
+	ivec4s *free_rects;
+
+	// glyph storage and an open addressing table of indices into it,
+	// keyed by (code, style). 0 marks an empty slot, otherwise index + 1.
 	struct fontatlas_glyph_s *glyphs;
 	unsigned int num_glyphs;
+	unsigned int glyphs_capacity;
+	unsigned int *glyph_table;
+	unsigned int glyph_table_capacity;
+
+	// incremented on every write, used for least-recently-used eviction
+	unsigned int use_clock;
+
+	// recently written strings, so unchanged text doesn't need shaping
+	struct fontatlas_run_s runs[FONTATLAS_RUN_CACHE_SIZE];
 
 	// From engine->window_pixel_ratio
 	float pixel_ratio;
@@ -63,9 +122,17 @@ struct fontatlas_s {
 // init/destroy
 void fontatlas_init(fontatlas_t *, struct engine *engine);
 void fontatlas_destroy(fontatlas_t *);
+// returns 0 and keeps FONTATLAS_RENDER_NORMAL if FreeType can't render SDFs
+int  fontatlas_set_render_mode(fontatlas_t *, enum fontatlas_render_mode);
+// sets the uniforms the text shader needs for this atlas, again whenever
+// the shader was (re)loaded.
+void fontatlas_setup_shader(fontatlas_t *, shader_t *);
 // faces
 unsigned int fontatlas_add_face(fontatlas_t *, const char *filename, int size);
-// glyphs
+// scale of the written text to appear at `size`, e.g. for pipeline_set_transform()
+float fontatlas_scale(fontatlas_t *, float size);
+// glyphs. glyphs missing on write are rasterized on demand, and when the
+// atlas is full the least recently used ones are evicted.
 void fontatlas_add_glyph(fontatlas_t *, ulong glyph);
 void fontatlas_add_ascii_glyphs(fontatlas_t *fa);
 // rendering
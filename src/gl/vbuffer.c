@@ -53,6 +53,10 @@ void vbuffer_set_attrib(struct vbuffer_s *vbo, shader_t *shader, const char *att
 }
 
 void vbuffer_draw(struct vbuffer_s *vbo, size_t n_vertices) {
+	vbuffer_draw_ex(vbo, GL_TRIANGLES, n_vertices);
+}
+
+void vbuffer_draw_ex(struct vbuffer_s *vbo, GLenum mode, size_t n_vertices) {
 	glBindBuffer(GL_ARRAY_BUFFER, vbo->buffer);
 
 	for (size_t i = 0; i < vbo->n_attribs; ++i) {
@@ -61,7 +65,7 @@ void vbuffer_draw(struct vbuffer_s *vbo, size_t n_vertices) {
 		glEnableVertexAttribArray(attrib->location);
 	}
 
-	glDrawArrays(GL_TRIANGLES, 0, n_vertices);
+	glDrawArrays(mode, 0, n_vertices);
 	// TODO: restore previously bound ARRAY_BUFFER, or dont even unset?
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
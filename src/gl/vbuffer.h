@@ -22,5 +22,6 @@ void vbuffer_set_data(struct vbuffer_s *vbo, size_t sizeof_vertices, float *vert
 void vbuffer_set_attrib(struct vbuffer_s *vbo, shader_t *, const char *attribname, GLint size, GLenum type, GLint stride, GLvoid *offset);
 
 void vbuffer_draw(struct vbuffer_s *vbo, size_t n_vertices);
+void vbuffer_draw_ex(struct vbuffer_s *vbo, GLenum mode, size_t n_vertices);
 
 #endif
@@ -4,9 +4,43 @@
 
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <cJSON.h>
 
+//
+// binary layout of each message
+//
+
+#define FIELD_INT(_name, _field)    { .type = MESSAGE_FIELD_INT,    .name = #_field, .offset = offsetof(struct _name, _field) }
+#define FIELD_STRING(_name, _field) { .type = MESSAGE_FIELD_STRING, .name = #_field, .offset = offsetof(struct _name, _field) }
+#define FIELD_INT_OPTIONAL(_name, _field) \
+	{ .type = MESSAGE_FIELD_INT, .name = #_field, .is_optional = 1, .offset = offsetof(struct _name, _field) }
+#define FIELD_INT_ARRAY(_name, _field, _capacity) {                             \
+		.type = MESSAGE_FIELD_INT_ARRAY, .name = #_field,                          \
+		.offset = offsetof(struct _name, _field),                                 \
+		.count_offset = offsetof(struct _name, _field##_len),                     \
+		.capacity = _capacity }
+#define FIELD(_name, _kind, ...) FIELD_##_kind(_name, __VA_ARGS__),
+// the field list from message.h, messages without fields have no table.
+#define MESSAGE_FIELD_TABLE(_name, _list) \
+	static const struct message_field _name##_fields[] = { _list(FIELD, _name) }
+#define MESSAGE_FIELDS(_name) \
+	.fields = _name##_fields, .fields_len = sizeof(_name##_fields) / sizeof(*_name##_fields)
+
+MESSAGE_FIELD_TABLE(welcome_response,      WELCOME_RESPONSE_FIELDS);
+MESSAGE_FIELD_TABLE(lobby_create_request,  LOBBY_CREATE_REQUEST_FIELDS);
+MESSAGE_FIELD_TABLE(lobby_create_response, LOBBY_CREATE_RESPONSE_FIELDS);
+MESSAGE_FIELD_TABLE(lobby_join_request,    LOBBY_JOIN_REQUEST_FIELDS);
+MESSAGE_FIELD_TABLE(lobby_join_response,   LOBBY_JOIN_RESPONSE_FIELDS);
+MESSAGE_FIELD_TABLE(lobby_list_response,   LOBBY_LIST_RESPONSE_FIELDS);
+MESSAGE_FIELD_TABLE(wire_format_request,   WIRE_FORMAT_REQUEST_FIELDS);
+
+static int    json_has_fields(cJSON *, const message_function_info_t *);
+static size_t binary_encode_payload(struct message_header *, uint8_t *out);
+static size_t varint_write(uint8_t *out, uint32_t value);
+static int    varint_read (const uint8_t **data, const uint8_t *end, uint32_t *value);
+
 const message_function_info_t message_function_infos[MSG_TYPE_MAX] = {
 	[MSG_TYPE_UNKNOWN] = (message_function_info_t){
 		.name="MSG_TYPE_UNKNOWN",
@@ -19,30 +53,35 @@ const message_function_info_t message_function_infos[MSG_TYPE_MAX] = {
 		.pack_fn     = (message_pack_fn)pack_welcome_response,
 		.unpack_fn   = (message_unpack_fn)unpack_welcome_response,
 		.struct_size = sizeof(struct welcome_response),
+		MESSAGE_FIELDS(welcome_response),
 	},
 	[LOBBY_CREATE_REQUEST] = (message_function_info_t){
 		.name        = "LOBBY_CREATE_REQUEST",
 		.pack_fn     = (message_pack_fn)pack_lobby_create_request,
 		.unpack_fn   = (message_unpack_fn)unpack_lobby_create_request,
 		.struct_size = sizeof(struct lobby_create_request),
+		MESSAGE_FIELDS(lobby_create_request),
 	},
 	[LOBBY_CREATE_RESPONSE] = (message_function_info_t){
 		.name        = "LOBBY_CREATE_RESPONSE",
 		.pack_fn     = (message_pack_fn)pack_lobby_create_response,
 		.unpack_fn   = (message_unpack_fn)unpack_lobby_create_response,
 		.struct_size = sizeof(struct lobby_create_response),
+		MESSAGE_FIELDS(lobby_create_response),
 	},
 	[LOBBY_JOIN_REQUEST] = (message_function_info_t){
 		.name        = "LOBBY_JOIN_REQUEST",
 		.pack_fn     = (message_pack_fn)pack_lobby_join_request,
 		.unpack_fn   = (message_unpack_fn)unpack_lobby_join_request,
 		.struct_size = sizeof(struct lobby_join_request),
+		MESSAGE_FIELDS(lobby_join_request),
 	},
 	[LOBBY_JOIN_RESPONSE] = (message_function_info_t){
 		.name        = "LOBBY_JOIN_RESPONSE",
 		.pack_fn     = (message_pack_fn)pack_lobby_join_response,
 		.unpack_fn   = (message_unpack_fn)unpack_lobby_join_response,
 		.struct_size = sizeof(struct lobby_join_response),
+		MESSAGE_FIELDS(lobby_join_response),
 	},
 	[LOBBY_LIST_REQUEST] = (message_function_info_t){
 		.name        = "LOBBY_LIST_REQUEST",
@@ -55,6 +94,20 @@ const message_function_info_t message_function_infos[MSG_TYPE_MAX] = {
 		.pack_fn     = (message_pack_fn)pack_lobby_list_response,
 		.unpack_fn   = (message_unpack_fn)unpack_lobby_list_response,
 		.struct_size = sizeof(struct lobby_list_response),
+		MESSAGE_FIELDS(lobby_list_response),
+	},
+	[WIRE_FORMAT_REQUEST] = (message_function_info_t){
+		.name        = "WIRE_FORMAT_REQUEST",
+		.pack_fn     = (message_pack_fn)pack_wire_format_request,
+		.unpack_fn   = (message_unpack_fn)unpack_wire_format_request,
+		.struct_size = sizeof(struct wire_format_request),
+		MESSAGE_FIELDS(wire_format_request),
+	},
+	[MSG_DISCONNECTED] = (message_function_info_t){
+		.name="MSG_DISCONNECTED",
+		.pack_fn=NULL,
+		.unpack_fn=NULL,
+		.struct_size=0,
 	},
 };
 
@@ -111,15 +164,17 @@ struct message_header *unpack_message(cJSON *json) {
 
 	struct message_header header;
 	unpack_message_header(json, &header);
-	if (header.type == 0) {
+	if (header.type <= MSG_TYPE_UNKNOWN || header.type >= MSG_TYPE_MAX) {
 		return NULL;
 	}
 
+	// the unpack functions expect every field to be there.
 	const message_function_info_t *info = &message_function_infos[header.type];
 	const message_unpack_fn unpack_fn = info->unpack_fn;
 	const size_t struct_size = info->struct_size;
-	assert(unpack_fn != NULL);
-	assert(struct_size > 0);
+	if (unpack_fn == NULL || struct_size == 0 || !json_has_fields(json, info)) {
+		return NULL;
+	}
 
 	struct message_header *msg = malloc(struct_size);
 	unpack_fn(json, msg);
@@ -138,6 +193,7 @@ void pack_welcome_response(struct welcome_response *msg, cJSON *json) {
 	pack_message_header(&msg->header, json);
 
 	cJSON_AddNumberToObject(json, "_dummy", msg->_dummy);
+	cJSON_AddNumberToObject(json, "wire_formats", msg->wire_formats);
 }
 
 void unpack_welcome_response(cJSON *json, struct welcome_response *msg) {
@@ -145,6 +201,10 @@ void unpack_welcome_response(cJSON *json, struct welcome_response *msg) {
 	assert(msg->header.type == WELCOME_RESPONSE);
 
 	msg->_dummy = cJSON_GetObjectItem(json, "_dummy")->valueint;
+
+	// older servers only speak json.
+	cJSON *wire_formats = cJSON_GetObjectItem(json, "wire_formats");
+	msg->wire_formats = cJSON_IsNumber(wire_formats) ? wire_formats->valueint : (1 << MESSAGE_WIRE_JSON);
 }
 
 // LOBBY_CREATE_REQUEST
@@ -263,3 +323,282 @@ void unpack_lobby_list_response(cJSON *json, struct lobby_list_response *msg) {
 	}
 }
 
+// WIRE_FORMAT_REQUEST
+void pack_wire_format_request(struct wire_format_request *msg, cJSON *json) {
+	assert(msg->header.type == WIRE_FORMAT_REQUEST);
+	pack_message_header(&msg->header, json);
+
+	cJSON_AddNumberToObject(json, "wire_format", msg->wire_format);
+}
+
+void unpack_wire_format_request(cJSON *json, struct wire_format_request *msg) {
+	unpack_message_header(json, &msg->header);
+	assert(msg->header.type == WIRE_FORMAT_REQUEST);
+
+	msg->wire_format = cJSON_GetObjectItem(json, "wire_format")->valueint;
+}
+
+//
+// binary encoding
+//
+
+size_t message_binary_size(struct message_header *msg) {
+	assert(msg != NULL);
+	assert(msg->type > MSG_TYPE_UNKNOWN && msg->type < MSG_TYPE_MAX);
+
+	uint8_t len_bytes[5];
+	const size_t payload_len = binary_encode_payload(msg, NULL);
+	return 1 + varint_write(len_bytes, payload_len) + payload_len;
+}
+
+size_t message_binary_encode(struct message_header *msg, uint8_t *out, size_t out_capacity) {
+	assert(msg != NULL);
+	assert(out != NULL);
+
+	const size_t frame_len = message_binary_size(msg);
+	if (frame_len > out_capacity) {
+		return 0;
+	}
+
+	const size_t payload_len = binary_encode_payload(msg, NULL);
+	assert(payload_len <= MESSAGE_BINARY_MAX_PAYLOAD);
+	size_t len = 0;
+	out[len++] = MESSAGE_BINARY_MAGIC;
+	len += varint_write(&out[len], payload_len);
+	len += binary_encode_payload(msg, &out[len]);
+	assert(len == frame_len);
+	return len;
+}
+
+enum message_decode_result message_binary_decode(const uint8_t *data, size_t data_len, size_t *frame_len, message_buffer_t *buffer, struct message_header **msg) {
+	assert(data != NULL || data_len == 0);
+	assert(frame_len != NULL);
+	assert(buffer != NULL);
+	assert(msg != NULL);
+
+	// frame
+	const uint8_t *at = data, *end = data + data_len;
+	if (at == end) return MESSAGE_DECODE_INCOMPLETE;
+	if (*at++ != MESSAGE_BINARY_MAGIC) return MESSAGE_DECODE_INVALID;
+
+	uint32_t payload_len;
+	const int len_result = varint_read(&at, end, &payload_len);
+	if (len_result != MESSAGE_DECODE_OK) return len_result;
+	if (payload_len > MESSAGE_BINARY_MAX_PAYLOAD) return MESSAGE_DECODE_INVALID;
+	if ((size_t)(end - at) < payload_len) return MESSAGE_DECODE_INCOMPLETE;
+	end = at + payload_len;
+
+	// payload, anything unexpected makes the whole frame invalid.
+	uint32_t type;
+	if (varint_read(&at, end, &type) != MESSAGE_DECODE_OK) return MESSAGE_DECODE_INVALID;
+	if (type == MSG_TYPE_UNKNOWN || type >= MSG_TYPE_MAX) return MESSAGE_DECODE_INVALID;
+	const message_function_info_t *info = &message_function_infos[type];
+	if (info->struct_size == 0) return MESSAGE_DECODE_INVALID;
+	assert(info->struct_size <= sizeof(buffer->bytes));
+
+	memset(buffer->bytes, 0, info->struct_size);
+	unsigned char *base = buffer->bytes;
+	size_t strings_len = info->struct_size;
+	((struct message_header *)base)->type = type;
+
+	for (size_t i = 0; i < info->fields_len; ++i) {
+		const struct message_field *field = &info->fields[i];
+		uint32_t value;
+		if (varint_read(&at, end, &value) != MESSAGE_DECODE_OK) return MESSAGE_DECODE_INVALID;
+
+		switch (field->type) {
+		case MESSAGE_FIELD_INT: {
+			const int decoded = (int)((value >> 1) ^ -(int32_t)(value & 1));
+			memcpy(base + field->offset, &decoded, sizeof(decoded));
+			break;
+		}
+		case MESSAGE_FIELD_STRING: {
+			char *string = NULL;
+			if (value > 0) {
+				const size_t string_len = value - 1;
+				if ((size_t)(end - at) < string_len) return MESSAGE_DECODE_INVALID;
+				if (strings_len + string_len + 1 > sizeof(buffer->bytes)) return MESSAGE_DECODE_INVALID;
+				string = (char *)base + strings_len;
+				memcpy(string, at, string_len);
+				string[string_len] = '\0';
+				strings_len += string_len + 1;
+				at += string_len;
+			}
+			memcpy(base + field->offset, &string, sizeof(string));
+			break;
+		}
+		case MESSAGE_FIELD_INT_ARRAY: {
+			if (value > (uint32_t)field->capacity) return MESSAGE_DECODE_INVALID;
+			const int count = (int)value;
+			memcpy(base + field->count_offset, &count, sizeof(count));
+			for (int j = 0; j < count; ++j) {
+				uint32_t item;
+				if (varint_read(&at, end, &item) != MESSAGE_DECODE_OK) return MESSAGE_DECODE_INVALID;
+				const int decoded = (int)((item >> 1) ^ -(int32_t)(item & 1));
+				memcpy(base + field->offset + j * sizeof(int), &decoded, sizeof(decoded));
+			}
+			break;
+		}
+		}
+	}
+	if (at != end) return MESSAGE_DECODE_INVALID;
+
+	*frame_len = (size_t)(end - data);
+	*msg = (struct message_header *)base;
+	return MESSAGE_DECODE_OK;
+}
+
+enum message_decode_result message_frame_length(const uint8_t *data, size_t data_len, size_t *frame_len) {
+	struct message_frame_scan scan = { 0 };
+	return message_frame_length_resume(data, data_len, &scan, frame_len);
+}
+
+enum message_decode_result message_frame_length_resume(const uint8_t *data, size_t data_len, struct message_frame_scan *scan, size_t *frame_len) {
+	assert(data != NULL || data_len == 0);
+	assert(scan != NULL);
+	assert(scan->scanned <= data_len);
+	assert(frame_len != NULL);
+	if (data_len == 0) return MESSAGE_DECODE_INCOMPLETE;
+
+	// binary frames carry their length.
+	if (data[0] == MESSAGE_BINARY_MAGIC) {
+		const uint8_t *at = data + 1, *end = data + data_len;
+		uint32_t payload_len;
+		const int len_result = varint_read(&at, end, &payload_len);
+		if (len_result != MESSAGE_DECODE_OK) return len_result;
+		if (payload_len > MESSAGE_BINARY_MAX_PAYLOAD) return MESSAGE_DECODE_INVALID;
+		const size_t len = (size_t)(at - data) + payload_len;
+		if (len > data_len) return MESSAGE_DECODE_INCOMPLETE;
+		*frame_len = len;
+		return MESSAGE_DECODE_OK;
+	}
+
+	// json objects end at their closing brace.
+	if (data[0] != '{') return MESSAGE_DECODE_INVALID;
+	const size_t scan_len = (data_len < MESSAGE_MAX_FRAME_LEN) ? data_len : MESSAGE_MAX_FRAME_LEN;
+	for (; scan->scanned < scan_len; ++scan->scanned) {
+		const uint8_t c = data[scan->scanned];
+		if (scan->is_string) {
+			if (scan->is_escaped) scan->is_escaped = 0;
+			else if (c == '\\') scan->is_escaped = 1;
+			else if (c == '"') scan->is_string = 0;
+		} else if (c == '"') {
+			scan->is_string = 1;
+		} else if (c == '{') {
+			++scan->depth;
+		} else if (c == '}' && --scan->depth == 0) {
+			*frame_len = scan->scanned + 1;
+			return MESSAGE_DECODE_OK;
+		}
+	}
+	return (data_len >= MESSAGE_MAX_FRAME_LEN) ? MESSAGE_DECODE_INVALID : MESSAGE_DECODE_INCOMPLETE;
+}
+
+static int json_has_fields(cJSON *json, const message_function_info_t *info) {
+	for (size_t i = 0; i < info->fields_len; ++i) {
+		const struct message_field *field = &info->fields[i];
+		cJSON *item = cJSON_GetObjectItem(json, field->name);
+		if (item == NULL && field->is_optional) {
+			continue;
+		}
+
+		switch (field->type) {
+		case MESSAGE_FIELD_INT:
+			if (!cJSON_IsNumber(item)) return 0;
+			break;
+		case MESSAGE_FIELD_STRING:
+			if (!cJSON_IsString(item)) return 0;
+			break;
+		case MESSAGE_FIELD_INT_ARRAY: {
+			if (!cJSON_IsArray(item) || cJSON_GetArraySize(item) > field->capacity) return 0;
+			cJSON *element;
+			cJSON_ArrayForEach(element, item) {
+				if (!cJSON_IsNumber(element)) return 0;
+			}
+			break;
+		}
+		}
+	}
+	return 1;
+}
+
+// Counts the bytes if `out` is NULL.
+static size_t binary_encode_payload(struct message_header *msg, uint8_t *out) {
+	const message_function_info_t *info = &message_function_infos[msg->type];
+	const unsigned char *base = (const unsigned char *)msg;
+	uint8_t scratch[5];
+	size_t len = 0;
+#define WRITE_VARINT(_value) (len += varint_write(out ? &out[len] : scratch, (_value)))
+#define ZIGZAG(_int) (((uint32_t)(_int) << 1) ^ (uint32_t)((int32_t)(_int) >> 31))
+
+	WRITE_VARINT(msg->type);
+	for (size_t i = 0; i < info->fields_len; ++i) {
+		const struct message_field *field = &info->fields[i];
+		switch (field->type) {
+		case MESSAGE_FIELD_INT: {
+			int value;
+			memcpy(&value, base + field->offset, sizeof(value));
+			WRITE_VARINT(ZIGZAG(value));
+			break;
+		}
+		case MESSAGE_FIELD_STRING: {
+			const char *string;
+			memcpy(&string, base + field->offset, sizeof(string));
+			const size_t string_len = (string != NULL) ? strlen(string) : 0;
+			WRITE_VARINT((string != NULL) ? string_len + 1 : 0);
+			if (string_len > 0 && out != NULL) {
+				memcpy(&out[len], string, string_len);
+			}
+			len += string_len;
+			break;
+		}
+		case MESSAGE_FIELD_INT_ARRAY: {
+			int count;
+			memcpy(&count, base + field->count_offset, sizeof(count));
+			assert(count >= 0 && count <= field->capacity);
+			WRITE_VARINT(count);
+			for (int j = 0; j < count; ++j) {
+				int value;
+				memcpy(&value, base + field->offset + j * sizeof(int), sizeof(value));
+				WRITE_VARINT(ZIGZAG(value));
+			}
+			break;
+		}
+		}
+	}
+
+#undef ZIGZAG
+#undef WRITE_VARINT
+	return len;
+}
+
+// LEB128, at most 5 bytes.
+static size_t varint_write(uint8_t *out, uint32_t value) {
+	size_t len = 0;
+	while (value >= 0x80) {
+		out[len++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	out[len++] = (uint8_t)value;
+	return len;
+}
+
+static int varint_read(const uint8_t **data, const uint8_t *end, uint32_t *value) {
+	uint32_t result = 0;
+	for (int shift = 0; shift < 35; shift += 7) {
+		if (*data == end) {
+			return MESSAGE_DECODE_INCOMPLETE;
+		}
+		const uint8_t byte = *(*data)++;
+		if (shift == 28 && (byte & 0xF0) != 0) {
+			return MESSAGE_DECODE_INVALID;
+		}
+		result |= (uint32_t)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0) {
+			*value = result;
+			return MESSAGE_DECODE_OK;
+		}
+	}
+	return MESSAGE_DECODE_INVALID;
+}
+
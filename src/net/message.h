@@ -13,12 +13,33 @@ enum message_type {
 	LOBBY_CREATE_REQUEST, LOBBY_CREATE_RESPONSE,
 	LOBBY_JOIN_REQUEST,   LOBBY_JOIN_RESPONSE,
 	LOBBY_LIST_REQUEST,   LOBBY_LIST_RESPONSE,
+	// switches the encoding of all following messages from the client.
+	WIRE_FORMAT_REQUEST,
 	// system messages
 	MSG_DISCONNECTED,
 	//
 	MSG_TYPE_MAX,
 };
 
+/** Encodings of messages on the wire.
+ * JSON is understood by every client and easy to debug. The binary
+ * encoding is used once client and server agreed on it, see WELCOME_RESPONSE.
+ */
+enum message_wire_format {
+	MESSAGE_WIRE_JSON,
+	MESSAGE_WIRE_BINARY,
+	MESSAGE_WIRE_FORMAT_MAX,
+};
+
+// Binary frames start with this byte, JSON messages with '{'.
+#define MESSAGE_BINARY_MAGIC 0xFF
+// Largest binary payload, larger frames are invalid.
+#define MESSAGE_BINARY_MAX_PAYLOAD (16 * 1024)
+// Largest decoded message, including copies of its strings.
+#define MESSAGE_BINARY_MAX_DECODED 1024
+// Largest frame in either format, longer JSON objects are invalid.
+#define MESSAGE_MAX_FRAME_LEN (64 * 1024)
+
 struct message_header {
 	enum message_type type;
 };
@@ -26,6 +47,27 @@ struct message_header {
 typedef void (*message_pack_fn)(struct message_header *, cJSON *);
 typedef void (*message_unpack_fn)(cJSON *, struct message_header *);
 
+enum message_field_type {
+	MESSAGE_FIELD_INT,
+	MESSAGE_FIELD_STRING,
+	MESSAGE_FIELD_INT_ARRAY,
+};
+
+/** Describes one member of a message struct, for the binary encoding and
+ * to validate received JSON before unpacking it.
+ */
+struct message_field {
+	enum message_field_type type;
+	// JSON key, the name of the struct member.
+	const char *name;
+	// may be missing in JSON, e.g. if it was added later.
+	int is_optional;
+	size_t offset;
+	// MESSAGE_FIELD_INT_ARRAY: offset of the `int` holding the element count.
+	size_t count_offset;
+	int capacity;
+};
+
 /** Holds meta information about a message.
  * This way, we can choose at runtime how to (un)pack a message based on its type.
  */
@@ -34,8 +76,24 @@ typedef struct {
 	message_pack_fn   pack_fn;
 	message_unpack_fn unpack_fn;
 	size_t struct_size;
+	const struct message_field *fields;
+	size_t fields_len;
 } message_function_info_t;
 
+/** Storage for a decoded binary message, see message_binary_decode(). */
+typedef union {
+	uint64_t align;
+	void *ptr;
+	unsigned char bytes[MESSAGE_BINARY_MAX_DECODED];
+} message_buffer_t;
+
+enum message_decode_result {
+	MESSAGE_DECODE_OK,
+	// more bytes are needed.
+	MESSAGE_DECODE_INCOMPLETE,
+	MESSAGE_DECODE_INVALID,
+};
+
 extern const message_function_info_t message_function_infos[MSG_TYPE_MAX];
 
 const char *message_type_to_name(enum message_type type);
@@ -71,36 +129,116 @@ struct message_header *unpack_message(cJSON *json);
 cJSON *pack_message(struct message_header *msg);
 void free_message(cJSON *json, struct message_header *);
 
+/**
+ * Binary encoding: MESSAGE_BINARY_MAGIC, the payload length as varint and
+ * the payload. The payload is the message type followed by the fields in
+ * declaration order. Integers are zigzag varints, strings and arrays are
+ * prefixed by their varint length, strings by length + 1 so NULL is 0.
+ */
+size_t message_binary_size(struct message_header *msg);
+/**
+ * Writes the frame for `msg` to `out`.
+ * @returns The number of bytes written, 0 if `out_capacity` is too small.
+ */
+size_t message_binary_encode(struct message_header *msg, uint8_t *out, size_t out_capacity);
+/**
+ * Decodes the frame at the start of `data` into `buffer`, strings are
+ * copied behind the message struct. Nothing is allocated.
+ *
+ *     message_buffer_t buffer;
+ *     struct message_header *msg = NULL;
+ *     size_t frame_len;
+ *     if (message_binary_decode(data, data_len, &frame_len, &buffer, &msg) == MESSAGE_DECODE_OK) {
+ *       ...
+ *     }
+ *
+ * @param frame_len Receives the number of bytes of the frame on success.
+ */
+enum message_decode_result message_binary_decode(const uint8_t *data, size_t data_len, size_t *frame_len, message_buffer_t *buffer, struct message_header **msg);
+
+/**
+ * Length of the binary frame or JSON object at the start of `data`,
+ * without decoding it. JSON is split at the closing brace of the outermost
+ * object, braces inside strings are skipped.
+ *
+ * @param frame_len Receives the number of bytes of the frame on success.
+ */
+enum message_decode_result message_frame_length(const uint8_t *data, size_t data_len, size_t *frame_len);
+
+// How far message_frame_length_resume() got into an incomplete JSON frame.
+// Zero it before the first call and after a frame was taken.
+struct message_frame_scan {
+	size_t scanned;
+	int depth;
+	int is_string;
+	int is_escaped;
+};
+
+// Same as message_frame_length(), but only looks at the bytes past
+// `scan->scanned`, so a frame arriving in pieces is scanned once.
+enum message_decode_result message_frame_length_resume(const uint8_t *data, size_t data_len, struct message_frame_scan *scan, size_t *frame_len);
+
+/**
+ * The fields of a message are listed once, as `F(_name, kind, member...)`
+ * in wire order. The list declares the struct members below, and builds
+ * the binary field table in message.c.
+ *
+ *     INT, INT_OPTIONAL  `int member`
+ *     STRING             `char *member`
+ *     INT_ARRAY, n       `int member_len` and `int member[n]`
+ */
+#define MESSAGE_MEMBER_INT(_member)                  int _member;
+#define MESSAGE_MEMBER_INT_OPTIONAL(_member)         int _member;
+#define MESSAGE_MEMBER_STRING(_member)               char *_member;
+#define MESSAGE_MEMBER_INT_ARRAY(_member, _capacity) int _member##_len; int _member[_capacity];
+#define MESSAGE_MEMBER(_name, _kind, ...) MESSAGE_MEMBER_##_kind(__VA_ARGS__)
+
 #define MESSAGE_DECLARATION(_type, _name, _fields) \
 	struct _name {                                 \
 		struct message_header header;              \
-		_fields;                                   \
+		_fields(MESSAGE_MEMBER, _name)             \
 	};                                             \
 	void _name##_init   (struct _name *s);         \
 	void _name##_destroy(struct _name *);          \
 	void pack_##_name   (struct _name *, cJSON *); \
 	void unpack_##_name (cJSON *, struct _name *)
 
-MESSAGE_DECLARATION(WELCOME_RESPONSE, welcome_response,
-	int _dummy);
-
-MESSAGE_DECLARATION(LOBBY_CREATE_REQUEST, lobby_create_request,
-	int lobby_id; char *lobby_name);
-
-MESSAGE_DECLARATION(LOBBY_CREATE_RESPONSE, lobby_create_response,
-	int lobby_id; int create_error);
-
-MESSAGE_DECLARATION(LOBBY_JOIN_REQUEST, lobby_join_request,
-	int lobby_id);
-
-MESSAGE_DECLARATION(LOBBY_JOIN_RESPONSE, lobby_join_response,
-	int lobby_id; int join_error; int is_other_user);
-
-MESSAGE_DECLARATION(LOBBY_LIST_REQUEST, lobby_list_request,
-	void);
-
-MESSAGE_DECLARATION(LOBBY_LIST_RESPONSE, lobby_list_response,
-	int ids_of_lobbies_len; int ids_of_lobbies[8]);
+// wire_formats: bitmask of the `message_wire_format`s the server understands.
+#define WELCOME_RESPONSE_FIELDS(F, _name) \
+	F(_name, INT, _dummy)                 \
+	F(_name, INT_OPTIONAL, wire_formats)
+MESSAGE_DECLARATION(WELCOME_RESPONSE, welcome_response, WELCOME_RESPONSE_FIELDS);
+
+#define LOBBY_CREATE_REQUEST_FIELDS(F, _name) \
+	F(_name, INT, lobby_id)                   \
+	F(_name, STRING, lobby_name)
+MESSAGE_DECLARATION(LOBBY_CREATE_REQUEST, lobby_create_request, LOBBY_CREATE_REQUEST_FIELDS);
+
+#define LOBBY_CREATE_RESPONSE_FIELDS(F, _name) \
+	F(_name, INT, lobby_id)                    \
+	F(_name, INT, create_error)
+MESSAGE_DECLARATION(LOBBY_CREATE_RESPONSE, lobby_create_response, LOBBY_CREATE_RESPONSE_FIELDS);
+
+#define LOBBY_JOIN_REQUEST_FIELDS(F, _name) \
+	F(_name, INT, lobby_id)
+MESSAGE_DECLARATION(LOBBY_JOIN_REQUEST, lobby_join_request, LOBBY_JOIN_REQUEST_FIELDS);
+
+#define LOBBY_JOIN_RESPONSE_FIELDS(F, _name) \
+	F(_name, INT, lobby_id)                  \
+	F(_name, INT, join_error)                \
+	F(_name, INT, is_other_user)
+MESSAGE_DECLARATION(LOBBY_JOIN_RESPONSE, lobby_join_response, LOBBY_JOIN_RESPONSE_FIELDS);
+
+#define LOBBY_LIST_REQUEST_FIELDS(F, _name)
+MESSAGE_DECLARATION(LOBBY_LIST_REQUEST, lobby_list_request, LOBBY_LIST_REQUEST_FIELDS);
+
+#define LOBBY_LIST_RESPONSE_FIELDS(F, _name) \
+	F(_name, INT_ARRAY, ids_of_lobbies, 8)
+MESSAGE_DECLARATION(LOBBY_LIST_RESPONSE, lobby_list_response, LOBBY_LIST_RESPONSE_FIELDS);
+
+#define WIRE_FORMAT_REQUEST_FIELDS(F, _name) \
+	F(_name, INT, wire_format)
+MESSAGE_DECLARATION(WIRE_FORMAT_REQUEST, wire_format_request, WIRE_FORMAT_REQUEST_FIELDS);
 
 #undef MESSAGE_DECLARATION
 
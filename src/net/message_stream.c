@@ -0,0 +1,99 @@
+#include "message_stream.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MESSAGE_STREAM_MIN_CAPACITY 4096
+
+void message_stream_init(struct message_stream *stream) {
+	assert(stream != NULL);
+	memset(stream, 0, sizeof(*stream));
+}
+
+void message_stream_destroy(struct message_stream *stream) {
+	assert(stream != NULL);
+	free(stream->data);
+	memset(stream, 0, sizeof(*stream));
+}
+
+void message_stream_clear(struct message_stream *stream) {
+	assert(stream != NULL);
+	stream->head = stream->tail = 0;
+	stream->scan = (struct message_frame_scan){ 0 };
+}
+
+size_t message_stream_pending(const struct message_stream *stream) {
+	assert(stream != NULL);
+	return stream->tail - stream->head;
+}
+
+uint8_t *message_stream_reserve(struct message_stream *stream, size_t min_len, size_t *available) {
+	assert(stream != NULL);
+	assert(available != NULL);
+
+	if (stream->capacity - stream->tail < min_len) {
+		const size_t pending = stream->tail - stream->head;
+		if (pending > 0 && stream->head > 0) {
+			memmove(stream->data, &stream->data[stream->head], pending);
+		}
+		stream->head = 0;
+		stream->tail = pending;
+	}
+
+	if (stream->capacity - stream->tail < min_len) {
+		size_t capacity = (stream->capacity > 0) ? stream->capacity : MESSAGE_STREAM_MIN_CAPACITY;
+		while (capacity - stream->tail < min_len) {
+			capacity *= 2;
+		}
+		stream->data = realloc(stream->data, capacity);
+		assert(stream->data != NULL);
+		stream->capacity = capacity;
+	}
+
+	*available = stream->capacity - stream->tail;
+	return &stream->data[stream->tail];
+}
+
+void message_stream_commit(struct message_stream *stream, size_t written) {
+	assert(stream != NULL);
+	assert(written <= stream->capacity - stream->tail);
+	stream->tail += written;
+}
+
+void message_stream_append(struct message_stream *stream, const void *data, size_t data_len) {
+	assert(stream != NULL);
+	assert(data != NULL || data_len == 0);
+
+	size_t available;
+	uint8_t *into = message_stream_reserve(stream, data_len, &available);
+	memcpy(into, data, data_len);
+	message_stream_commit(stream, data_len);
+}
+
+enum message_decode_result message_stream_next(struct message_stream *stream, const uint8_t **frame, size_t *frame_len) {
+	assert(stream != NULL);
+	assert(frame != NULL);
+	assert(frame_len != NULL);
+
+	while (stream->head < stream->tail) {
+		const uint8_t c = stream->data[stream->head];
+		if (c != ' ' && c != '\n' && c != '\r' && c != '\t') break;
+		++stream->head;
+	}
+	if (stream->head == stream->tail) {
+		// everything was read, the next bytes go to the front again.
+		stream->head = stream->tail = 0;
+		return MESSAGE_DECODE_INCOMPLETE;
+	}
+
+	const enum message_decode_result result = message_frame_length_resume(&stream->data[stream->head], stream->tail - stream->head, &stream->scan, frame_len);
+	if (result != MESSAGE_DECODE_OK) {
+		return result;
+	}
+
+	*frame = &stream->data[stream->head];
+	stream->head += *frame_len;
+	stream->scan = (struct message_frame_scan){ 0 };
+	return MESSAGE_DECODE_OK;
+}
@@ -0,0 +1,63 @@
+#ifndef MESSAGE_STREAM_H
+#define MESSAGE_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "net/message.h"
+
+/** Reassembles messages from a byte stream.
+ * Reads may split a message or contain several of them. Received bytes are
+ * appended with message_stream_reserve() and message_stream_commit(),
+ * complete frames are taken out with message_stream_next(). Partial frames
+ * stay until the rest of them arrives.
+ *
+ *     size_t available;
+ *     uint8_t *into = message_stream_reserve(&stream, 4096, &available);
+ *     message_stream_commit(&stream, recv(fd, into, available, 0));
+ *
+ *     const uint8_t *frame;
+ *     size_t frame_len;
+ *     while (message_stream_next(&stream, &frame, &frame_len) == MESSAGE_DECODE_OK) {
+ *       ...
+ *     }
+ */
+struct message_stream {
+	uint8_t *data;
+	size_t capacity;
+	// unread bytes are data[head, tail).
+	size_t head;
+	size_t tail;
+	// progress on the frame at `head`, so appends are not scanned twice.
+	struct message_frame_scan scan;
+};
+
+void message_stream_init   (struct message_stream *);
+void message_stream_destroy(struct message_stream *);
+// drops all unread bytes, e.g. after reconnecting.
+void message_stream_clear  (struct message_stream *);
+
+size_t message_stream_pending(const struct message_stream *);
+
+/**
+ * Makes room for at least `min_len` bytes behind the unread ones. Unread
+ * bytes are moved to the front first, the buffer only grows if that is not
+ * enough.
+ *
+ * @param available Receives how many bytes can be written.
+ * @returns Where to write the received bytes.
+ */
+uint8_t *message_stream_reserve(struct message_stream *, size_t min_len, size_t *available);
+void     message_stream_commit (struct message_stream *, size_t written);
+void     message_stream_append (struct message_stream *, const void *data, size_t data_len);
+
+/**
+ * Takes the next complete frame out of the stream, whitespace between
+ * frames is skipped. The frame stays valid until the next reserve or
+ * append.
+ *
+ * @returns MESSAGE_DECODE_INCOMPLETE until a whole frame was received,
+ *          MESSAGE_DECODE_INVALID if the stream can not be read any further.
+ */
+enum message_decode_result message_stream_next(struct message_stream *, const uint8_t **frame, size_t *frame_len);
+
+#endif
@@ -0,0 +1,310 @@
+#include "net/net_thread.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NET_THREAD_COMMANDS_CAPACITY 256
+#define NET_THREAD_EVENTS_CAPACITY 1024
+// how long to wait for data before looking at new commands.
+#define NET_THREAD_POLL_MS 4
+#define NET_THREAD_RECEIVE_CHUNK 4096
+// stop reading from the socket once this much is buffered.
+#define NET_THREAD_MAX_PENDING (256 * 1024)
+
+enum net_command_type {
+	NET_COMMAND_CONNECT,
+	NET_COMMAND_SEND,
+};
+
+struct net_command {
+	enum net_command_type type;
+	int connection_id;
+	uint16_t port;
+	// NET_COMMAND_CONNECT: the address, NET_COMMAND_SEND: the encoded message.
+	size_t data_len;
+	uint8_t data[];
+};
+
+//
+// private api
+//
+
+static int  net_thread_run     (void *);
+static int  net_thread_command (struct net_thread *, struct net_command *);
+static void net_thread_receive (struct net_thread *);
+static void net_thread_close   (struct net_thread *, int notify);
+static void net_thread_emit    (struct net_thread *, struct net_event *);
+static int  net_thread_push_command(struct net_thread *, enum net_command_type, int connection_id, uint16_t port, const void *data, size_t data_len);
+
+//
+// api
+//
+
+int net_thread_start(struct net_thread *net) {
+	assert(net != NULL);
+
+	*net = (struct net_thread){ 0 };
+	SDL_AtomicSet(&net->quit, 0);
+	SDL_AtomicSet(&net->close_connection_id, 0);
+	net->wake = SDL_CreateSemaphore(0);
+	assert(net->wake != NULL);
+	spsc_queue_init(&net->commands, NET_THREAD_COMMANDS_CAPACITY);
+	spsc_queue_init(&net->events, NET_THREAD_EVENTS_CAPACITY);
+	message_stream_init(&net->stream);
+
+	net->thread = SDL_CreateThread(net_thread_run, "net", net);
+	if (net->thread == NULL) {
+		SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Could not start network thread: %s", SDL_GetError());
+		net_thread_stop(net);
+		return 0;
+	}
+	return 1;
+}
+
+void net_thread_stop(struct net_thread *net) {
+	assert(net != NULL);
+
+	if (net->thread != NULL) {
+		SDL_AtomicSet(&net->quit, 1);
+		SDL_SemPost(net->wake);
+		SDL_WaitThread(net->thread, NULL);
+	}
+	net_thread_close(net, 0);
+
+	void *item;
+	while ((item = spsc_queue_pop(&net->commands)) != NULL) {
+		free(item);
+	}
+	while ((item = spsc_queue_pop(&net->events)) != NULL) {
+		net_event_free(item);
+	}
+	spsc_queue_destroy(&net->commands);
+	spsc_queue_destroy(&net->events);
+	message_stream_destroy(&net->stream);
+	SDL_DestroySemaphore(net->wake);
+	*net = (struct net_thread){ 0 };
+}
+
+int net_thread_connect(struct net_thread *net, int connection_id, const char *address, uint16_t port) {
+	assert(net != NULL);
+	assert(address != NULL);
+
+	return net_thread_push_command(net, NET_COMMAND_CONNECT, connection_id, port, address, strlen(address) + 1);
+}
+
+// Not a command, so it never waits for room in a full queue. Connection
+// ids only grow, a newer connect is not affected.
+void net_thread_disconnect(struct net_thread *net, int connection_id) {
+	assert(net != NULL);
+	SDL_AtomicSet(&net->close_connection_id, connection_id);
+}
+
+// Dropped if the connection is not open by the time it is picked up.
+int net_thread_send(struct net_thread *net, const void *data, size_t data_len) {
+	assert(net != NULL);
+	assert(data != NULL);
+	assert(data_len > 0);
+	return net_thread_push_command(net, NET_COMMAND_SEND, 0, 0, data, data_len);
+}
+
+struct net_event *net_thread_poll(struct net_thread *net) {
+	assert(net != NULL);
+	return spsc_queue_pop(&net->events);
+}
+
+void net_event_free(struct net_event *event) {
+	assert(event != NULL);
+	if (event->json != NULL) {
+		free_message(event->json, event->message);
+	}
+	free(event);
+}
+
+//
+// private impls
+//
+
+static int net_thread_push_command(struct net_thread *net, enum net_command_type type, int connection_id, uint16_t port, const void *data, size_t data_len) {
+	struct net_command *command = malloc(sizeof(*command) + data_len);
+	command->type = type;
+	command->connection_id = connection_id;
+	command->port = port;
+	command->data_len = data_len;
+	if (data_len > 0) {
+		memcpy(command->data, data, data_len);
+	}
+
+	if (!spsc_queue_push(&net->commands, command)) {
+		free(command);
+		return 0;
+	}
+	// the count is not needed, one pending wake up is enough.
+	if (SDL_SemValue(net->wake) == 0) {
+		SDL_SemPost(net->wake);
+	}
+	return 1;
+}
+
+static int net_thread_run(void *userdata) {
+	struct net_thread *net = userdata;
+
+	while (!SDL_AtomicGet(&net->quit)) {
+		// the main thread already knows.
+		if (net->tcp != NULL && SDL_AtomicGet(&net->close_connection_id) == net->connection_id) {
+			net_thread_close(net, 0);
+		}
+
+		struct net_command *command;
+		while ((command = spsc_queue_pop(&net->commands)) != NULL) {
+			net_thread_command(net, command);
+			free(command);
+		}
+
+		// nothing to do until the next connect.
+		if (net->tcp == NULL) {
+			SDL_SemWait(net->wake);
+			continue;
+		}
+
+		net_thread_receive(net);
+	}
+
+	return 0;
+}
+
+static int net_thread_command(struct net_thread *net, struct net_command *command) {
+	switch (command->type) {
+	case NET_COMMAND_CONNECT: {
+		net_thread_close(net, 0);
+		net->connection_id = command->connection_id;
+
+		IPaddress ip;
+		const char *address = (const char *)command->data;
+		if (SDLNet_ResolveHost(&ip, address, command->port) < 0) {
+			fprintf(stderr, "Could not resolve host: \"%s\"...\n", address);
+			net_thread_emit(net, &(struct net_event){ .type = NET_EVENT_DISCONNECTED });
+			return 0;
+		}
+
+		net->tcp = SDLNet_TCP_Open(&ip);
+		if (net->tcp == NULL) {
+			fprintf(stderr, "Failed connecting to gameserver...\n");
+			net_thread_emit(net, &(struct net_event){ .type = NET_EVENT_DISCONNECTED });
+			return 0;
+		}
+
+		net->socketset = SDLNet_AllocSocketSet(1);
+		SDLNet_TCP_AddSocket(net->socketset, net->tcp);
+		net_thread_emit(net, &(struct net_event){ .type = NET_EVENT_CONNECTED });
+		return 1;
+	}
+	case NET_COMMAND_SEND:
+		if (net->tcp == NULL) {
+			return 0;
+		}
+		if (SDLNet_TCP_Send(net->tcp, command->data, command->data_len) != (int)command->data_len) {
+			fprintf(stderr, "Could not send %zu bytes, that means we disconnect...\n", command->data_len);
+			net_thread_close(net, 1);
+			return 0;
+		}
+		return 1;
+	}
+
+	return 0;
+}
+
+static void net_thread_receive(struct net_thread *net) {
+	const int can_read = (message_stream_pending(&net->stream) < NET_THREAD_MAX_PENDING);
+	const int can_emit = !spsc_queue_is_full(&net->events);
+	// the main thread does not keep up, wait for it instead of spinning.
+	if (!can_read || !can_emit) {
+		SDL_Delay(1);
+	}
+
+	// wait for data, but look at new commands regularly.
+	if (can_read && SDLNet_CheckSockets(net->socketset, NET_THREAD_POLL_MS) > 0) {
+		size_t available;
+		uint8_t *into = message_stream_reserve(&net->stream, NET_THREAD_RECEIVE_CHUNK, &available);
+		const int received = SDLNet_TCP_Recv(net->tcp, into, (int)available);
+		if (received <= 0) {
+			printf("TCP_Recv failure, got 0 bytes...\n");
+			net_thread_close(net, 1);
+			return;
+		}
+		message_stream_commit(&net->stream, (size_t)received);
+	}
+
+	// decode every complete message, a partial one waits for the next read.
+	while (!spsc_queue_is_full(&net->events)) {
+		const uint8_t *frame;
+		size_t frame_len;
+		const enum message_decode_result result = message_stream_next(&net->stream, &frame, &frame_len);
+		if (result == MESSAGE_DECODE_INCOMPLETE) {
+			break;
+		}
+		if (result == MESSAGE_DECODE_INVALID) {
+			fprintf(stderr, "Received a malformed or oversized message, disconnecting...\n");
+			net_thread_close(net, 1);
+			break;
+		}
+
+		struct net_event *event = malloc(sizeof(*event));
+		event->type = NET_EVENT_MESSAGE;
+		event->connection_id = net->connection_id;
+		event->message = NULL;
+		event->json = NULL;
+		if (frame[0] == MESSAGE_BINARY_MAGIC) {
+			size_t decoded_len;
+			message_binary_decode(frame, frame_len, &decoded_len, &event->buffer, &event->message);
+		} else {
+			event->json = cJSON_ParseWithLength((const char *)frame, frame_len);
+			event->message = unpack_message(event->json);
+			if (event->message == NULL) {
+				cJSON_Delete(event->json);
+				event->json = NULL;
+			}
+		}
+
+		// not a valid message, but the stream is fine.
+		if (event->message == NULL) {
+			free(event);
+			continue;
+		}
+		spsc_queue_push(&net->events, event);
+	}
+}
+
+// Closes the socket, and tells the main thread if it does not know yet.
+static void net_thread_close(struct net_thread *net, int notify) {
+	if (net->tcp != NULL) {
+		SDLNet_TCP_DelSocket(net->socketset, net->tcp);
+		SDLNet_FreeSocketSet(net->socketset);
+		net->socketset = NULL;
+		SDLNet_TCP_Close(net->tcp);
+		net->tcp = NULL;
+	}
+	message_stream_clear(&net->stream);
+
+	if (notify) {
+		net_thread_emit(net, &(struct net_event){ .type = NET_EVENT_DISCONNECTED });
+	}
+}
+
+// Connection events must not get lost, waits for room if necessary.
+static void net_thread_emit(struct net_thread *net, struct net_event *event) {
+	struct net_event *copy = malloc(sizeof(*copy));
+	copy->type = event->type;
+	copy->connection_id = net->connection_id;
+	copy->message = NULL;
+	copy->json = NULL;
+
+	while (!spsc_queue_push(&net->events, copy)) {
+		if (SDL_AtomicGet(&net->quit)) {
+			free(copy);
+			return;
+		}
+		SDL_Delay(1);
+	}
+}
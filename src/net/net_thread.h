@@ -0,0 +1,71 @@
+#ifndef NET_THREAD_H
+#define NET_THREAD_H
+
+#include <SDL.h>
+#include <SDL_net.h>
+#include <cJSON.h>
+#include "net/message.h"
+#include "net/message_stream.h"
+#include "util/spsc_queue.h"
+
+/** Runs the connection to the gameserver on its own thread.
+ * Resolving, connecting, reading, framing and decoding all happen there,
+ * so a slow network never stalls a frame. The main thread hands over
+ * commands and takes decoded messages through two single-producer/
+ * single-consumer queues.
+ *
+ * Every connection gets an id from the main thread, events of a closed
+ * connection can still be in the queue and are told apart by it.
+ */
+
+enum net_event_type {
+	NET_EVENT_CONNECTED,
+	// connecting failed, or the connection broke.
+	NET_EVENT_DISCONNECTED,
+	NET_EVENT_MESSAGE,
+};
+
+struct net_event {
+	enum net_event_type type;
+	int connection_id;
+	// NET_EVENT_MESSAGE: points into `buffer`, or is owned by `json`.
+	struct message_header *message;
+	cJSON *json;
+	message_buffer_t buffer;
+};
+
+struct net_thread {
+	SDL_Thread *thread;
+	SDL_atomic_t quit;
+	// posted for every command, the thread waits on it while it has no
+	// connection.
+	SDL_sem *wake;
+	// the main thread asks to close this connection.
+	SDL_atomic_t close_connection_id;
+	// main thread to network thread
+	struct spsc_queue commands;
+	// network thread to main thread
+	struct spsc_queue events;
+
+	// only used by the network thread.
+	TCPsocket tcp;
+	SDLNet_SocketSet socketset;
+	struct message_stream stream;
+	int connection_id;
+};
+
+// Returns 0 if no thread could be started, e.g. on the web.
+int  net_thread_start(struct net_thread *);
+void net_thread_stop (struct net_thread *);
+
+// Only from the main thread. Return 0 if the command queue is full,
+// disconnecting never blocks.
+int  net_thread_connect   (struct net_thread *, int connection_id, const char *address, uint16_t port);
+void net_thread_disconnect(struct net_thread *, int connection_id);
+int  net_thread_send      (struct net_thread *, const void *data, size_t data_len);
+
+// The next event or NULL, free it with net_event_free().
+struct net_event *net_thread_poll(struct net_thread *);
+void net_event_free(struct net_event *);
+
+#endif
@@ -25,6 +25,7 @@
 #include "gl/particle_system.h"
 #include "game/background.h"
 #include "game/hexmap.h"
+#include "game/hexmap_cache.h"
 #include "game/particle_spawners.h"
 #include "gui/console.h"
 #include "scenes/menu.h"
@@ -32,6 +33,11 @@
 #include "util/util.h"
 #include "util/str.h"
 
+// card and hud text appear at this size, distance field glyphs are
+// rasterized at the larger one.
+#define CARD_FONT_SIZE     9
+#define CARD_FONT_SDF_SIZE 24
+
 //
 // structs & enums
 //
@@ -192,11 +198,13 @@ static ecs_entity_t spawn_random_card(void);
 static int          gamestate_changed(enum gamestate_battle old_state, enum gamestate_battle new_state);
 static void         update_gamestate(enum gamestate_battle state, float dt);
 static void         highlight_reachable_tiles(struct hexcoord origin, usize distance);
+static void         update_enemy_goal_map(void);
 static void         trigger_card_effect(c_card *, enum effect_trigger);
 static void         update_animations(float dt);
 static void         interact_with_camera(void);
 static void         draw_entity_component_tooltip(ecs_entity_t entity, vec3s world_position);
 static void         draw_offscreen_tooltip_ui(const c_offscreen_tooltip *, vec3s world_pos);
+static void         draw_text_pipeline(void);
 
 // systems
 static void system_move_cards               (ecs_iter_t *);
@@ -251,6 +259,8 @@ static float                 g_pickup_next_card;
 static struct camera         g_camera;
 static struct camera         g_portrait_camera;
 static struct hexmap         g_hexmap;
+static struct hexmap_cache   g_hexmap_cache;
+static uint32_t             *g_enemy_goal_map;
 static enum gamestate_battle g_gamestate;
 static enum gamestate_battle g_next_gamestate;
 static struct { float x, y, w, h; } g_button_end_turn;
@@ -321,7 +331,11 @@ static void load(struct scene_battle *battle, struct engine *engine) {
 		assert(load_fun_error == 0);
 	}
 
-	hexmap_init(&g_hexmap, g_engine);
+	int load_hexmap_error = hexmap_init_from_file(&g_hexmap, "res/data/levels/battle.json");
+	assert(load_hexmap_error == 0);
+	hexmap_init_render(&g_hexmap, g_engine);
+	hexmap_cache_init(&g_hexmap_cache, &g_hexmap, 32);
+	g_enemy_goal_map = malloc((usize)g_hexmap.w * g_hexmap.h * sizeof(*g_enemy_goal_map));
 
 	// initialize cameras
 	camera_init_default(&g_camera, engine->window_width, engine->window_height);
@@ -379,7 +393,7 @@ static void load(struct scene_battle *battle, struct engine *engine) {
 		e = ecs_new_id(g_world);
 		ecs_set(g_world, e, c_position, { .x=campfire_pos.x, .y=campfire_pos.y });
 		ecs_set(g_world, e, c_model,    { .model=&g_props_model[3], .scale=10.0f });
-		hexmap_tile_at(&g_hexmap, campfire_pos)->occupied_by = e;
+		hexmap_set_occupied_by(&g_hexmap, campfire_pos, e);
 		// enemy
 		struct hexcoord enemy_pos = { .x=3, .y=3 };
 		e = ecs_new_id(g_world);
@@ -388,7 +402,7 @@ static void load(struct scene_battle *battle, struct engine *engine) {
 		ecs_set(g_world, e, c_health,            { .hp=8, .max_hp=8 });
 		ecs_set(g_world, e, c_npc,               { ._dummy=1 });
 		ecs_set(g_world, e, c_offscreen_tooltip, { .animation=0.0f, .is_on_screen=0, .color=nvgRGB(0xC6, 0x6B, 0x5B) });
-		hexmap_tile_at(&g_hexmap, enemy_pos)->occupied_by = e;
+		hexmap_set_occupied_by(&g_hexmap, enemy_pos, e);
 		g_enemy_skeleton.animation_index = 3;
 		// player
 		struct hexcoord player_pos = { .x=2, .y=5 };
@@ -399,7 +413,7 @@ static void load(struct scene_battle *battle, struct engine *engine) {
 		ecs_set(g_world, g_player, c_offscreen_tooltip, { .animation=0.0f, .is_on_screen=0, .color=nvgRGB(0x5B, 0xB6, 0xC6) });
 		g_portrait_skeleton.animation_index = 72;
 		g_player_skeleton.animation_index = 0;
-		hexmap_tile_at(&g_hexmap, player_pos)->occupied_by = g_player;
+		hexmap_set_occupied_by(&g_hexmap, player_pos, g_player);
 	}
 
 	// Character Shader
@@ -480,10 +494,13 @@ static void load(struct scene_battle *battle, struct engine *engine) {
 	// text rendering
 	{
 		fontatlas_init(&g_card_font, engine);
-		fontatlas_add_face(&g_card_font, "res/font/NotoSans-Regular.ttf",    9);
-		fontatlas_add_face(&g_card_font, "res/font/NotoSans-Bold.ttf",       9);
-		fontatlas_add_face(&g_card_font, "res/font/NotoSans-Italic.ttf",     9);
-		fontatlas_add_face(&g_card_font, "res/font/NotoSans-BoldItalic.ttf", 9);
+		// distance fields are rasterized larger, so zoomed card previews
+		// stay sharp. Written text is scaled down to CARD_FONT_SIZE.
+		const int face_size = fontatlas_set_render_mode(&g_card_font, FONTATLAS_RENDER_SDF) ? CARD_FONT_SDF_SIZE : CARD_FONT_SIZE;
+		fontatlas_add_face(&g_card_font, "res/font/NotoSans-Regular.ttf",    face_size);
+		fontatlas_add_face(&g_card_font, "res/font/NotoSans-Bold.ttf",       face_size);
+		fontatlas_add_face(&g_card_font, "res/font/NotoSans-Italic.ttf",     face_size);
+		fontatlas_add_face(&g_card_font, "res/font/NotoSans-BoldItalic.ttf", face_size);
 		// printable ascii characters
 		fontatlas_add_ascii_glyphs(&g_card_font);
 
@@ -514,6 +531,9 @@ static void destroy(struct scene_battle *battle, struct engine *engine) {
 
 	background_destroy();
 	// TODO: Destroy remaining paths for all entities with a c_move_along_path component.
+	hexmap_cache_destroy(&g_hexmap_cache);
+	free(g_enemy_goal_map);
+	hexmap_destroy_render(&g_hexmap);
 	hexmap_destroy(&g_hexmap);
 	for (usize i = 0; i < g_base_cards_len; ++i) {
 		const c_card card = g_base_cards[i];
@@ -683,6 +703,7 @@ static int gamestate_changed(enum gamestate_battle old_state, enum gamestate_bat
 		case GS_TURN_PLAYER_END:
 			break;
 		case GS_TURN_ENTITY_BEGIN:
+			update_enemy_goal_map();
 			ecs_run(g_world, ecs_id(system_enemy_turn), g_engine->dt, NULL);
 			break;
 		case GS_TURN_ENTITY_IN_PROGRESS:
@@ -736,11 +757,11 @@ static void update_gamestate(enum gamestate_battle state, float dt) {
 			struct hexcoord click_begin_coord = hexmap_world_position_to_coord(&g_hexmap, (vec2s){ .x=p_begin.x, .y=p_begin.z });
 			struct hexcoord click_end_coord = hexmap_world_position_to_coord(&g_hexmap, (vec2s){ .x=p_end.x, .y=p_end.z });
 			if (hexmap_is_valid_coord(&g_hexmap, click_begin_coord) && hexmap_is_valid_coord(&g_hexmap, click_end_coord) && hexcoord_equal(click_begin_coord, click_end_coord)) {
-				ecs_entity_t occupied_by = hexmap_tile_at(&g_hexmap, click_begin_coord)->occupied_by;
+				ecs_entity_t occupied_by = hexmap_occupied_by(&g_hexmap, click_begin_coord);
 				if (occupied_by != 0 && ecs_is_valid(g_world, occupied_by)) {
 					struct hexmap_path path_to_neighbor;
 					enum hexmap_path_result path_found =
-						hexmap_path_find_ex(&g_hexmap, *ecs_get(g_world, g_player, c_position), click_begin_coord, PATH_FLAGS_FIND_NEIGHBOR, &path_to_neighbor);
+						hexmap_cache_path_find(&g_hexmap_cache, *ecs_get(g_world, g_player, c_position), click_begin_coord, PATH_FLAGS_FIND_NEIGHBOR, &path_to_neighbor);
 
 					if (path_found == HEXMAP_PATH_OK) {
 						if (path_to_neighbor.distance_in_tiles == 0) {
@@ -801,9 +822,9 @@ static void update_gamestate(enum gamestate_battle state, float dt) {
 }
 
 static void highlight_reachable_tiles(struct hexcoord origin, usize distance) {
-	// Regenerate flow field
-	usize flowfield[g_hexmap.w * g_hexmap.h];
-	hexmap_generate_flowfield(&g_hexmap, origin, count_of(flowfield), flowfield);
+	// Regenerate flow field, unless the board did not change
+	const usize flowfield_len = (usize)g_hexmap.w * g_hexmap.h;
+	const usize *flowfield = hexmap_cache_flowfield(&g_hexmap_cache, origin);
 	// highlight new movement range
 	hexmap_clear_tile_effect(&g_hexmap, HEXMAP_TILE_EFFECT_MOVEABLE_AREA);
 	if (distance >= 1) {
@@ -811,13 +832,22 @@ static void highlight_reachable_tiles(struct hexcoord origin, usize distance) {
 	}
 	for (usize i = 0; i < (usize)g_hexmap.w * g_hexmap.h; ++i) {
 		struct hexcoord coord = hexmap_index_to_coord(&g_hexmap, i);
-		usize distance_to_reachable = hexmap_flowfield_distance(&g_hexmap, coord, count_of(flowfield), flowfield);
+		usize distance_to_reachable = hexmap_flowfield_distance(&g_hexmap, coord, flowfield_len, flowfield);
 		if (distance_to_reachable >= 1 && distance_to_reachable <= distance) {
 			hexmap_set_tile_effect(&g_hexmap, coord, HEXMAP_TILE_EFFECT_MOVEABLE_AREA);
 		}
 	}
 }
 
+// One dijkstra map towards the player is shared by all enemies this turn.
+static void update_enemy_goal_map(void) {
+	const c_position *player_pos = ecs_get(g_world, g_player, c_position);
+	struct hexmap_dijkstra_source sources[] = {
+		{ .coord = *player_pos, .cost = 0 },
+	};
+	hexmap_generate_dijkstra_map(&g_hexmap, count_of(sources), sources, (usize)g_hexmap.w * g_hexmap.h, g_enemy_goal_map);
+}
+
 static void trigger_card_effect(c_card *card, enum effect_trigger trigger) {
 	switch (trigger) {
 		case TRIGGER_DRAW_CARD:
@@ -958,19 +988,22 @@ static void draw_ui(pipeline_t *pipeline) {
 
 		glm_mat4_identity(model);
 		glm_translate(model, (vec3){12, 90, 0});
+		glm_scale_uni(model, fontatlas_scale(&g_card_font, CARD_FONT_SIZE));
 		pipeline_set_transform(&g_text_pipeline, model);
 		pipeline_reset(&g_text_pipeline);
 		fontatlas_writef_ex(&g_card_font, &g_text_pipeline, 0, 0, "$1Movement: $B%d", g_player_movement_this_turn);
-		pipeline_draw_ortho(&g_text_pipeline, g_engine->window_width, g_engine->window_height);
+		draw_text_pipeline();
 	}
 
 	{ // Debug Text
 		mat4 model = GLM_MAT4_IDENTITY_INIT;
 		glm_translate(model, (vec3){g_debug_rect.x, g_debug_rect.y, 0.0f});
+		const float text_scale = fontatlas_scale(&g_card_font, CARD_FONT_SIZE);
+		glm_scale_uni(model, text_scale);
 		pipeline_set_transform(&g_text_pipeline, model);
 		pipeline_reset(&g_text_pipeline);
-		fontatlas_writef_ex(&g_card_font, &g_text_pipeline, 0, g_debug_rect.w, "$2Number of particles: $1$B%d$0.\nYaay", g_particle_renderer.particles_count);
-		pipeline_draw_ortho(&g_text_pipeline, g_engine->window_width, g_engine->window_height);
+		fontatlas_writef_ex(&g_card_font, &g_text_pipeline, 0, g_debug_rect.w / text_scale, "$2Number of particles: $1$B%d$0.\nYaay", g_particle_renderer.particles_count);
+		draw_text_pipeline();
 
 		float corner_radius = 6.0f;
 		int mx, my;
@@ -1011,6 +1044,12 @@ static void draw_ui(pipeline_t *pipeline) {
 	}
 }
 
+// The uniforms are set on every draw, so they survive a shader reload.
+static void draw_text_pipeline(void) {
+	fontatlas_setup_shader(&g_card_font, &g_text_shader);
+	pipeline_draw_ortho(&g_text_pipeline, g_engine->window_width, g_engine->window_height);
+}
+
 static void draw_hud(pipeline_t *pipeline) {
 	drawcmd_t cmd;
 	// Frame (portrait & healthbar)
@@ -1084,17 +1123,15 @@ static void draw_hud(pipeline_t *pipeline) {
 		NVGcontext *vg = g_engine->vg;
 		usize n_tiles = (usize)g_hexmap.w * g_hexmap.h;
 		for (usize i = 0; i < n_tiles; ++i) {
-			int edges_count = 0;
-			while (g_hexmap.edges[i + n_tiles * edges_count] < n_tiles && edges_count < 6) {
-				++edges_count;
-			}
+			usize neighbors[HEXMAP_MAX_NEIGHBORS];
+			int edges_count = hexmap_neighbors(&g_hexmap, i, neighbors);
 
 			vec2s wp = hexmap_index_to_world_position(&g_hexmap, i);
 			vec3s p = (vec3s){{ wp.x, 0.0f, wp.y }};
 			vec2s screen_pos = world_to_screen_camera(g_engine, &g_camera, GLM_MAT4_IDENTITY, p);
 
 			// movement cost (center)
-			float movecost_pct = g_hexmap.tiles[i].movement_cost < HEXMAP_MOVEMENT_COST_MAX ? 1.0f : 0.0f;
+			float movecost_pct = g_hexmap.movement_cost[i] < HEXMAP_MOVEMENT_COST_MAX ? 1.0f : 0.0f;
 			nvgBeginPath(vg);
 			nvgFillColor(vg, nvgRGBf(1.0f - movecost_pct, movecost_pct, 0.0f));
 			nvgTextAlign(vg, NVG_ALIGN_CENTER | NVG_ALIGN_MIDDLE);
@@ -1104,7 +1141,7 @@ static void draw_hud(pipeline_t *pipeline) {
 				nvgFillColor(vg, nvgRGB(255, 0, 0));
 				sprintf(movecost_text, "#");
 			} else {
-				sprintf(movecost_text, "%d", g_hexmap.tiles[i].movement_cost);
+				sprintf(movecost_text, "%d", g_hexmap.movement_cost[i]);
 			}
 			nvgText(vg, screen_pos.x, screen_pos.y, movecost_text, NULL);
 
@@ -1129,6 +1166,15 @@ static void draw_hud(pipeline_t *pipeline) {
 			nvgStrokeWidth(vg, 3.0f);
 			nvgStrokeColor(vg, nvgRGB(128, 0, 128));
 		}
+
+		// path cache statistics
+		char cache_text[96];
+		sprintf(cache_text, "path cache: %.0f%% hits, %lu repairs (%lu lookups)", hexmap_cache_hit_rate(&g_hexmap_cache) * 100.0f, g_hexmap_cache.repairs, g_hexmap_cache.hits + g_hexmap_cache.repairs + g_hexmap_cache.misses);
+		nvgBeginPath(vg);
+		nvgFontSize(vg, 14.0f);
+		nvgTextAlign(vg, NVG_ALIGN_LEFT | NVG_ALIGN_TOP);
+		nvgFillColor(vg, nvgRGBf(1, 1, 1));
+		nvgText(vg, 10.0f, 10.0f, cache_text, NULL);
 	}
 }
 
@@ -1141,10 +1187,10 @@ static void on_game_event(struct game_event event) {
 	case EVENT_MOVE_ENTITY: {
 		const c_position start = *ecs_get(g_world, event.move_entity.entity, c_position);
 		struct hexmap_path path;
-		if (HEXMAP_PATH_OK == hexmap_path_find(&g_hexmap, start, event.move_entity.goal, &path)) {
+		if (HEXMAP_PATH_OK == hexmap_cache_path_find(&g_hexmap_cache, start, event.move_entity.goal, PATH_FLAGS_NONE, &path)) {
 			if (path.distance_in_tiles >= 1 && path.distance_in_tiles <= g_player_movement_this_turn) {
-				hexmap_tile_at(&g_hexmap, event.move_entity.goal)->occupied_by = g_player;
-				hexmap_tile_at(&g_hexmap, start)->occupied_by = 0;
+				hexmap_set_occupied_by(&g_hexmap, event.move_entity.goal, g_player);
+				hexmap_set_occupied_by(&g_hexmap, start, 0);
 				g_player_movement_this_turn -= path.distance_in_tiles;
 				highlight_reachable_tiles(event.move_entity.goal, g_player_movement_this_turn);
 
@@ -1504,16 +1550,18 @@ static void system_draw_cards(ecs_iter_t *it) {
 			},
 			cmd_card.angle, (vec3){0.0f, 0.0f, 1.0f}
 		);
-		// Card Title
+		// Card Title, grows with the card
+		const float text_scale = fontatlas_scale(&g_card_font, CARD_FONT_SIZE) * extra_scale;
 		glm_translate(model, (vec3){5, 64 * extra_scale, 0});
+		glm_scale_uni(model, text_scale);
 		pipeline_set_transform(&g_text_pipeline, model);
 		pipeline_reset(&g_text_pipeline);
 		fontatlas_writef_ex(&g_card_font, &g_text_pipeline, 0, 0, "$B%s$0", cards[i].name);
-		pipeline_draw_ortho(&g_text_pipeline, g_engine->window_width, g_engine->window_height);
+		draw_text_pipeline();
 		// Card Description
 		pipeline_reset(&g_text_pipeline);
-		fontatlas_writef_ex(&g_card_font, &g_text_pipeline, 0, cmd_card.size.x - 10.0f, "\n%s", cards[i].description);
-		pipeline_draw_ortho(&g_text_pipeline, g_engine->window_width, g_engine->window_height);
+		fontatlas_writef_ex(&g_card_font, &g_text_pipeline, 0, (cmd_card.size.x - 10.0f) / text_scale, "\n%s", cards[i].description);
+		draw_text_pipeline();
 	}
 }
 
@@ -1608,30 +1656,16 @@ static void system_enemy_turn(ecs_iter_t *it) {
 		c_position *pos = &it_position[i];
 		c_npc npc = it_npc[i];
 
-		// Move to a random neighbor
-		struct hexcoord random_neighbor;
-		uint iterations = HEXMAP_MAX_NEIGHBORS;
-		int start = rng_i() % (HEXMAP_N_LAST - HEXMAP_N_FIRST + 1);
-		do {
-			random_neighbor = hexmap_get_neighbor_coord(&g_hexmap, *pos, (start + iterations) % (HEXMAP_N_LAST + 1));
-			if (iterations - 1 == 0) {
-				console_log_ex(g_engine, CONSOLE_MSG_ERROR, 2.0f, "Enemy has 0 valid neighbors?!");
-			}
-		} while (iterations-- > 0 && (!hexmap_is_valid_coord(&g_hexmap, random_neighbor) || hexmap_is_tile_obstacle(&g_hexmap, random_neighbor)));
-
-		if (hexmap_is_valid_coord(&g_hexmap, random_neighbor) && !hexmap_is_tile_obstacle(&g_hexmap, random_neighbor)) {
-			struct hexmap_path path;
-			enum hexmap_path_result result = hexmap_path_find(&g_hexmap, *pos, random_neighbor, &path);
-			assert(result == HEXMAP_PATH_OK);
+		// Walk towards the player
+		struct hexmap_path path;
+		if (HEXMAP_PATH_OK == hexmap_dijkstra_map_path(&g_hexmap, g_enemy_goal_map, *pos, 2, &path)) {
 			ecs_set(g_world, e, c_tile_offset, { .x=0.0f, .y=0.0f, .z=0.0f });
 			ecs_set(g_world, e, c_move_along_path, { .path=path, .current_tile=0, .duration_per_tile=0.5f, .percentage_to_next_tile=0.0f });
 
-			hexmap_tile_at(&g_hexmap, random_neighbor)->occupied_by = e;
-			hexmap_tile_at(&g_hexmap, *pos)->occupied_by = 0;
-			hexmap_set_tile_effect(&g_hexmap, random_neighbor, HEXMAP_TILE_EFFECT_ATTACKABLE);
+			hexmap_set_occupied_by(&g_hexmap, path.goal, e);
+			hexmap_set_occupied_by(&g_hexmap, *pos, 0);
+			hexmap_set_tile_effect(&g_hexmap, path.goal, HEXMAP_TILE_EFFECT_ATTACKABLE);
 			hexmap_set_tile_effect(&g_hexmap, *pos, HEXMAP_TILE_EFFECT_NONE);
-		} else {
-			console_log_ex(g_engine, CONSOLE_MSG_ERROR, 2.0f, "Did not move?");
 		}
 	}
 }
@@ -1,12 +1,17 @@
 #include "game.h"
 #include <stdlib.h>
 #include <SDL.h>
+#include <cglm/cglm.h>
 #include <stb_ds.h>
+#include "engine.h"
 #include "scenes/scene.h"
 #include "game/terrain.h"
 
 static void game_load(struct scene_game_s *game, struct engine *engine) {
 	terrain_init(&game->terrain, 25, 45);
+#ifdef DEBUG
+	game->terrain.debug_draw_density = 1;
+#endif
 }
 
 static void game_destroy(struct scene_game_s *game, struct engine *engine) {
@@ -31,14 +36,14 @@ static void game_update(struct scene_game_s *game, struct engine *engine, float
 			*density = *density + 5;
 		}
 
-		stbds_arrfree(game->terrain.polygon_edges);
-		game->terrain.polygon_edges = NULL;
 		terrain_polygonize(&game->terrain);
 	}
 
 }
 
 static void game_draw(struct scene_game_s *game, struct engine *engine) {
+	// other scenes leave their camera in u_view.
+	glm_mat4_identity(engine->u_view);
 	terrain_draw(&game->terrain, engine);
 }
 
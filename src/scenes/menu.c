@@ -528,6 +528,7 @@ static void on_message(struct scene_menu *menu, struct engine *engine, struct me
 		case LOBBY_CREATE_REQUEST:
 		case LOBBY_JOIN_REQUEST:
 		case LOBBY_LIST_REQUEST:
+		case WIRE_FORMAT_REQUEST:
 			fprintf(stderr, "Can't handle message %s...\n", message_type_to_name(msg->type));
 			break;
 	}
@@ -656,7 +657,7 @@ static void on_begin_search_friends(struct engine *engine) {
 	g_search_friends_text = g_search_friends_texts[1];
 
 	// TODO: remove
-	if (engine->gameserver_tcp == NULL) {
+	if (!engine_gameserver_is_connected(engine)) {
 		// TODO: When deployed connect to "gameserver.xn--schl-noa.com". Maybe different URL depending on native/WASM/...?
 		if (engine_gameserver_connect(engine, "localhost") == 0) {
 			console_log_ex(engine, CONSOLE_MSG_SUCCESS, 4.0f, "Connected to server");
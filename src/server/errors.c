@@ -10,6 +10,8 @@ const char *server_error_description(enum server_error error) {
 	case SERVER_ERROR_ALREADY_IN_A_LOBBY  : return "Already in a lobby.";
 	case SERVER_ERROR_LOBBY_ALREADY_EXISTS: return "Lobby already exists.";
 	case SERVER_ERROR_LOBBY_DOES_NOT_EXIST: return "Lobby does not exist.";
+	case SERVER_ERROR_LOBBY_IS_FULL       : return "Lobby is full.";
+	case SERVER_ERROR_INVALID_LOBBY_ID    : return "Invalid lobby id.";
 	// ...
 	case SERVER_ERROR_UNKNOWN:
 	default:
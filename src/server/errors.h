@@ -7,6 +7,8 @@ enum server_error {
 	SERVER_ERROR_ALREADY_IN_A_LOBBY,
 	SERVER_ERROR_LOBBY_ALREADY_EXISTS,
 	SERVER_ERROR_LOBBY_DOES_NOT_EXIST,
+	SERVER_ERROR_LOBBY_IS_FULL,
+	SERVER_ERROR_INVALID_LOBBY_ID,
 	// ...
 	SERVER_ERROR_UNKNOWN
 };
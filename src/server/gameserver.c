@@ -1,7 +1,9 @@
 #include "gameserver.h"
 
 #include <assert.h>
+#include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <libwebsockets.h>
 #include <cJSON.h>
 #include <stb_ds.h>
@@ -17,7 +19,25 @@ static int callback_ws    (struct lws *, enum lws_callback_reasons, void *, void
 static void gameserver_on_connect   (struct gameserver *, struct session *, struct lws *wsi);
 static void gameserver_on_disconnect(struct gameserver *, struct session *);
 static void gameserver_on_message   (struct gameserver *, struct session *, void *, size_t);
-static void gameserver_on_writable  (struct gameserver *, struct session *);
+static int  gameserver_on_frame    (struct gameserver *, struct session *, const uint8_t *, size_t);
+static void gameserver_dispatch    (struct gameserver *, struct session *, struct message_header *);
+static int  gameserver_on_writable  (struct gameserver *, struct session *);
+
+static struct outbound_message *outbound_message_create (const void *payload, size_t payload_len);
+static struct outbound_message *outbound_message_pack   (struct message_header *, enum message_wire_format);
+static struct outbound_message *outbound_message_for_shard(struct outbound_message *, int shard);
+static void                     outbound_message_release(struct outbound_message *);
+static void                     session_enqueue         (struct gameserver *, struct session *, struct outbound_message *);
+static void                     session_queue_clear     (struct session_queue *);
+static void                     session_deliver         (struct gameserver *, struct session *, struct outbound_message *);
+
+static void *shard_thread     (void *);
+static void  shard_run        (struct gameserver *, struct gameserver_shard *);
+static void  shard_on_wakeup  (lws_sorted_usec_list_t *);
+static void  shard_drain_inbox(struct gameserver *, struct gameserver_shard *);
+
+static void session_id_seed    (struct gameserver *);
+static int  session_id_generate(struct gameserver *);
 
 //
 // private variables
@@ -29,6 +49,9 @@ static struct lws_protocols protocols[] = {
 	{NULL,     NULL,            0,                      0,   0, NULL, 0},
 };
 
+// shard serviced by the calling thread, -1 outside of gameserver_listen().
+static __thread int g_current_shard = -1;
+
 //
 // api
 //
@@ -39,7 +62,8 @@ int filter_everybody        (struct session *o, struct session *t) { return 1; }
 int filter_everybody_exclude(struct session *o, struct session *t) { return (o->id != t->id); }
 
 // initialization
-int gameserver_init(struct gameserver *server, uint16_t port) {
+int gameserver_init(struct gameserver *server, uint16_t port, int threads_len) {
+	assert(threads_len >= 1 && threads_len <= GAMESERVER_MAX_SHARDS);
 	memset(server, 0, sizeof(*server));
 
 	// init libwebsockets
@@ -55,24 +79,151 @@ int gameserver_init(struct gameserver *server, uint16_t port) {
 	// TODO: This works on HTTPS: info.options = LWS_SERVER_OPTION_FALLBACK_TO_RAW;
 	info.options = LWS_SERVER_OPTION_FALLBACK_TO_RAW; // | LWS_SERVER_OPTION_ADOPT_APPLY_LISTEN_ACCEPT_CONFIG
 	info.user = (void *)server;
+	// every service thread gets its own event loop, connections stay on
+	// the thread that accepted them.
+	info.count_threads = threads_len;
+
+	session_id_seed(server);
+
+	// services hold the lock across several calls which lock it as well.
+	pthread_mutexattr_t registry_attr;
+	pthread_mutexattr_init(&registry_attr);
+	pthread_mutexattr_settype(&registry_attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&server->registry_mutex, &registry_attr);
+	pthread_mutexattr_destroy(&registry_attr);
 
 	server->lws = lws_create_context(&info);
-	return (server->lws == NULL);
+	if (server->lws == NULL) {
+		pthread_mutex_destroy(&server->registry_mutex);
+		return 1;
+	}
+
+	// lws may support fewer threads than requested.
+	const int lws_threads_len = lws_get_count_threads(server->lws);
+	server->shards_len = (lws_threads_len >= 1 && lws_threads_len < threads_len) ? lws_threads_len : threads_len;
+	for (int i = 0; i < server->shards_len; ++i) {
+		struct gameserver_shard *shard = &server->shards[i];
+		shard->server = server;
+		shard->index = i;
+		timer_wheel_init(&shard->timers, gameserver_now_ms(), GAMESERVER_TIMER_TICK_MS);
+		pthread_mutex_init(&shard->inbox_mutex, NULL);
+	}
+
+	return 0;
 }
 
 void gameserver_destroy(struct gameserver *server) {
 	lws_context_destroy(server->lws);
+
+	for (size_t i = 0; i < (size_t)stbds_hmlen(server->lobbies); ++i) {
+		stbds_arrfree(server->lobbies[i].value->members);
+		free(server->lobbies[i].value);
+	}
+	stbds_hmfree(server->lobbies);
+	stbds_hmfree(server->sessions_by_id);
+	stbds_arrfree(server->sessions);
+
+	for (int i = 0; i < server->shards_len; ++i) {
+		struct gameserver_shard *shard = &server->shards[i];
+		for (size_t j = 0; j < (size_t)stbds_arrlen(shard->inbox); ++j) {
+			outbound_message_release(shard->inbox[j].message);
+		}
+		stbds_arrfree(shard->inbox);
+		pthread_mutex_destroy(&shard->inbox_mutex);
+		timer_wheel_destroy(&shard->timers);
+	}
+	pthread_mutex_destroy(&server->registry_mutex);
 }
 
+// Can be called from any thread, wakes up all shards.
 void gameserver_shutdown(struct gameserver *server) {
-	server->shutdown_requested = 1;
+	__atomic_store_n(&server->shutdown_requested, 1, __ATOMIC_RELEASE);
+	lws_cancel_service(server->lws);
 }
 
-// main loop
-void gameserver_listen(struct gameserver *server) {
-	while (!server->shutdown_requested) {
-		lws_service(server->lws, 0);
+// main loop, runs the first shard on the calling thread and all others
+// on their own threads. Returns once all of them have stopped, or 1 if
+// not every shard could get a thread.
+int gameserver_listen(struct gameserver *server) {
+	int threads_started = 1;
+	for (int i = 1; i < server->shards_len; ++i) {
+		if (pthread_create(&server->shards[i].thread, NULL, shard_thread, &server->shards[i]) != 0) {
+			break;
+		}
+		++threads_started;
+	}
+
+	// lws keeps accepting connections onto every shard, those without a
+	// thread would never be serviced.
+	const int is_complete = (threads_started == server->shards_len);
+	if (is_complete) {
+		server->shards[0].thread = pthread_self();
+		shard_run(server, &server->shards[0]);
+	} else {
+		gameserver_shutdown(server);
+	}
+
+	for (int i = 1; i < threads_started; ++i) {
+		pthread_join(server->shards[i].thread, NULL);
 	}
+	return is_complete ? 0 : 1;
+}
+
+//
+// shared state
+//
+
+// Guards the sessions and lobbies, which are shared by all shards. Needed
+// when iterating them, or to keep a `struct lobby *` alive. Recursive.
+void gameserver_lock(struct gameserver *server) {
+	pthread_mutex_lock(&server->registry_mutex);
+}
+
+void gameserver_unlock(struct gameserver *server) {
+	pthread_mutex_unlock(&server->registry_mutex);
+}
+
+// Can be called from any thread, the counters are read one by one.
+void gameserver_shard_stats(struct gameserver *server, int shard, struct gameserver_shard_stats *stats) {
+	assert(server != NULL);
+	assert(shard >= 0 && shard < server->shards_len);
+	assert(stats != NULL);
+
+	const struct gameserver_shard_stats *from = &server->shards[shard].stats;
+	stats->sessions           = __atomic_load_n(&from->sessions,           __ATOMIC_RELAXED);
+	stats->messages_received  = __atomic_load_n(&from->messages_received,  __ATOMIC_RELAXED);
+	stats->messages_sent      = __atomic_load_n(&from->messages_sent,      __ATOMIC_RELAXED);
+	stats->messages_forwarded = __atomic_load_n(&from->messages_forwarded, __ATOMIC_RELAXED);
+	stats->messages_dropped   = __atomic_load_n(&from->messages_dropped,   __ATOMIC_RELAXED);
+	stats->messages_rejected  = __atomic_load_n(&from->messages_rejected,  __ATOMIC_RELAXED);
+}
+
+//
+// scheduled work
+//
+
+// monotonic, unaffected by changes to the system clock.
+uint64_t gameserver_now_ms(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+// Runs `fn` on the calling shard's thread after `delay_ms`, and then
+// every `interval_ms` if that is greater than 0. Must be called from a
+// service thread, e.g. from one of the callbacks, or before
+// gameserver_listen() to schedule on the first shard.
+uint32_t gameserver_schedule(struct gameserver *server, uint64_t delay_ms, uint64_t interval_ms, timer_fn fn, void *userdata) {
+	assert(server != NULL);
+	struct gameserver_shard *shard = &server->shards[(g_current_shard >= 0) ? g_current_shard : 0];
+	return timer_wheel_schedule(&shard->timers, gameserver_now_ms(), delay_ms, interval_ms, fn, userdata);
+}
+
+// Timers can only be cancelled from the shard that scheduled them.
+void gameserver_cancel(struct gameserver *server, uint32_t timer_id) {
+	assert(server != NULL);
+	struct gameserver_shard *shard = &server->shards[(g_current_shard >= 0) ? g_current_shard : 0];
+	timer_wheel_cancel(&shard->timers, timer_id);
 }
 
 // send raw bytes
@@ -81,41 +232,32 @@ void gameserver_send_raw(struct gameserver *gserver, struct session *receiver, u
 	assert(data != NULL);
 	assert(data_len > 0);
 
-	// build message for lws
-	uint8_t message[LWS_PRE + data_len];
-	memcpy(&message[LWS_PRE], data, data_len);
-	
+	struct outbound_message *message = outbound_message_create(data, data_len);
+
 	// if the receiver is NULL, we send to everybody
-	// TODO: use receiver->message_queue and callback_on_writable()
 	if (receiver == NULL) {
+		gameserver_lock(gserver);
 		const size_t sessions_len = stbds_arrlen(gserver->sessions);
 		for (size_t i = 0; i < sessions_len; ++i) {
-			lws_write(gserver->sessions[i]->wsi, &message[LWS_PRE], data_len, LWS_WRITE_TEXT);
+			session_deliver(gserver, gserver->sessions[i], message);
 		}
+		gameserver_unlock(gserver);
 	} else {
-		lws_write(receiver->wsi, &message[LWS_PRE], data_len, LWS_WRITE_TEXT);
+		session_deliver(gserver, receiver, message);
 	}
+
+	outbound_message_release(message);
 }
 
 void gameserver_send_to(struct gameserver *gserver, struct message_header *message, struct session *receiver) {
-	// serialize message
-	cJSON *json = pack_message(message);
-	char *json_str = cJSON_PrintUnformatted(json); // TODO: maybe we can implement this directly with LWS_PRE padding?
-	const size_t json_str_len = strlen(json_str);
-	cJSON_Delete(json);
-	
-	// TODO: validation
-	assert(json_str != NULL);
-	assert(json_str_len > 0);
-
-	// build lws message
-	uint8_t *data = malloc(LWS_PRE + json_str_len + 1);
-	memcpy(&data[LWS_PRE], json_str, json_str_len + 1);
-	free(json_str);
+	assert(gserver != NULL);
+	assert(message != NULL);
+	assert(receiver != NULL);
 
-	// enqueue message
-	stbds_arrpush(receiver->message_queue, data);
-	lws_callback_on_writable(receiver->wsi);
+	const enum message_wire_format format = __atomic_load_n(&receiver->wire_format, __ATOMIC_RELAXED);
+	struct outbound_message *outbound = outbound_message_pack(message, format);
+	session_deliver(gserver, receiver, outbound);
+	outbound_message_release(outbound);
 }
 
 void gameserver_send_filtered(struct gameserver *gserver, struct message_header *message, struct session *master, session_filter_fn filter) {
@@ -123,37 +265,125 @@ void gameserver_send_filtered(struct gameserver *gserver, struct message_header
 	assert(message != NULL);
 	assert(filter != NULL);
 
-	// serialize message
-	cJSON *json = pack_message(message);
-	char *json_str = cJSON_PrintUnformatted(json); // TODO: maybe we can implement this directly with LWS_PRE padding?
-	const size_t json_str_len = strlen(json_str);
-	cJSON_Delete(json);
-	
-	// TODO: validation
-	assert(json_str != NULL);
-	assert(json_str_len > 0);
+	// serialized once per wire format, every receiver holds a reference.
+	struct outbound_message *outbound[MESSAGE_WIRE_FORMAT_MAX] = {0};
+
+	gameserver_lock(gserver);
 
-	// build lws message
-	const size_t sessions_len = stbds_arrlen(gserver->sessions);
-	for (size_t i = 0; i < sessions_len; ++i) {
-		struct session *tested = gserver->sessions[i];
+	// group broadcasts only need to look at the members of the lobby.
+	struct session **candidates = gserver->sessions;
+	const int is_group_filter = (filter == filter_group || filter == filter_group_exclude);
+	if (is_group_filter && master != NULL && master->group_id > 0) {
+		struct lobby *lobby = gameserver_lobby_find(gserver, master->group_id);
+		assert(lobby != NULL);
+		candidates = lobby->members;
+	}
+
+	const size_t candidates_len = stbds_arrlen(candidates);
+	for (size_t i = 0; i < candidates_len; ++i) {
+		struct session *tested = candidates[i];
 		if (filter(master, tested)) {
-			// TODO: refcount message instead of `malloc`ing for every session
-			unsigned char *data = malloc(LWS_PRE + json_str_len + 1);
-			memcpy(&data[LWS_PRE], json_str, json_str_len + 1);
+			const enum message_wire_format format = __atomic_load_n(&tested->wire_format, __ATOMIC_RELAXED);
+			if (outbound[format] == NULL) {
+				outbound[format] = outbound_message_pack(message, format);
+			}
+			session_deliver(gserver, tested, outbound[format]);
+		}
+	}
 
-			stbds_arrpush(tested->message_queue, data);
-			lws_callback_on_writable(tested->wsi);
+	gameserver_unlock(gserver);
+	for (int i = 0; i < MESSAGE_WIRE_FORMAT_MAX; ++i) {
+		if (outbound[i] != NULL) {
+			outbound_message_release(outbound[i]);
 		}
 	}
+}
 
-	free(json_str);
+//
+// lobbies
+//
+
+// The lobby is only valid while gameserver_lock() is held.
+struct lobby *gameserver_lobby_find(struct gameserver *server, uint32_t id) {
+	assert(server != NULL);
+	gameserver_lock(server);
+	struct lobby *lobby = stbds_hmget(server->lobbies, id);
+	gameserver_unlock(server);
+	return lobby;
+}
+
+struct lobby *gameserver_lobby_create(struct gameserver *server, uint32_t id) {
+	assert(server != NULL);
+	assert(id > 0);
+	assert(gameserver_lobby_find(server, id) == NULL);
+
+	struct lobby *lobby = calloc(1, sizeof(*lobby));
+	lobby->id = id;
+	lobby->state = LOBBY_STATE_OPEN;
+	lobby->capacity = GAMESERVER_LOBBY_CAPACITY;
+	lobby->members = NULL;
+	gameserver_lock(server);
+	stbds_hmput(server->lobbies, id, lobby);
+	gameserver_unlock(server);
+	return lobby;
+}
+
+// Moves `session` into `lobby`, leaving its current lobby first.
+void gameserver_lobby_join(struct gameserver *server, struct lobby *lobby, struct session *session) {
+	assert(server != NULL);
+	assert(lobby != NULL);
+	assert(session != NULL);
+	assert(session->group_id != lobby->id);
+
+	gameserver_lock(server);
+	gameserver_lobby_leave(server, session);
+	assert(stbds_arrlen(lobby->members) < lobby->capacity);
+	stbds_arrpush(lobby->members, session);
+	session->group_id = lobby->id;
+	gameserver_unlock(server);
+}
+
+// Removes `session` from its lobby, empty lobbies are closed.
+void gameserver_lobby_leave(struct gameserver *server, struct session *session) {
+	assert(server != NULL);
+	assert(session != NULL);
+	if (session->group_id == 0) {
+		return;
+	}
+
+	gameserver_lock(server);
+	struct lobby *lobby = gameserver_lobby_find(server, session->group_id);
+	assert(lobby != NULL);
+	for (size_t i = 0; i < (size_t)stbds_arrlen(lobby->members); ++i) {
+		if (lobby->members[i] == session) {
+			stbds_arrdelswap(lobby->members, i);
+			break;
+		}
+	}
+	session->group_id = 0;
+
+	if (stbds_arrlen(lobby->members) == 0) {
+		(void)stbds_hmdel(server->lobbies, lobby->id);
+		stbds_arrfree(lobby->members);
+		free(lobby);
+	}
+	gameserver_unlock(server);
 }
 
 //
 // session api
 //
 
+// The session is only valid while gameserver_lock() is held, or on the
+// thread of its shard.
+struct session *gameserver_session_find(struct gameserver *server, int id) {
+	assert(server != NULL);
+	gameserver_lock(server);
+	struct session *session = stbds_hmget(server->sessions_by_id, id);
+	gameserver_unlock(server);
+	return session;
+}
+
 char *gameserver_session_connection_type(struct session *s) {
 	assert(s != NULL);
 	switch (s->connection_type) {
@@ -185,8 +415,7 @@ static int callback_ws(struct lws *wsi, enum lws_callback_reasons reason, void *
 		gameserver_on_disconnect(server, session);
 		break;
 	case LWS_CALLBACK_SERVER_WRITEABLE:
-		gameserver_on_writable(server, session);
-		break;
+		return gameserver_on_writable(server, session);
 	default: break;
 	}
 
@@ -220,7 +449,10 @@ static int callback_rawtcp(struct lws *wsi, enum lws_callback_reasons reason, vo
 
 	case LWS_CALLBACK_SERVER_WRITEABLE:
 	case LWS_CALLBACK_RAW_WRITEABLE:
-		gameserver_on_writable(server, session);
+		return gameserver_on_writable(server, session);
+
+	// woken up by lws_cancel_service(), the shard checks its inbox and for shutdown.
+	case LWS_CALLBACK_EVENT_WAIT_CANCELLED:
 		break;
 
 	default: break;
@@ -234,17 +466,20 @@ static void gameserver_on_connect(struct gameserver *server, struct session *ses
 
 	// initialize
 	session->wsi = wsi;
-	session->id = (uint32_t)((rand() / (float)RAND_MAX) * 999999.0f + 100000.0f);
-	session->message_queue = NULL;
+	session->shard = (server->shards_len > 1) ? lws_get_tsi(wsi) : 0;
+	session->is_closing = 0;
 	session->group_id = 0;
+	message_stream_init(&session->stream);
+	assert(session->shard >= 0 && session->shard < server->shards_len);
 
 	// store session
-	size_t sessions_count = stbds_arrlen(server->sessions);
-	for (size_t i = 0; i < sessions_count; ++i) {
-		assert(session->id != server->sessions[i]->id);
-	}
-
+	gameserver_lock(server);
+	session->id = session_id_generate(server);
+	session->sessions_index = stbds_arrlen(server->sessions);
 	stbds_arrpush(server->sessions, session);
+	stbds_hmput(server->sessions_by_id, session->id, session);
+	gameserver_unlock(server);
+	__atomic_add_fetch(&server->shards[session->shard].stats.sessions, 1, __ATOMIC_RELAXED);
 
 	// propagate
 	if (server->callback_on_connect != NULL) {
@@ -254,16 +489,21 @@ static void gameserver_on_connect(struct gameserver *server, struct session *ses
 
 static void gameserver_on_disconnect(struct gameserver *server, struct session *session) {
 	// cleanup
-	stbds_arrfree(session->message_queue);
-
-	// remove from sessions
-	size_t sessions_count = stbds_arrlen(server->sessions);
-	for (size_t i = 0; i < sessions_count; ++i) {
-		if (server->sessions[i]->id == session->id) {
-			stbds_arrdel(server->sessions, i);
-			break;
-		}
+	gameserver_lock(server);
+	gameserver_lobby_leave(server, session);
+	session_queue_clear(&session->queue);
+	message_stream_destroy(&session->stream);
+
+	// remove from sessions, the last session takes its place.
+	const size_t index = session->sessions_index;
+	assert(index < (size_t)stbds_arrlen(server->sessions) && server->sessions[index] == session);
+	stbds_arrdelswap(server->sessions, index);
+	if (index < (size_t)stbds_arrlen(server->sessions)) {
+		server->sessions[index]->sessions_index = index;
 	}
+	(void)stbds_hmdel(server->sessions_by_id, session->id);
+	gameserver_unlock(server);
+	__atomic_sub_fetch(&server->shards[session->shard].stats.sessions, 1, __ATOMIC_RELAXED);
 
 	// propagate
 	if (server->callback_on_disconnect != NULL) {
@@ -271,53 +511,354 @@ static void gameserver_on_disconnect(struct gameserver *server, struct session *
 	}
 }
 
+// Raw reads and websocket fragments may hold any part of a message, or
+// several of them. Complete messages are handled right away, the rest is
+// kept until the next callback.
 static void gameserver_on_message(struct gameserver *server, struct session *session, void *data, size_t data_len) {
-	if (data_len == 0) {
+	if (data_len == 0 || session->is_closing) {
 		return;
 	}
 
-	// parse as json
-	// TODO: handle multiple json objects in data. (see engine.c)
-	cJSON *data_json = cJSON_ParseWithLength(data, data_len);
-	if (data_json == NULL) {
-		return;
+	struct message_stream *stream = &session->stream;
+	message_stream_append(stream, data, data_len);
+
+	const uint8_t *frame;
+	size_t frame_len;
+	enum message_decode_result result;
+	while ((result = message_stream_next(stream, &frame, &frame_len)) == MESSAGE_DECODE_OK) {
+		if (!gameserver_on_frame(server, session, frame, frame_len)) {
+			__atomic_add_fetch(&server->shards[session->shard].stats.messages_rejected, 1, __ATOMIC_RELAXED);
+		}
+	}
+
+	// the stream can not be split into messages anymore, e.g. because
+	// a message is larger than MESSAGE_MAX_FRAME_LEN. nothing that follows
+	// can be trusted, so the client is disconnected.
+	if (result == MESSAGE_DECODE_INVALID) {
+		__atomic_add_fetch(&server->shards[session->shard].stats.messages_rejected, 1, __ATOMIC_RELAXED);
+		message_stream_clear(stream);
+		session->is_closing = 1;
+		lws_callback_on_writable(session->wsi);
+	}
+}
+
+// Returns 0 if the message is malformed, the connection stays open.
+static int gameserver_on_frame(struct gameserver *server, struct session *session, const uint8_t *frame, size_t frame_len) {
+	// binary frames are decoded into a buffer on the stack, nothing is allocated.
+	if (frame[0] == MESSAGE_BINARY_MAGIC) {
+		message_buffer_t buffer;
+		struct message_header *message = NULL;
+		size_t decoded_len = 0;
+		if (message_binary_decode(frame, frame_len, &decoded_len, &buffer, &message) != MESSAGE_DECODE_OK) {
+			return 0;
+		}
+
+		gameserver_dispatch(server, session, message);
+		return 1;
 	}
 
-	// TODO: this can easily occur, but message.h doesnt validate the data yet.
-	//       we just fail here for visibility, these asserts can be removed later.
-	assert(cJSON_GetObjectItem(data_json, "header") != NULL);
-	assert(cJSON_GetObjectItem(cJSON_GetObjectItem(data_json, "header"), "type") != NULL);
-	assert(cJSON_IsNumber(cJSON_GetObjectItem(cJSON_GetObjectItem(data_json, "header"), "type")));
+	// parse as json, unpack_message() checks all fields.
+	cJSON *data_json = cJSON_ParseWithLength((const char *)frame, frame_len);
+	if (data_json == NULL) {
+		return 0;
+	}
 
-	// unpack
 	struct message_header *message = unpack_message(data_json);
 	if (message == NULL) {
 		cJSON_Delete(data_json);
-		return;
+		return 0;
 	}
 
+	gameserver_dispatch(server, session, message);
+	free_message(data_json, message);
+	return 1;
+}
+
+static void gameserver_dispatch(struct gameserver *server, struct session *session, struct message_header *message) {
 	assert(message->type != MSG_TYPE_UNKNOWN);
 	assert(message->type != MSG_TYPE_MAX);
+	__atomic_add_fetch(&server->shards[session->shard].stats.messages_received, 1, __ATOMIC_RELAXED);
+
+	// the wire format is negotiated here, services never see it.
+	if (message->type == WIRE_FORMAT_REQUEST) {
+		const struct wire_format_request *request = (struct wire_format_request *)message;
+		if (request->wire_format >= 0 && request->wire_format < MESSAGE_WIRE_FORMAT_MAX) {
+			__atomic_store_n(&session->wire_format, (enum message_wire_format)request->wire_format, __ATOMIC_RELAXED);
+		}
+		return;
+	}
 
 	// propagate
 	if (server->callback_on_message != NULL) {
 		server->callback_on_message(server, session, message);
 	}
+}
 
-	free_message(data_json, message);
+// Writes a single message, and asks for another callback if there are
+// more. Returns -1 to have lws close the connection.
+static int gameserver_on_writable(struct gameserver *server, struct session *session) {
+	struct session_queue *queue = &session->queue;
+	if (session->is_closing) {
+		return -1;
+	}
+	if (queue->len == 0) {
+		return 0;
+	}
+
+	// the kernel buffer is full, try again once it drained.
+	if (lws_send_pipe_choked(session->wsi)) {
+		lws_callback_on_writable(session->wsi);
+		return 0;
+	}
+
+	// lws writes its framing into the headroom, the payload stays
+	// untouched. What the kernel does not take is buffered by lws itself,
+	// anything but the whole message is an error.
+	struct outbound_message *msg = queue->messages[queue->head];
+	const enum lws_write_protocol write_type = (msg->format == MESSAGE_WIRE_BINARY) ? LWS_WRITE_BINARY : LWS_WRITE_TEXT;
+	const int written = lws_write(session->wsi, &msg->data[LWS_PRE], msg->len, write_type);
+	if (written < 0 || (size_t)written < msg->len) {
+		return -1;
+	}
+
+	queue->head = (queue->head + 1) % GAMESERVER_QUEUE_MAX_MESSAGES;
+	--queue->len;
+	queue->bytes -= msg->len;
+	outbound_message_release(msg);
+	__atomic_add_fetch(&server->shards[session->shard].stats.messages_sent, 1, __ATOMIC_RELAXED);
+
+	if (queue->len > 0) {
+		lws_callback_on_writable(session->wsi);
+	}
+	return 0;
 }
 
-static void gameserver_on_writable(struct gameserver *server, struct session *session) {
-	// write all queued messages
-	size_t message_queue_len = stbds_arrlen(session->message_queue);
-	for (size_t i = 0; i < message_queue_len; ++i) {
-		char *msg = session->message_queue[i];
+// Copies `payload` behind the lws headroom. The caller holds the only reference.
+static struct outbound_message *outbound_message_create(const void *payload, size_t payload_len) {
+	assert(payload != NULL);
+	assert(payload_len > 0);
+
+	struct outbound_message *message = malloc(sizeof(*message) + LWS_PRE + payload_len + 1);
+	message->refcount = 1;
+	message->len = payload_len;
+	message->format = MESSAGE_WIRE_JSON;
+	message->shard = -1;
+	message->next_copy = NULL;
+	memcpy(&message->data[LWS_PRE], payload, payload_len);
+	message->data[LWS_PRE + payload_len] = '\0';
+	return message;
+}
 
-		lws_write(session->wsi, (unsigned char *)&msg[LWS_PRE], strlen(&msg[LWS_PRE]), LWS_WRITE_TEXT);
-		free(msg);
+static struct outbound_message *outbound_message_pack(struct message_header *message, enum message_wire_format format) {
+	switch (format) {
+	case MESSAGE_WIRE_BINARY: {
+		// encoded straight behind the lws headroom.
+		const size_t binary_len = message_binary_size(message);
+		assert(binary_len > 0);
+		struct outbound_message *outbound = malloc(sizeof(*outbound) + LWS_PRE + binary_len);
+		outbound->refcount = 1;
+		outbound->len = message_binary_encode(message, &outbound->data[LWS_PRE], binary_len);
+		outbound->format = MESSAGE_WIRE_BINARY;
+		outbound->shard = -1;
+		outbound->next_copy = NULL;
+		assert(outbound->len == binary_len);
+		return outbound;
+	}
+	case MESSAGE_WIRE_JSON:
+	case MESSAGE_WIRE_FORMAT_MAX:
+		break;
 	}
-	stbds_arrfree(session->message_queue);
-	session->message_queue = NULL;
+	assert(format == MESSAGE_WIRE_JSON);
+
+	// serialize message
+	cJSON *json = pack_message(message);
+	char *json_str = cJSON_PrintUnformatted(json); // TODO: maybe we can implement this directly with LWS_PRE padding?
+	cJSON_Delete(json);
+
+	// TODO: validation
+	assert(json_str != NULL);
+	const size_t json_str_len = strlen(json_str);
+	assert(json_str_len > 0);
+
+	struct outbound_message *outbound = outbound_message_create(json_str, json_str_len);
+	free(json_str);
+	return outbound;
 }
 
+// The message itself if `shard` writes it, or its copy for `shard`.
+// Copies are made on the first delivery to another shard.
+static struct outbound_message *outbound_message_for_shard(struct outbound_message *message, int shard) {
+	struct outbound_message *it = message;
+	for (;;) {
+		if (it->shard < 0) {
+			it->shard = shard;
+		}
+		if (it->shard == shard) {
+			return it;
+		}
+		if (it->next_copy == NULL) {
+			it->next_copy = outbound_message_create(&message->data[LWS_PRE], message->len);
+			it->next_copy->format = message->format;
+		}
+		it = it->next_copy;
+	}
+}
+
+static void outbound_message_release(struct outbound_message *message) {
+	assert(message != NULL);
+	assert(__atomic_load_n(&message->refcount, __ATOMIC_RELAXED) > 0);
+	if (__atomic_sub_fetch(&message->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+		if (message->next_copy != NULL) {
+			outbound_message_release(message->next_copy);
+		}
+		free(message);
+	}
+}
+
+// Only on the thread of the session's shard. A full queue means the
+// client does not keep up, it is either dropped or the message is.
+static void session_enqueue(struct gameserver *server, struct session *session, struct outbound_message *message) {
+	struct session_queue *queue = &session->queue;
+	if (session->is_closing) {
+		return;
+	}
+
+	const int is_full = (queue->len == GAMESERVER_QUEUE_MAX_MESSAGES || queue->bytes + message->len > GAMESERVER_QUEUE_MAX_BYTES);
+	if (is_full) {
+		__atomic_add_fetch(&server->shards[session->shard].stats.messages_dropped, 1, __ATOMIC_RELAXED);
+		switch (server->overflow_policy) {
+		case QUEUE_OVERFLOW_DISCONNECT:
+			session->is_closing = 1;
+			lws_callback_on_writable(session->wsi);
+			return;
+		case QUEUE_OVERFLOW_DROP:
+			return;
+		}
+	}
+
+	__atomic_add_fetch(&message->refcount, 1, __ATOMIC_RELAXED);
+	queue->messages[(queue->head + queue->len) % GAMESERVER_QUEUE_MAX_MESSAGES] = message;
+	++queue->len;
+	queue->bytes += message->len;
+	lws_callback_on_writable(session->wsi);
+}
+
+static void session_queue_clear(struct session_queue *queue) {
+	for (size_t i = 0; i < queue->len; ++i) {
+		outbound_message_release(queue->messages[(queue->head + i) % GAMESERVER_QUEUE_MAX_MESSAGES]);
+	}
+	queue->head = 0;
+	queue->len = 0;
+	queue->bytes = 0;
+}
+
+// Only the session's own shard may touch its queue. Other shards and
+// threads outside of the service loop, e.g. the console, hand the message
+// over through the shard's inbox.
+static void session_deliver(struct gameserver *server, struct session *session, struct outbound_message *message) {
+	message = outbound_message_for_shard(message, session->shard);
+	if (session->shard == g_current_shard) {
+		session_enqueue(server, session, message);
+		return;
+	}
+
+	struct gameserver_shard *from = &server->shards[(g_current_shard >= 0) ? g_current_shard : 0];
+	struct gameserver_shard *to = &server->shards[session->shard];
+	__atomic_add_fetch(&message->refcount, 1, __ATOMIC_RELAXED);
+	pthread_mutex_lock(&to->inbox_mutex);
+	stbds_arrpush(to->inbox, ((struct shard_delivery){ .session_id = session->id, .message = message }));
+	pthread_mutex_unlock(&to->inbox_mutex);
+	__atomic_add_fetch(&from->stats.messages_forwarded, 1, __ATOMIC_RELAXED);
+
+	// wakes up the receiving shard.
+	lws_cancel_service_pt(session->wsi);
+}
+
+static void *shard_thread(void *userdata) {
+	struct gameserver_shard *shard = userdata;
+	shard_run(shard->server, shard);
+	return NULL;
+}
+
+// lws 4.x ignores the timeout passed to lws_service_tsi() and only wakes
+// up for its own scheduled events, the next timer has to be one of them.
+struct shard_wakeup {
+	lws_sorted_usec_list_t sul;
+	struct gameserver_shard *shard;
+};
+
+static void shard_run(struct gameserver *server, struct gameserver_shard *shard) {
+	g_current_shard = shard->index;
+	struct shard_wakeup wakeup = { .shard = shard };
+	while (!__atomic_load_n(&server->shutdown_requested, __ATOMIC_ACQUIRE)) {
+		// sleeps until there is network activity, the next timer is due
+		// or lws_cancel_service() is called.
+		const int timeout_ms = timer_wheel_timeout_ms(&shard->timers, gameserver_now_ms(), GAMESERVER_MAX_WAIT_MS);
+		lws_sul_schedule(server->lws, shard->index, &wakeup.sul, shard_on_wakeup, (lws_usec_t)timeout_ms * LWS_US_PER_MS);
+		lws_service_tsi(server->lws, timeout_ms, shard->index);
+		shard_drain_inbox(server, shard);
+		timer_wheel_advance(&shard->timers, gameserver_now_ms());
+	}
+	lws_sul_schedule(server->lws, shard->index, &wakeup.sul, shard_on_wakeup, LWS_SET_TIMER_USEC_CANCEL);
+	g_current_shard = -1;
+}
+
+// runs on the shard's thread, from within lws_service_tsi().
+static void shard_on_wakeup(lws_sorted_usec_list_t *sul) {
+	struct shard_wakeup *wakeup = lws_container_of(sul, struct shard_wakeup, sul);
+	timer_wheel_advance(&wakeup->shard->timers, gameserver_now_ms());
+}
+
+// Queues messages forwarded by other shards, unless the receiver has
+// disconnected in the meantime.
+static void shard_drain_inbox(struct gameserver *server, struct gameserver_shard *shard) {
+	pthread_mutex_lock(&shard->inbox_mutex);
+	struct shard_delivery *inbox = shard->inbox;
+	shard->inbox = NULL;
+	pthread_mutex_unlock(&shard->inbox_mutex);
+
+	// sessions of this shard can only disconnect on this thread.
+	for (size_t i = 0; i < (size_t)stbds_arrlen(inbox); ++i) {
+		struct session *session = gameserver_session_find(server, inbox[i].session_id);
+		if (session != NULL && session->shard == shard->index) {
+			session_enqueue(server, session, inbox[i].message);
+		}
+		outbound_message_release(inbox[i].message);
+	}
+	stbds_arrfree(inbox);
+}
+
+// The key makes ids unpredictable for clients, it is not meant to be
+// cryptographically secure.
+static void session_id_seed(struct gameserver *server) {
+	FILE *urandom = fopen("/dev/urandom", "rb");
+	if (urandom == NULL || fread(server->session_id_key, sizeof(server->session_id_key), 1, urandom) != 1) {
+		server->session_id_key[0] = (uint32_t)time(NULL);
+		server->session_id_key[1] = (uint32_t)rand();
+	}
+	if (urandom != NULL) {
+		fclose(urandom);
+	}
+	server->session_id_counter = 0;
+}
+
+// Every step of the mix is invertible, so consecutive counters give
+// distinct, scattered ids. Dropping the top bit can still collide with a
+// connected session, such ids are skipped.
+static int session_id_generate(struct gameserver *server) {
+	for (;;) {
+		uint32_t x = ++server->session_id_counter ^ server->session_id_key[0];
+		x ^= x >> 16;
+		x *= 0x7feb352dU;
+		x += server->session_id_key[1];
+		x ^= x >> 15;
+		x *= 0x846ca68bU;
+		x ^= x >> 16;
+
+		const int id = (int)(x & 0x7FFFFFFF);
+		if (id != 0 && gameserver_session_find(server, id) == NULL) {
+			return id;
+		}
+	}
+}
 
@@ -3,6 +3,10 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <pthread.h>
+#include "server/timer_wheel.h"
+#include "net/message.h"
+#include "net/message_stream.h"
 
 //
 // types
@@ -22,6 +26,17 @@ typedef void (*on_message_fn)   (struct gameserver *, struct session *, struct m
 
 typedef int (*session_filter_fn)(struct session *master, struct session *tested);
 
+#define GAMESERVER_LOBBY_CAPACITY 8
+// resolution of scheduled work.
+#define GAMESERVER_TIMER_TICK_MS 10
+// longest time the main loop sleeps without network activity or timers.
+#define GAMESERVER_MAX_WAIT_MS 1000
+// most lws service threads.
+#define GAMESERVER_MAX_SHARDS 16
+// limits of each session's outbound queue.
+#define GAMESERVER_QUEUE_MAX_MESSAGES 128
+#define GAMESERVER_QUEUE_MAX_BYTES (256 * 1024)
+
 //
 // enums & structs
 //
@@ -32,11 +47,71 @@ enum connection_type {
 	CONNECTION_TYPE_TCP,
 };
 
+enum lobby_state {
+	LOBBY_STATE_OPEN,
+	LOBBY_STATE_IN_GAME,
+};
+
+// what happens to messages for a session whose queue is full.
+enum queue_overflow_policy {
+	QUEUE_OVERFLOW_DISCONNECT,
+	QUEUE_OVERFLOW_DROP,
+};
+
+struct gameserver_shard_stats {
+	// currently connected
+	uint64_t sessions;
+	uint64_t messages_received;
+	uint64_t messages_sent;
+	// handed to a session of another shard
+	uint64_t messages_forwarded;
+	// not sent because the receiver's queue was full
+	uint64_t messages_dropped;
+	// received, but malformed or too large
+	uint64_t messages_rejected;
+};
+
+/* a message for a session of another shard */
+struct shard_delivery {
+	int session_id;
+	struct outbound_message *message;
+};
+
+/* one lws service thread and the sessions it services */
+struct gameserver_shard {
+	struct gameserver *server;
+	int index;
+	pthread_t thread;
+	// scheduled work, only touched from this shard's thread.
+	struct timer_wheel timers;
+	// stb_ds array, other shards push to it.
+	struct shard_delivery *inbox;
+	pthread_mutex_t inbox_mutex;
+	// updated atomically, see gameserver_shard_stats().
+	struct gameserver_shard_stats stats;
+};
+
 struct gameserver {
 	struct lws_context *lws;
+	int shards_len;
+	struct gameserver_shard shards[GAMESERVER_MAX_SHARDS];
+
+	// `sessions`, `sessions_by_id`, `lobbies` and the session ids are
+	// shared by all shards, see gameserver_lock().
+	pthread_mutex_t registry_mutex;
+	// stb_ds array, dense and unordered.
 	struct session **sessions;
+	// stb_ds hashmap, `session.id` to session.
+	struct { int key; struct session *value; } *sessions_by_id;
+	// session ids are a keyed permutation of this counter.
+	uint32_t session_id_counter;
+	uint32_t session_id_key[2];
+	// stb_ds hashmap, `session.group_id` to lobby.
+	struct { uint32_t key; struct lobby *value; } *lobbies;
 
 	int shutdown_requested;
+	// defaults to QUEUE_OVERFLOW_DISCONNECT, set before gameserver_listen().
+	enum queue_overflow_policy overflow_policy;
 
 	// callbacks
 	on_connect_fn    callback_on_connect;
@@ -44,12 +119,55 @@ struct gameserver {
 	on_message_fn    callback_on_message;
 };
 
+/* serialized message, shared by its receivers on one shard */
+struct outbound_message {
+	int refcount;
+	size_t len;
+	enum message_wire_format format;
+	// the only shard writing it, -1 until it is first delivered. lws puts
+	// the websocket framing into the headroom, so shards can not share it.
+	int shard;
+	// copy of the payload for another shard, owned by this message and
+	// only touched by the thread delivering it.
+	struct outbound_message *next_copy;
+	// LWS_PRE bytes of headroom for lws, followed by the payload.
+	unsigned char data[];
+};
+
+/* all sessions sharing a `group_id` */
+struct lobby {
+	uint32_t id;
+	enum lobby_state state;
+	int capacity;
+	// stb_ds array
+	struct session **members;
+};
+
+/* messages waiting to be written, each entry holds a reference */
+struct session_queue {
+	struct outbound_message *messages[GAMESERVER_QUEUE_MAX_MESSAGES];
+	size_t head;
+	size_t len;
+	size_t bytes;
+};
+
 /* represents the state of a client connection */
 struct session {
 	struct lws *wsi;
-	char **message_queue;
+	struct session_queue queue;
+	// received bytes which do not form a whole message yet.
+	struct message_stream stream;
+	// the queue overflowed, the connection is closed on the next write.
+	int is_closing;
 	enum connection_type connection_type;
+	// index into `gameserver.shards`, set on connect.
+	int shard;
+	// JSON until the client asks for another format after the welcome.
+	enum message_wire_format wire_format;
 	
+	// position in `gameserver.sessions`
+	size_t sessions_index;
+
 	// client userdata
 	int id;
 	uint32_t group_id;
@@ -60,18 +178,34 @@ struct session {
 //
 
 // init & destroy
-int  gameserver_init         (struct gameserver *, uint16_t port);
+int  gameserver_init         (struct gameserver *, uint16_t port, int threads_len);
 void gameserver_destroy      (struct gameserver *);
 void gameserver_shutdown     (struct gameserver *);
 
 //   main                            loop
-void gameserver_listen       (struct gameserver *);
+int  gameserver_listen       (struct gameserver *);
+
+//   shared                          state
+void gameserver_lock         (struct gameserver *);
+void gameserver_unlock       (struct gameserver *);
+void gameserver_shard_stats  (struct gameserver *, int shard, struct gameserver_shard_stats *);
+
+//   scheduled                       work
+uint64_t gameserver_now_ms   (void);
+uint32_t gameserver_schedule (struct gameserver *, uint64_t delay_ms, uint64_t interval_ms, timer_fn, void *userdata);
+void     gameserver_cancel   (struct gameserver *, uint32_t timer_id);
 
 //   sending                         data
 void gameserver_send_raw     (struct gameserver *, struct session *receiver, uint8_t *data, size_t data_len);
 void gameserver_send_to      (struct gameserver *, struct message_header *message, struct session  *receiver);
 void gameserver_send_filtered(struct gameserver *, struct message_header *message, struct session *master, session_filter_fn filter);
 
+// lobbies
+struct lobby *gameserver_lobby_find  (struct gameserver *, uint32_t id);
+struct lobby *gameserver_lobby_create(struct gameserver *, uint32_t id);
+void          gameserver_lobby_join  (struct gameserver *, struct lobby *, struct session *);
+void          gameserver_lobby_leave (struct gameserver *, struct session *);
+
 // filters
 int  filter_group            (struct session *o, struct session *t);
 int  filter_group_exclude    (struct session *o, struct session *t);
@@ -79,6 +213,7 @@ int  filter_everybody        (struct session *o, struct session *t);
 int  filter_everybody_exclude(struct session *o, struct session *t);
 
 // session api
+struct session *gameserver_session_find(struct gameserver *, int id);
 char *gameserver_session_connection_type(struct session *);
 
 #endif
@@ -44,20 +44,45 @@ const size_t messagequeue_max = 128;
 static char *messagequeue[128];
 static size_t messagequeue_len = 0;
 static struct gameserver gserver;
+static int server_threads = 1;
+static enum queue_overflow_policy server_overflow_policy = QUEUE_OVERFLOW_DISCONNECT;
 
 int main(int argc, char **argv) {
 	int server_port = 9124;
 
+	// one service thread per core by default.
+	const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	server_threads = (cores < 1) ? 1 : (cores > GAMESERVER_MAX_SHARDS) ? GAMESERVER_MAX_SHARDS : (int)cores;
+
 	// Arg parsing
 	for (int i = 1; i < argc; ++i) {
 		const char *next_arg = (i+1 < argc) ? argv[i+1] : NULL;
 		if ((strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)) {
 			printf(" --help, -h  : Print this message.\n");
 			printf(" --port, -p  : Specify the server port.\n");
+			printf(" --threads, -t : Number of service threads, defaults to one per core.\n");
+			printf(" --overflow  : 'disconnect' (default) or 'drop' messages for clients which do not keep up.\n");
 			return 0;
 		} else if ((strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "--port") == 0) && next_arg != NULL) {
 			server_port = atoi(next_arg);
 			++i;
+		} else if ((strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--threads") == 0) && next_arg != NULL) {
+			server_threads = atoi(next_arg);
+			if (server_threads < 1 || server_threads > GAMESERVER_MAX_SHARDS) {
+				printf("Threads must be between 1 and %d.\n", GAMESERVER_MAX_SHARDS);
+				return 1;
+			}
+			++i;
+		} else if (strcmp(argv[i], "--overflow") == 0 && next_arg != NULL) {
+			if (strcmp(next_arg, "drop") == 0) {
+				server_overflow_policy = QUEUE_OVERFLOW_DROP;
+			} else if (strcmp(next_arg, "disconnect") == 0) {
+				server_overflow_policy = QUEUE_OVERFLOW_DISCONNECT;
+			} else {
+				printf("Unknown overflow policy: %s\n", next_arg);
+				return 1;
+			}
+			++i;
 		}
 	}
 
@@ -155,6 +180,7 @@ static void server_on_connect(struct gameserver *gs, struct session *session) {
 	struct welcome_response res;
 	message_header_init(&res.header, WELCOME_RESPONSE);
 	res._dummy = 1337;
+	res.wire_formats = (1 << MESSAGE_WIRE_JSON) | (1 << MESSAGE_WIRE_BINARY);
 	gameserver_send_to(gs, (struct message_header *)&res, session);
 }
 
@@ -184,16 +210,28 @@ static void serverui_on_input(const char *cmd, size_t cmd_len) {
 		if (serverui_is_input_command(input, "help")) {
 			console_log("- /help [cmd]    :  Get help for a specific command.");
 			console_log("- /status        :  Display server status info.");
+			console_log("- /shards        :  Display statistics of each service thread.");
 			console_log("- /clear         :  Clear the screen, same as <C-l>.");
 			console_log("- /logs [on/off] :  Enable or disable writing logs to disk.");
 		} else if (serverui_is_input_command(input, "status")) {
 			console_log("Status: OK");
 			console_log("PID: %d", getpid());
+			gameserver_lock(&gserver);
 			console_log("Clients: %d", stbds_arrlen(gserver.sessions));
 			for (int i = 0; i < stbds_arrlen(gserver.sessions); ++i) {
 				struct session *s = gserver.sessions[i];
 				console_log(" - %d (Group #%d) <%s>", s->id, s->group_id, gameserver_session_connection_type(s));
 			}
+			gameserver_unlock(&gserver);
+		} else if (serverui_is_input_command(input, "shards")) {
+			for (int i = 0; i < gserver.shards_len; ++i) {
+				struct gameserver_shard_stats stats;
+				gameserver_shard_stats(&gserver, i, &stats);
+				console_log(" - Shard %d: %lu sessions, %lu received, %lu sent, %lu forwarded, %lu dropped, %lu rejected", i,
+						(unsigned long)stats.sessions, (unsigned long)stats.messages_received,
+						(unsigned long)stats.messages_sent, (unsigned long)stats.messages_forwarded,
+						(unsigned long)stats.messages_dropped, (unsigned long)stats.messages_rejected);
+			}
 		} else if (serverui_is_input_command(input, "clear")) {
 			console_log("Not implemented :(");
 		} else {
@@ -323,24 +361,29 @@ static void *thread_run_gameserver(void *data) {
 	const int port = *(int *)data;
 
 	// init server
-	if (gameserver_init(&gserver, port)) {
+	if (gameserver_init(&gserver, port, server_threads)) {
 		console_log("Failed starting Websocket server!");
 		return (void *)1;
 	}
 
+	gserver.overflow_policy = server_overflow_policy;
+
 	// register callbacks
 	gserver.callback_on_connect = server_on_connect;
 	gserver.callback_on_disconnect = server_on_disconnect;
 	gserver.callback_on_message = server_on_message;
 
 	// run
-	console_log("Websocket server on :%d...", port);
-	gameserver_listen(&gserver);
+	console_log("Websocket server on :%d with %d threads...", port, gserver.shards_len);
+	const int listen_error = gameserver_listen(&gserver);
+	if (listen_error) {
+		console_log("Failed starting the service threads!");
+	}
 
 	// destroy
 	gameserver_destroy(&gserver);
 
-	return (void *)0;
+	return (void *)(intptr_t)listen_error;
 }
 
 //
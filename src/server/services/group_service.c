@@ -12,7 +12,6 @@
 void group_service_create_lobby(struct gameserver *gserver, struct lobby_create_request *msg, struct session *requested_by) {
 	assert(msg != NULL);
 	assert(requested_by != NULL); // TODO: also support no session
-	assert(msg->lobby_id >= 0); // TODO: this is application logic...
 
 	struct lobby_create_response response;
 	message_header_init(&response.header, LOBBY_CREATE_RESPONSE);
@@ -27,19 +26,25 @@ void group_service_create_lobby(struct gameserver *gserver, struct lobby_create_
 		return;
 	}
 
+	// 0 means "in no lobby", the client picks the id.
+	if (msg->lobby_id <= 0) {
+		response.create_error = SERVER_ERROR_INVALID_LOBBY_ID;
+		gameserver_send_to(gserver, &response.header, requested_by);
+
+		return;
+	}
+
 	// Check if lobby already exists.
-	for (int i = 0; i < stbds_arrlen(gserver->sessions); ++i) {
-		struct session *s = gserver->sessions[i];
-		if ((uint32_t)msg->lobby_id == s->group_id) {
-			response.create_error = SERVER_ERROR_LOBBY_ALREADY_EXISTS;
-			gameserver_send_to(gserver, &response.header, requested_by);
+	if (gameserver_lobby_find(gserver, msg->lobby_id) != NULL) {
+		response.create_error = SERVER_ERROR_LOBBY_ALREADY_EXISTS;
+		gameserver_send_to(gserver, &response.header, requested_by);
 
-			return;
-		}
+		return;
 	}
 
 	response.create_error = 0;
-	requested_by->group_id = msg->lobby_id;
+	struct lobby *lobby = gameserver_lobby_create(gserver, msg->lobby_id);
+	gameserver_lobby_join(gserver, lobby, requested_by);
 	//messagequeue_add("#%06d created, and joined lobby %d!", requested_by->id, requested_by->group_id);
 
 	gameserver_send_to(gserver, &response.header, requested_by);
@@ -77,16 +82,11 @@ void group_service_join_lobby(struct gameserver *gserver, struct lobby_join_requ
 	}
 
 	// check if the lobby exists.
+	struct lobby *lobby = NULL;
 	int lobby_exists = (msg->lobby_id == 0); // "0" is indicates a leave and always "exists".
 	if (lobby_exists == 0) {
-		const size_t sessions_len = stbds_arrlen(gserver->sessions);
-		for (size_t i = 0; i < sessions_len; ++i) {
-			struct session *s = gserver->sessions[i];
-			if (msg->lobby_id == s->group_id) {
-				lobby_exists = 1;
-				break;
-			}
-		}
+		lobby = gameserver_lobby_find(gserver, msg->lobby_id);
+		lobby_exists = (lobby != NULL);
 	}
 
 	// lobby doesnt exist? then we cant join.
@@ -103,8 +103,14 @@ void group_service_join_lobby(struct gameserver *gserver, struct lobby_join_requ
 		goto send_response;
 	}
 
-	if (msg->lobby_id != 0) {
-		requested_by->group_id = msg->lobby_id;
+	if (lobby != NULL && stbds_arrlen(lobby->members) >= lobby->capacity) {
+		join.join_error = SERVER_ERROR_LOBBY_IS_FULL;
+		join.lobby_id = msg->lobby_id;
+		goto send_response;
+	}
+
+	if (lobby != NULL) {
+		gameserver_lobby_join(gserver, lobby, requested_by);
 	}
 
 	// lobby_id can be 0 to indicate a leave
@@ -120,8 +126,9 @@ send_response:
 		gameserver_send_filtered(gserver, &join.header, requested_by, filter_group_exclude);
 	}
 
+	// leave only after the others have been told.
 	if (msg->lobby_id == 0) {
-		requested_by->group_id = msg->lobby_id;
+		gameserver_lobby_leave(gserver, requested_by);
 	}
 }
 
@@ -130,26 +137,22 @@ send_response:
  * @param requested_by The client who requested the list.
  */
 void group_service_list_lobbies(struct gameserver *gserver, struct lobby_list_request *msg, struct session *requested_by) {
-	int sessions_len = stbds_arrlen(gserver->sessions);
-	if (sessions_len > 8) sessions_len = 8;
+	const int max_lobbies = sizeof(((struct lobby_list_response *)0)->ids_of_lobbies) / sizeof(int);
 
 	struct lobby_list_response res;
 	message_header_init(&res.header, LOBBY_LIST_RESPONSE);
 	res.ids_of_lobbies_len = 0;
-	for (int i = 0; i < sessions_len; ++i) {
-		int lobby_id = gserver->sessions[i]->group_id;
-		
-		// check if we already added lobby_id to list.
-		for (int j = 0; j < res.ids_of_lobbies_len; ++j) {
-			if (lobby_id == res.ids_of_lobbies[j]) {
-				lobby_id = 0; // already exists
-			}
-		}
 
-		if (lobby_id > 0) {
-			res.ids_of_lobbies[res.ids_of_lobbies_len] = lobby_id;
-			++res.ids_of_lobbies_len;
+	// only lobbies which can still be joined.
+	const size_t lobbies_len = stbds_hmlen(gserver->lobbies);
+	for (size_t i = 0; i < lobbies_len && res.ids_of_lobbies_len < max_lobbies; ++i) {
+		const struct lobby *lobby = gserver->lobbies[i].value;
+		if (lobby->state != LOBBY_STATE_OPEN || stbds_arrlen(lobby->members) >= lobby->capacity) {
+			continue;
 		}
+
+		res.ids_of_lobbies[res.ids_of_lobbies_len] = lobby->id;
+		++res.ids_of_lobbies_len;
 	}
 	gameserver_send_to(gserver, &res.header, requested_by);
 }
@@ -6,7 +6,10 @@
 // include all sub-services
 #include "group_service.c"
 
+// Services run on the thread of the session's shard, and hold the lock so
+// lobbies do not change halfway through a request.
 void services_dispatcher(struct gameserver *gs, struct message_header *message, struct session *session) {
+	gameserver_lock(gs);
 	switch (message->type) {
 		case LOBBY_CREATE_REQUEST:
 			group_service_create_lobby(gs, (struct lobby_create_request *)message, session);
@@ -21,6 +24,9 @@ void services_dispatcher(struct gameserver *gs, struct message_header *message,
 		case MSG_DISCONNECTED: {
 			break;
 		}
+		case WIRE_FORMAT_REQUEST:
+			// handled by the gameserver itself
+			break;
 		case WELCOME_RESPONSE:
 		case LOBBY_CREATE_RESPONSE:
 		case LOBBY_JOIN_RESPONSE:
@@ -31,5 +37,6 @@ void services_dispatcher(struct gameserver *gs, struct message_header *message,
 			// these messages are invalid
 			break;
 	}
+	gameserver_unlock(gs);
 }
 
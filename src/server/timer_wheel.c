@@ -0,0 +1,167 @@
+#include "timer_wheel.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stb_ds.h>
+
+//
+// private api
+//
+
+static void timer_wheel_push   (struct timer_wheel *, struct timer_entry);
+static void timer_wheel_process(struct timer_wheel *, struct timer_entry **slot, uint64_t up_to_tick);
+
+//
+// api
+//
+
+void timer_wheel_init(struct timer_wheel *wheel, uint64_t now_ms, uint64_t tick_ms) {
+	assert(wheel != NULL);
+	assert(tick_ms > 0);
+
+	memset(wheel, 0, sizeof(*wheel));
+	wheel->tick_ms = tick_ms;
+	wheel->current_tick = now_ms / tick_ms;
+	wheel->next_id = 1;
+}
+
+void timer_wheel_destroy(struct timer_wheel *wheel) {
+	assert(wheel != NULL);
+
+	for (int i = 0; i < TIMER_WHEEL_SLOTS; ++i) {
+		stbds_arrfree(wheel->slots[i]);
+	}
+	stbds_hmfree(wheel->scheduled);
+}
+
+uint32_t timer_wheel_schedule(struct timer_wheel *wheel, uint64_t now_ms, uint64_t delay_ms, uint64_t interval_ms, timer_fn fn, void *userdata) {
+	assert(wheel != NULL);
+	assert(fn != NULL);
+
+	struct timer_entry timer = {0};
+	timer.id = wheel->next_id++;
+	if (wheel->next_id == 0) {
+		wheel->next_id = 1;
+	}
+	// rounded up, timers never fire early.
+	timer.due_tick = (now_ms + delay_ms + wheel->tick_ms - 1) / wheel->tick_ms;
+	timer.interval_ticks = (interval_ms + wheel->tick_ms - 1) / wheel->tick_ms;
+	timer.fn = fn;
+	timer.userdata = userdata;
+
+	stbds_hmput(wheel->scheduled, timer.id, 1);
+	timer_wheel_push(wheel, timer);
+	return timer.id;
+}
+
+void timer_wheel_cancel(struct timer_wheel *wheel, uint32_t id) {
+	assert(wheel != NULL);
+	(void)stbds_hmdel(wheel->scheduled, id);
+}
+
+void timer_wheel_advance(struct timer_wheel *wheel, uint64_t now_ms) {
+	assert(wheel != NULL);
+
+	const uint64_t target_tick = now_ms / wheel->tick_ms;
+	if (target_tick <= wheel->current_tick) {
+		return;
+	}
+
+	// nothing to do while idle.
+	if (stbds_hmlen(wheel->scheduled) == 0) {
+		wheel->current_tick = target_tick;
+		return;
+	}
+
+	// after a long stall every slot is due, one pass over all of them is enough.
+	if (target_tick - wheel->current_tick >= TIMER_WHEEL_SLOTS) {
+		wheel->current_tick = target_tick;
+		for (int i = 0; i < TIMER_WHEEL_SLOTS; ++i) {
+			timer_wheel_process(wheel, &wheel->slots[i], target_tick);
+		}
+		return;
+	}
+
+	while (wheel->current_tick < target_tick) {
+		++wheel->current_tick;
+		timer_wheel_process(wheel, &wheel->slots[wheel->current_tick % TIMER_WHEEL_SLOTS], wheel->current_tick);
+	}
+}
+
+int timer_wheel_timeout_ms(struct timer_wheel *wheel, uint64_t now_ms, int max_ms) {
+	assert(wheel != NULL);
+	assert(max_ms >= 0);
+
+	if (stbds_hmlen(wheel->scheduled) == 0) {
+		return max_ms;
+	}
+
+	// the first slot holding a timer for this revolution, otherwise wake
+	// up after one revolution and look again.
+	uint64_t due_tick = wheel->current_tick + TIMER_WHEEL_SLOTS;
+	for (uint64_t tick = wheel->current_tick + 1; tick < wheel->current_tick + TIMER_WHEEL_SLOTS; ++tick) {
+		struct timer_entry *slot = wheel->slots[tick % TIMER_WHEEL_SLOTS];
+		int is_due = 0;
+		for (int i = 0; i < stbds_arrlen(slot); ++i) {
+			if (slot[i].due_tick == tick) {
+				is_due = 1;
+				break;
+			}
+		}
+
+		if (is_due) {
+			due_tick = tick;
+			break;
+		}
+	}
+
+	const uint64_t due_ms = due_tick * wheel->tick_ms;
+	if (due_ms <= now_ms) {
+		return 0;
+	}
+	return (due_ms - now_ms < (uint64_t)max_ms) ? (int)(due_ms - now_ms) : max_ms;
+}
+
+//
+// private impls
+//
+
+static void timer_wheel_push(struct timer_wheel *wheel, struct timer_entry timer) {
+	if (timer.due_tick <= wheel->current_tick) {
+		timer.due_tick = wheel->current_tick + 1;
+	}
+	stbds_arrpush(wheel->slots[timer.due_tick % TIMER_WHEEL_SLOTS], timer);
+}
+
+// Fires the timers of `slot` which are due at `up_to_tick`. Callbacks can
+// push into the same slot, so entries are always accessed by index.
+static void timer_wheel_process(struct timer_wheel *wheel, struct timer_entry **slot, uint64_t up_to_tick) {
+	int i = 0;
+	while (i < stbds_arrlen(*slot)) {
+		const struct timer_entry timer = (*slot)[i];
+
+		// cancelled
+		if (stbds_hmgeti(wheel->scheduled, timer.id) < 0) {
+			stbds_arrdelswap(*slot, i);
+			continue;
+		}
+
+		// a later revolution
+		if (timer.due_tick > up_to_tick) {
+			++i;
+			continue;
+		}
+
+		stbds_arrdelswap(*slot, i);
+		if (timer.interval_ticks > 0) {
+			struct timer_entry next = timer;
+			next.due_tick += next.interval_ticks;
+			timer_wheel_push(wheel, next);
+		} else {
+			(void)stbds_hmdel(wheel->scheduled, timer.id);
+		}
+
+		timer.fn(timer.userdata);
+	}
+}
+
@@ -0,0 +1,62 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+
+// Hashed timer wheel for scheduled server work, e.g. lobby timeouts,
+// heartbeats or periodic state pushes.
+//
+// Time is split into ticks of `tick_ms`, a timer due at tick `t` lives in
+// slot `t % TIMER_WHEEL_SLOTS`. Scheduling and cancelling are O(1), each
+// tick only looks at the timers of a single slot.
+
+//
+// types
+//
+
+#define TIMER_WHEEL_SLOTS 256
+
+typedef void (*timer_fn)(void *userdata);
+
+struct timer_entry {
+	uint32_t id;
+	uint64_t due_tick;
+	// 0 for one-shot timers.
+	uint64_t interval_ticks;
+	timer_fn fn;
+	void *userdata;
+};
+
+struct timer_wheel {
+	uint64_t tick_ms;
+	// last tick that has been processed.
+	uint64_t current_tick;
+	// stb_ds arrays
+	struct timer_entry *slots[TIMER_WHEEL_SLOTS];
+	// stb_ds hashmap of scheduled timer ids, cancelled timers are dropped
+	// lazily once their slot comes up.
+	struct { uint32_t key; int value; } *scheduled;
+	uint32_t next_id;
+};
+
+//
+// api
+//
+
+void timer_wheel_init   (struct timer_wheel *, uint64_t now_ms, uint64_t tick_ms);
+void timer_wheel_destroy(struct timer_wheel *);
+
+// Returns an id for timer_wheel_cancel(), never 0. Repeats every
+// `interval_ms` if that is greater than 0.
+uint32_t timer_wheel_schedule(struct timer_wheel *, uint64_t now_ms, uint64_t delay_ms, uint64_t interval_ms, timer_fn, void *userdata);
+void     timer_wheel_cancel  (struct timer_wheel *, uint32_t id);
+
+// Runs every timer which is due at `now_ms`. Callbacks may schedule and
+// cancel timers.
+void timer_wheel_advance(struct timer_wheel *, uint64_t now_ms);
+
+// Milliseconds until the next timer is due, at most `max_ms`.
+int timer_wheel_timeout_ms(struct timer_wheel *, uint64_t now_ms, int max_ms);
+
+#endif
+
@@ -1,5 +1,7 @@
 #include "framework/testing.h"
 #include "util/util.h"
+#include "util/heap.h"
+#include "util/spsc_queue.h"
 
 TEST(ringbuffer) {
 	RINGBUFFER(int, buffer, 4);
@@ -137,3 +139,97 @@ TEST(ringbuffer_many_writes) {
 
 	TEST_SUCCESS;
 }
+
+TEST(heap_pops_in_priority_order) {
+	struct heap heap;
+	heap_init(&heap, 8);
+
+	heap_push(&heap, 3, 30);
+	heap_push(&heap, 5, 10);
+	heap_push(&heap, 1, 20);
+	heap_push(&heap, 7, 20);
+	heap_push(&heap, 0, 50);
+	TEST_ASSERT(5 == heap.len);
+
+	// lower the priority of an id already in the heap
+	heap_decrease(&heap, 0, 5);
+
+	uint32_t priority;
+	TEST_ASSERT(0 == heap_pop(&heap, &priority));
+	TEST_ASSERT(5 == priority);
+	TEST_ASSERT(5 == heap_pop(&heap, &priority));
+	TEST_ASSERT(10 == priority);
+	// ties pop the smaller id first
+	TEST_ASSERT(1 == heap_pop(&heap, NULL));
+	TEST_ASSERT(7 == heap_pop(&heap, NULL));
+	TEST_ASSERT(3 == heap_pop(&heap, &priority));
+	TEST_ASSERT(30 == priority);
+	TEST_ASSERT(0 == heap.len);
+
+	// ids can be pushed again after popping
+	heap_push(&heap, 3, 1);
+	TEST_ASSERT(3 == heap_pop(&heap, NULL));
+
+	heap_destroy(&heap);
+	TEST_SUCCESS;
+}
+
+TEST(spsc_queue_push_and_pop) {
+	struct spsc_queue queue;
+	spsc_queue_init(&queue, 4);
+	int items[4] = { 0, 1, 2, 3 };
+
+	TEST_ASSERT(NULL == spsc_queue_pop(&queue));
+	TEST_ASSERT(!spsc_queue_is_full(&queue));
+
+	// one slot always stays empty
+	TEST_ASSERT(spsc_queue_push(&queue, &items[0]));
+	TEST_ASSERT(spsc_queue_push(&queue, &items[1]));
+	TEST_ASSERT(spsc_queue_push(&queue, &items[2]));
+	TEST_ASSERT(spsc_queue_is_full(&queue));
+	TEST_ASSERT(!spsc_queue_push(&queue, &items[3]));
+
+	TEST_ASSERT(&items[0] == spsc_queue_pop(&queue));
+	TEST_ASSERT(spsc_queue_push(&queue, &items[3]));
+	TEST_ASSERT(&items[1] == spsc_queue_pop(&queue));
+	TEST_ASSERT(&items[2] == spsc_queue_pop(&queue));
+	TEST_ASSERT(&items[3] == spsc_queue_pop(&queue));
+	TEST_ASSERT(NULL == spsc_queue_pop(&queue));
+
+	spsc_queue_destroy(&queue);
+	TEST_SUCCESS;
+}
+
+#define SPSC_QUEUE_TEST_ITEMS 100000
+
+static int spsc_queue_test_producer(void *userdata) {
+	struct spsc_queue *queue = userdata;
+	for (uintptr_t i = 1; i <= SPSC_QUEUE_TEST_ITEMS; ++i) {
+		while (!spsc_queue_push(queue, (void *)i)) {
+		}
+	}
+	return 0;
+}
+
+TEST(spsc_queue_between_threads) {
+	struct spsc_queue queue;
+	spsc_queue_init(&queue, 64);
+
+	SDL_Thread *producer = SDL_CreateThread(spsc_queue_test_producer, "producer", &queue);
+	TEST_ASSERT(producer != NULL);
+
+	// every item arrives exactly once and in order
+	uintptr_t expected = 1;
+	while (expected <= SPSC_QUEUE_TEST_ITEMS) {
+		void *item = spsc_queue_pop(&queue);
+		if (item != NULL) {
+			TEST_ASSERT((uintptr_t)item == expected);
+			++expected;
+		}
+	}
+	SDL_WaitThread(producer, NULL);
+	TEST_ASSERT(NULL == spsc_queue_pop(&queue));
+
+	spsc_queue_destroy(&queue);
+	TEST_SUCCESS;
+}
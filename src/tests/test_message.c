@@ -0,0 +1,205 @@
+#include "framework/testing.h"
+
+#include <string.h>
+#include "net/message.h"
+#include "net/message_stream.h"
+
+TEST(message_binary_roundtrip) {
+	struct lobby_create_request create;
+	message_header_init(&create.header, LOBBY_CREATE_REQUEST);
+	create.lobby_id = -1234567;
+	create.lobby_name = "my lobby";
+
+	uint8_t frame[64];
+	const size_t frame_len = message_binary_encode(&create.header, frame, sizeof(frame));
+	TEST_ASSERT(frame_len > 0);
+	TEST_ASSERT(frame_len == message_binary_size(&create.header));
+	TEST_ASSERT(frame[0] == MESSAGE_BINARY_MAGIC);
+
+	message_buffer_t buffer;
+	struct message_header *decoded = NULL;
+	size_t decoded_len = 0;
+	TEST_ASSERT(message_binary_decode(frame, frame_len, &decoded_len, &buffer, &decoded) == MESSAGE_DECODE_OK);
+	TEST_ASSERT(decoded_len == frame_len);
+	TEST_ASSERT(decoded->type == LOBBY_CREATE_REQUEST);
+	struct lobby_create_request *decoded_create = (struct lobby_create_request *)decoded;
+	TEST_ASSERT(decoded_create->lobby_id == -1234567);
+	TEST_ASSERT(strcmp(decoded_create->lobby_name, "my lobby") == 0);
+
+	struct lobby_list_response list;
+	message_header_init(&list.header, LOBBY_LIST_RESPONSE);
+	list.ids_of_lobbies_len = 3;
+	list.ids_of_lobbies[0] = 1;
+	list.ids_of_lobbies[1] = 300;
+	list.ids_of_lobbies[2] = 2147483647;
+	const size_t list_len = message_binary_encode(&list.header, frame, sizeof(frame));
+	TEST_ASSERT(list_len > 0);
+	TEST_ASSERT(message_binary_decode(frame, list_len, &decoded_len, &buffer, &decoded) == MESSAGE_DECODE_OK);
+	struct lobby_list_response *decoded_list = (struct lobby_list_response *)decoded;
+	TEST_ASSERT(decoded_list->ids_of_lobbies_len == 3);
+	TEST_ASSERT(decoded_list->ids_of_lobbies[1] == 300);
+	TEST_ASSERT(decoded_list->ids_of_lobbies[2] == 2147483647);
+
+	TEST_SUCCESS;
+}
+
+TEST(message_binary_rejects_broken_frames) {
+	struct lobby_list_response list;
+	message_header_init(&list.header, LOBBY_LIST_RESPONSE);
+	list.ids_of_lobbies_len = 2;
+	list.ids_of_lobbies[0] = 5;
+	list.ids_of_lobbies[1] = 6;
+
+	uint8_t frame[64];
+	const size_t frame_len = message_binary_encode(&list.header, frame, sizeof(frame));
+	TEST_ASSERT(frame_len > 0);
+	TEST_ASSERT(message_binary_encode(&list.header, frame, frame_len - 1) == 0);
+
+	message_buffer_t buffer;
+	struct message_header *decoded = NULL;
+	size_t decoded_len = 0;
+
+	// every prefix is incomplete
+	for (size_t len = 0; len < frame_len; ++len) {
+		TEST_ASSERT(message_binary_decode(frame, len, &decoded_len, &buffer, &decoded) == MESSAGE_DECODE_INCOMPLETE);
+	}
+
+	// more lobbies than fit into the struct
+	uint8_t too_many[64];
+	memcpy(too_many, frame, frame_len);
+	too_many[3] = 9;
+	TEST_ASSERT(message_binary_decode(too_many, frame_len, &decoded_len, &buffer, &decoded) == MESSAGE_DECODE_INVALID);
+
+	// json is not a binary frame
+	TEST_ASSERT(message_binary_decode((const uint8_t *)"{}", 2, &decoded_len, &buffer, &decoded) == MESSAGE_DECODE_INVALID);
+
+	TEST_SUCCESS;
+}
+
+TEST(message_stream_reassembles_frames) {
+	struct lobby_join_request join;
+	message_header_init(&join.header, LOBBY_JOIN_REQUEST);
+	join.lobby_id = 42;
+	uint8_t binary[32];
+	const size_t binary_len = message_binary_encode(&join.header, binary, sizeof(binary));
+	const char *json = "{\"header\":{\"type\":1},\"lobby_name\":\"}{\\\"\"}";
+
+	// a binary frame and a json object, both split across every byte.
+	struct message_stream stream;
+	message_stream_init(&stream);
+	const uint8_t *frame = NULL;
+	size_t frame_len = 0;
+	for (size_t i = 0; i < binary_len; ++i) {
+		TEST_ASSERT(message_stream_next(&stream, &frame, &frame_len) == MESSAGE_DECODE_INCOMPLETE);
+		message_stream_append(&stream, &binary[i], 1);
+	}
+	for (size_t i = 0; i < strlen(json); ++i) {
+		message_stream_append(&stream, &json[i], 1);
+	}
+
+	TEST_ASSERT(message_stream_next(&stream, &frame, &frame_len) == MESSAGE_DECODE_OK);
+	TEST_ASSERT(frame_len == binary_len);
+	TEST_ASSERT(memcmp(frame, binary, binary_len) == 0);
+	TEST_ASSERT(message_stream_next(&stream, &frame, &frame_len) == MESSAGE_DECODE_OK);
+	TEST_ASSERT(frame_len == strlen(json));
+	TEST_ASSERT(message_stream_next(&stream, &frame, &frame_len) == MESSAGE_DECODE_INCOMPLETE);
+	TEST_ASSERT(message_stream_pending(&stream) == 0);
+
+	// larger than the initial capacity
+	static char large[20000];
+	memset(large, ' ', sizeof(large));
+	large[0] = '{';
+	large[sizeof(large) - 1] = '}';
+	message_stream_append(&stream, large, sizeof(large));
+	TEST_ASSERT(message_stream_next(&stream, &frame, &frame_len) == MESSAGE_DECODE_OK);
+	TEST_ASSERT(frame_len == sizeof(large));
+
+	message_stream_destroy(&stream);
+	TEST_SUCCESS;
+}
+
+TEST(message_stream_resumes_json_scan) {
+	const char *json = "{\"header\":{\"type\":1},\"lobby_name\":\"}{\\\\\\\"\"}";
+	struct message_stream stream;
+	message_stream_init(&stream);
+	const uint8_t *frame = NULL;
+	size_t frame_len = 0;
+
+	// asked after every byte, the scan continues where it stopped.
+	for (int round = 0; round < 2; ++round) {
+		for (size_t i = 0; i < strlen(json); ++i) {
+			TEST_ASSERT(message_stream_next(&stream, &frame, &frame_len) == MESSAGE_DECODE_INCOMPLETE);
+			message_stream_append(&stream, &json[i], 1);
+		}
+		TEST_ASSERT(message_stream_next(&stream, &frame, &frame_len) == MESSAGE_DECODE_OK);
+		TEST_ASSERT(frame_len == strlen(json));
+		TEST_ASSERT(memcmp(frame, json, frame_len) == 0);
+	}
+
+	// clearing drops a half scanned frame.
+	message_stream_append(&stream, "{\"a\":\"{", 7);
+	TEST_ASSERT(message_stream_next(&stream, &frame, &frame_len) == MESSAGE_DECODE_INCOMPLETE);
+	message_stream_clear(&stream);
+	message_stream_append(&stream, "{}", 2);
+	TEST_ASSERT(message_stream_next(&stream, &frame, &frame_len) == MESSAGE_DECODE_OK);
+	TEST_ASSERT(frame_len == 2);
+
+	message_stream_destroy(&stream);
+	TEST_SUCCESS;
+}
+
+TEST(message_stream_rejects_oversize_frames) {
+	struct message_stream stream;
+	message_stream_init(&stream);
+	const uint8_t *frame = NULL;
+	size_t frame_len = 0;
+
+	// never closed
+	static char unclosed[MESSAGE_MAX_FRAME_LEN];
+	memset(unclosed, ' ', sizeof(unclosed));
+	unclosed[0] = '{';
+	message_stream_append(&stream, unclosed, sizeof(unclosed) - 1);
+	TEST_ASSERT(message_stream_next(&stream, &frame, &frame_len) == MESSAGE_DECODE_INCOMPLETE);
+	message_stream_append(&stream, " ", 1);
+	TEST_ASSERT(message_stream_next(&stream, &frame, &frame_len) == MESSAGE_DECODE_INVALID);
+
+	// binary payload above the limit
+	message_stream_clear(&stream);
+	const uint8_t too_large[] = { MESSAGE_BINARY_MAGIC, 0xFF, 0xFF, 0x7F };
+	message_stream_append(&stream, too_large, sizeof(too_large));
+	TEST_ASSERT(message_stream_next(&stream, &frame, &frame_len) == MESSAGE_DECODE_INVALID);
+
+	// neither json nor binary
+	message_stream_clear(&stream);
+	message_stream_append(&stream, "hello", 5);
+	TEST_ASSERT(message_stream_next(&stream, &frame, &frame_len) == MESSAGE_DECODE_INVALID);
+
+	message_stream_destroy(&stream);
+	TEST_SUCCESS;
+}
+
+TEST(unpack_message_rejects_malformed_json) {
+	const char *malformed[] = {
+		"{\"header\":{}}",
+		"{\"header\":{\"type\":4}}",
+		"{\"header\":{\"type\":4},\"lobby_id\":\"5\"}",
+		"{\"header\":{\"type\":-1}}",
+		"{\"header\":{\"type\":100000}}",
+	};
+	for (size_t i = 0; i < sizeof(malformed) / sizeof(*malformed); ++i) {
+		cJSON *json = cJSON_Parse(malformed[i]);
+		TEST_ASSERT(json != NULL);
+		TEST_ASSERT(unpack_message(json) == NULL);
+		cJSON_Delete(json);
+	}
+
+	// fields added later may be missing
+	cJSON *welcome = cJSON_Parse("{\"header\":{\"type\":1},\"_dummy\":0}");
+	struct message_header *message = unpack_message(welcome);
+	TEST_ASSERT(message != NULL);
+	TEST_ASSERT(((struct welcome_response *)message)->wire_formats == (1 << MESSAGE_WIRE_JSON));
+	free_message(welcome, message);
+
+	TEST_SUCCESS;
+}
+
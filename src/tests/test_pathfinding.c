@@ -1,6 +1,13 @@
 #include "framework/testing.h"
 
 #include "util/util.h"
+#include "util/arena.h"
+#include "game/hexmap.h"
+#include "game/hexmap_hpa.h"
+#include "game/hexmap_cache.h"
+#include "game/hexmap_batch.h"
+#include "game/hexmap_visibility.h"
+#include "util/bitset.h"
 
 struct edge {
 	float weight;
@@ -96,3 +103,582 @@ TEST(pathfinding) {
 	TEST_SUCCESS;
 }
 
+// slow but obviously correct reference for the cheapest path cost
+static usize reference_path_cost(struct hexmap *map, struct hexcoord start, struct hexcoord goal) {
+	const usize n = (usize)map->w * map->h;
+	usize cost[n];
+	int done[n];
+	for (usize i = 0; i < n; ++i) {
+		cost[i] = (usize)-1;
+		done[i] = 0;
+	}
+	cost[hexmap_coord_to_index(map, start)] = 0;
+
+	for (;;) {
+		usize current = (usize)-1;
+		for (usize i = 0; i < n; ++i) {
+			if (!done[i] && cost[i] != (usize)-1 && (current == (usize)-1 || cost[i] < cost[current])) {
+				current = i;
+			}
+		}
+		if (current == (usize)-1) break;
+		done[current] = 1;
+
+		const struct hexcoord current_coord = hexmap_index_to_coord(map, current);
+		for (enum hexmap_neighbor d = HEXMAP_N_FIRST; d <= HEXMAP_N_LAST; ++d) {
+			struct hexcoord next = hexmap_get_neighbor_coord(map, current_coord, d);
+			if (!hexmap_is_valid_coord(map, next) || hexmap_is_tile_obstacle(map, next)) continue;
+
+			const usize next_i = hexmap_coord_to_index(map, next);
+			const usize next_cost = cost[current] + map->movement_cost[next_i];
+			if (next_cost < cost[next_i]) {
+				cost[next_i] = next_cost;
+			}
+		}
+	}
+
+	return cost[hexmap_coord_to_index(map, goal)];
+}
+
+TEST(hexmap_weighted_path_avoids_expensive_tiles) {
+	struct hexmap map;
+	hexmap_init(&map, 5, 3);
+
+	// a swamp in the middle row, the direct route costs more than going around
+	for (int x = 1; x < 4; ++x) {
+		hexmap_set_movement_cost(&map, (struct hexcoord){ .x=x, .y=1 }, 10);
+	}
+
+	struct hexcoord start = { .x=0, .y=1 };
+	struct hexcoord goal  = { .x=4, .y=1 };
+
+	struct hexmap_path path;
+	TEST_ASSERT(HEXMAP_PATH_OK == hexmap_path_find(&map, start, goal, &path));
+	TEST_ASSERT(reference_path_cost(&map, start, goal) == path.cost);
+	for (usize i = 0; i < path.distance_in_tiles; ++i) {
+		TEST_ASSERT(map.movement_cost[hexmap_path_at(&path, i)] == 1);
+	}
+	hexmap_path_destroy(&path);
+
+	// breadth first search takes the direct route
+	TEST_ASSERT(HEXMAP_PATH_OK == hexmap_path_find_ex(&map, start, goal, PATH_FLAGS_UNWEIGHTED, &path));
+	TEST_ASSERT(4 == path.distance_in_tiles);
+	hexmap_path_destroy(&path);
+
+	hexmap_destroy(&map);
+	TEST_SUCCESS;
+}
+
+TEST(hexmap_weighted_path_is_optimal) {
+	rng_seed(31);
+
+	struct hexmap map;
+	hexmap_init(&map, 13, 9);
+
+	for (int round = 0; round < 20; ++round) {
+		for (int i = 0; i < map.w * map.h; ++i) {
+			hexmap_set_movement_cost(&map, hexmap_index_to_coord(&map, i), (rng_f() < 0.2f) ? HEXMAP_MOVEMENT_COST_MAX : 1 + rng_i() % 5);
+		}
+
+		struct hexcoord start = { .x = rng_i() % map.w, .y = rng_i() % map.h };
+		struct hexcoord goal  = { .x = rng_i() % map.w, .y = rng_i() % map.h };
+		hexmap_set_movement_cost(&map, start, 1);
+		hexmap_set_movement_cost(&map, goal, 1);
+
+		const usize expected = reference_path_cost(&map, start, goal);
+
+		struct hexmap_path path;
+		enum hexmap_path_result result = hexmap_path_find(&map, start, goal, &path);
+		if (expected == (usize)-1) {
+			TEST_ASSERT(HEXMAP_PATH_OK != result);
+		} else {
+			TEST_ASSERT(HEXMAP_PATH_OK == result);
+			TEST_ASSERT(expected == path.cost);
+		}
+		hexmap_path_destroy(&path);
+	}
+
+	hexmap_destroy(&map);
+	TEST_SUCCESS;
+}
+
+TEST(hexmap_find_neighbor_stops_next_to_goal) {
+	struct hexmap map;
+	hexmap_init(&map, 6, 6);
+
+	struct hexcoord start = { .x=0, .y=0 };
+	struct hexcoord goal  = { .x=4, .y=4 };
+	hexmap_set_occupied_by(&map, goal, 1);
+
+	struct hexmap_path path;
+	TEST_ASSERT(HEXMAP_PATH_OK == hexmap_path_find_ex(&map, start, goal, PATH_FLAGS_FIND_NEIGHBOR, &path));
+	TEST_ASSERT(1 == hexcoord_distance(path.goal, goal));
+	TEST_ASSERT(hexcoord_distance(start, goal) - 1 == (int)path.distance_in_tiles);
+	hexmap_path_destroy(&path);
+
+	hexmap_destroy(&map);
+	TEST_SUCCESS;
+}
+TEST(hexmap_path_find_with_reuses_workspace) {
+	rng_seed(32);
+
+	struct hexmap map;
+	hexmap_init(&map, 11, 11);
+	for (int i = 0; i < map.w * map.h; ++i) {
+		hexmap_set_movement_cost(&map, hexmap_index_to_coord(&map, i), (rng_f() < 0.15f) ? HEXMAP_MOVEMENT_COST_MAX : 1 + rng_i() % 3);
+	}
+
+	struct hexmap_path_workspace ws;
+	hexmap_path_workspace_init(&ws, map.w * map.h);
+	// stamps wrap around during the test
+	ws.generation = UINT32_MAX - 8;
+
+	struct arena arena;
+	arena_init(&arena, 256);
+
+	for (int i = 0; i < 64; ++i) {
+		struct hexcoord start = { .x = rng_i() % map.w, .y = rng_i() % map.h };
+		struct hexcoord goal  = { .x = rng_i() % map.w, .y = rng_i() % map.h };
+		const enum path_find_flags flags = (i % 2) ? PATH_FLAGS_UNWEIGHTED : PATH_FLAGS_NONE;
+
+		struct hexmap_path expected, path;
+		enum hexmap_path_result expected_result = hexmap_path_find_ex(&map, start, goal, flags, &expected);
+		TEST_ASSERT(expected_result == hexmap_path_find_with(&map, &ws, &arena, start, goal, flags, &path));
+		TEST_ASSERT(!path.owns_tiles);
+		TEST_ASSERT(expected.cost == path.cost);
+		TEST_ASSERT(expected.distance_in_tiles == path.distance_in_tiles);
+		for (usize t = 0; t < path.distance_in_tiles; ++t) {
+			TEST_ASSERT(hexmap_path_at(&expected, t) == hexmap_path_at(&path, t));
+		}
+		hexmap_path_destroy(&expected);
+		hexmap_path_destroy(&path);
+
+		if (i % 16 == 15) {
+			arena_reset(&arena);
+		}
+	}
+
+	arena_destroy(&arena);
+	hexmap_path_workspace_destroy(&ws);
+	hexmap_destroy(&map);
+	TEST_SUCCESS;
+}
+
+TEST(hexmap_large_map_neighbors) {
+	struct hexmap map;
+	hexmap_init(&map, 1024, 1024);
+
+	// implicit neighbors match hexmap_get_neighbor_coord()
+	const struct hexcoord coords[] = { {0, 0}, {1023, 0}, {0, 1023}, {1023, 1023}, {17, 500}, {17, 501} };
+	for (usize c = 0; c < count_of(coords); ++c) {
+		usize neighbors[HEXMAP_MAX_NEIGHBORS];
+		usize neighbors_len = hexmap_neighbors(&map, hexmap_coord_to_index(&map, coords[c]), neighbors);
+
+		usize expected_len = 0;
+		for (enum hexmap_neighbor d = HEXMAP_N_FIRST; d <= HEXMAP_N_LAST; ++d) {
+			struct hexcoord n = hexmap_get_neighbor_coord(&map, coords[c], d);
+			if (!hexmap_is_valid_coord(&map, n)) continue;
+			TEST_ASSERT(expected_len < neighbors_len);
+			TEST_ASSERT(hexmap_coord_to_index(&map, n) == neighbors[expected_len]);
+			TEST_ASSERT(1 == hexcoord_distance(coords[c], n));
+			++expected_len;
+		}
+		TEST_ASSERT(expected_len == neighbors_len);
+	}
+
+	// across the whole map, without obstacles the path is as long as the distance
+	struct hexcoord start = { .x=3, .y=2 };
+	struct hexcoord goal  = { .x=1020, .y=1021 };
+	struct hexmap_path path;
+	TEST_ASSERT(HEXMAP_PATH_OK == hexmap_path_find(&map, start, goal, &path));
+	TEST_ASSERT((usize)hexcoord_distance(start, goal) == path.distance_in_tiles);
+	hexmap_path_destroy(&path);
+
+	// obstacles show up in the bitset
+	hexmap_set_movement_cost(&map, goal, HEXMAP_MOVEMENT_COST_MAX);
+	TEST_ASSERT(hexmap_is_tile_obstacle(&map, goal));
+	hexmap_set_movement_cost(&map, goal, 1);
+	hexmap_set_occupied_by(&map, goal, 42);
+	TEST_ASSERT(hexmap_is_tile_obstacle(&map, goal));
+	hexmap_set_occupied_by(&map, goal, 0);
+	TEST_ASSERT(!hexmap_is_tile_obstacle(&map, goal));
+
+	hexmap_destroy(&map);
+	TEST_SUCCESS;
+}
+
+TEST(hexmap_hpa_matches_flat_search) {
+	rng_seed(34);
+
+	struct hexmap map;
+	hexmap_init(&map, 48, 40);
+	for (int i = 0; i < map.w * map.h; ++i) {
+		hexmap_set_movement_cost(&map, hexmap_index_to_coord(&map, i), (rng_f() < 0.2f) ? HEXMAP_MOVEMENT_COST_MAX : 1 + rng_i() % 4);
+	}
+
+	const int cluster_size = 8;
+	struct hexmap_hpa hpa;
+	hexmap_hpa_init(&hpa, &map, cluster_size);
+
+	usize flat_cost_sum = 0, hpa_cost_sum = 0;
+	for (int query = 0; query < 200; ++query) {
+		// change some tiles, the hierarchy has to catch up on its own
+		if (query % 25 == 0) {
+			for (int i = 0; i < 20; ++i) {
+				struct hexcoord coord = { .x = rng_i() % map.w, .y = rng_i() % map.h };
+				hexmap_set_movement_cost(&map, coord, (rng_f() < 0.3f) ? HEXMAP_MOVEMENT_COST_MAX : 1 + rng_i() % 4);
+			}
+			for (int i = 0; i < 10; ++i) {
+				struct hexcoord coord = { .x = rng_i() % map.w, .y = rng_i() % map.h };
+				hexmap_set_occupied_by(&map, coord, (rng_f() < 0.5f) ? 7 : 0);
+			}
+		}
+
+		struct hexcoord start = { .x = rng_i() % map.w, .y = rng_i() % map.h };
+		struct hexcoord goal  = { .x = rng_i() % map.w, .y = rng_i() % map.h };
+
+		struct hexmap_path flat, hierarchical;
+		enum hexmap_path_result flat_result = hexmap_path_find(&map, start, goal, &flat);
+		TEST_ASSERT(flat_result == hexmap_hpa_path_find(&hpa, start, goal, &hierarchical));
+
+		if (flat_result == HEXMAP_PATH_OK) {
+			// a walkable path of the reported cost, ending at the goal
+			usize cost = 0;
+			struct hexcoord previous = start;
+			for (usize i = 0; i < hierarchical.distance_in_tiles; ++i) {
+				struct hexcoord coord = hexmap_index_to_coord(&map, hexmap_path_at(&hierarchical, i));
+				TEST_ASSERT(1 == hexcoord_distance(previous, coord));
+				TEST_ASSERT(!hexmap_is_tile_obstacle(&map, coord));
+				cost += hexmap_movement_cost(&map, coord);
+				previous = coord;
+			}
+			TEST_ASSERT(hexcoord_equal(previous, goal));
+			TEST_ASSERT(cost == hierarchical.cost);
+
+			// bounded suboptimality
+			TEST_ASSERT(hierarchical.cost >= flat.cost);
+			TEST_ASSERT(hierarchical.cost <= 2 * flat.cost + cluster_size);
+			flat_cost_sum += flat.cost;
+			hpa_cost_sum += hierarchical.cost;
+		}
+
+		hexmap_path_destroy(&flat);
+		hexmap_path_destroy(&hierarchical);
+	}
+	// on average within 20% of the optimum
+	TEST_ASSERT(hpa_cost_sum * 10 <= flat_cost_sum * 12);
+
+	hexmap_hpa_destroy(&hpa);
+	hexmap_destroy(&map);
+	TEST_SUCCESS;
+}
+
+TEST(hexmap_cache_invalidates_on_board_change) {
+	struct hexmap map;
+	hexmap_init(&map, 8, 8);
+	struct hexmap_cache cache;
+	hexmap_cache_init(&cache, &map, 4);
+
+	struct hexcoord start = { .x=0, .y=0 };
+	struct hexcoord goal  = { .x=6, .y=5 };
+
+	struct hexmap_path first, second;
+	TEST_ASSERT(HEXMAP_PATH_OK == hexmap_cache_path_find(&cache, start, goal, PATH_FLAGS_NONE, &first));
+	TEST_ASSERT(HEXMAP_PATH_OK == hexmap_cache_path_find(&cache, start, goal, PATH_FLAGS_NONE, &second));
+	TEST_ASSERT(1 == cache.misses && 1 == cache.hits);
+	TEST_ASSERT(first.cost == second.cost && first.tiles != second.tiles);
+	for (usize i = 0; i < first.distance_in_tiles; ++i) {
+		TEST_ASSERT(hexmap_path_at(&first, i) == hexmap_path_at(&second, i));
+	}
+	hexmap_path_destroy(&second);
+
+	// unchanged values keep the cache valid
+	const uint64_t version = map.version;
+	hexmap_set_movement_cost(&map, start, hexmap_movement_cost(&map, start));
+	TEST_ASSERT(version == map.version);
+
+	// blocking a tile on the path forces a new search
+	struct hexcoord on_path = hexmap_index_to_coord(&map, hexmap_path_at(&first, 1));
+	hexmap_set_occupied_by(&map, on_path, 1);
+	TEST_ASSERT(version != map.version);
+	TEST_ASSERT(HEXMAP_PATH_OK == hexmap_cache_path_find(&cache, start, goal, PATH_FLAGS_NONE, &second));
+	TEST_ASSERT(2 == cache.misses);
+	for (usize i = 0; i < second.distance_in_tiles; ++i) {
+		TEST_ASSERT(!hexcoord_equal(on_path, hexmap_index_to_coord(&map, hexmap_path_at(&second, i))));
+	}
+	hexmap_path_destroy(&first);
+	hexmap_path_destroy(&second);
+
+	// flowfields are shared until the board changes again
+	const usize *flowfield = hexmap_cache_flowfield(&cache, start);
+	TEST_ASSERT(flowfield == hexmap_cache_flowfield(&cache, start));
+	TEST_ASSERT(3 == cache.misses && 2 == cache.hits);
+	TEST_ASSERT(hexmap_cache_hit_rate(&cache) > 0.39f && hexmap_cache_hit_rate(&cache) < 0.41f);
+
+	hexmap_cache_destroy(&cache);
+	hexmap_destroy(&map);
+	TEST_SUCCESS;
+}
+
+TEST(hexmap_dijkstra_map_matches_reference) {
+	rng_seed(36);
+
+	struct hexmap map;
+	hexmap_init(&map, 13, 9);
+	const usize map_size = (usize)map.w * map.h;
+	uint32_t dijkstra_map[map_size];
+
+	for (int round = 0; round < 10; ++round) {
+		for (usize i = 0; i < map_size; ++i) {
+			hexmap_set_movement_cost(&map, hexmap_index_to_coord(&map, i), (rng_f() < 0.2f) ? HEXMAP_MOVEMENT_COST_MAX : 1 + rng_i() % 5);
+		}
+		struct hexmap_dijkstra_source sources[3];
+		for (usize s = 0; s < count_of(sources); ++s) {
+			sources[s].coord = (struct hexcoord){ .x = rng_i() % map.w, .y = rng_i() % map.h };
+			sources[s].cost = rng_i() % 8;
+			hexmap_set_movement_cost(&map, sources[s].coord, 1);
+		}
+
+		hexmap_generate_dijkstra_map(&map, count_of(sources), sources, map_size, dijkstra_map);
+		for (usize i = 0; i < map_size; ++i) {
+			const struct hexcoord coord = hexmap_index_to_coord(&map, i);
+			if (hexmap_is_tile_obstacle(&map, coord)) continue;
+
+			usize expected = (usize)-1;
+			for (usize s = 0; s < count_of(sources); ++s) {
+				const usize cost = reference_path_cost(&map, coord, sources[s].coord);
+				if (cost != (usize)-1 && cost + sources[s].cost < expected) {
+					expected = cost + sources[s].cost;
+				}
+			}
+			if (expected == (usize)-1) {
+				TEST_ASSERT(HEXMAP_DIJKSTRA_UNREACHABLE == dijkstra_map[i]);
+			} else {
+				TEST_ASSERT(expected == dijkstra_map[i]);
+			}
+		}
+	}
+
+	hexmap_destroy(&map);
+	TEST_SUCCESS;
+}
+
+TEST(hexmap_dijkstra_map_path_approaches_source) {
+	struct hexmap map;
+	hexmap_init(&map, 9, 9);
+	const usize map_size = (usize)map.w * map.h;
+	uint32_t dijkstra_map[map_size];
+
+	// both units block their tiles
+	struct hexcoord player = { .x=1, .y=1 };
+	struct hexcoord enemy  = { .x=7, .y=6 };
+	hexmap_set_occupied_by(&map, player, 1);
+	hexmap_set_occupied_by(&map, enemy, 2);
+
+	struct hexmap_dijkstra_source source = { .coord = player, .cost = 0 };
+	hexmap_generate_dijkstra_map(&map, 1, &source, map_size, dijkstra_map);
+	TEST_ASSERT(HEXMAP_DIJKSTRA_UNREACHABLE != dijkstra_map[hexmap_coord_to_index(&map, enemy)]);
+
+	struct hexmap_path path;
+	TEST_ASSERT(HEXMAP_PATH_OK == hexmap_dijkstra_map_path(&map, dijkstra_map, enemy, 3, &path));
+	TEST_ASSERT(3 == path.distance_in_tiles);
+	TEST_ASSERT(3 == path.cost);
+	TEST_ASSERT(hexcoord_distance(path.goal, player) == hexcoord_distance(enemy, player) - 3);
+	struct hexcoord previous = enemy;
+	for (usize i = 0; i < path.distance_in_tiles; ++i) {
+		struct hexcoord coord = hexmap_index_to_coord(&map, hexmap_path_at(&path, i));
+		TEST_ASSERT(1 == hexcoord_distance(previous, coord));
+		TEST_ASSERT(!hexmap_is_tile_obstacle(&map, coord));
+		previous = coord;
+	}
+	TEST_ASSERT(hexcoord_equal(previous, path.goal));
+	hexmap_path_destroy(&path);
+
+	// next to the player there is nowhere closer to go
+	struct hexcoord next_to_player = hexmap_get_neighbor_coord(&map, player, HEXMAP_E);
+	TEST_ASSERT(HEXMAP_PATH_ERROR == hexmap_dijkstra_map_path(&map, dijkstra_map, next_to_player, 3, &path));
+	hexmap_path_destroy(&path);
+
+	hexmap_destroy(&map);
+	TEST_SUCCESS;
+}
+
+TEST(hexmap_path_find_batch_matches_single_queries) {
+	rng_seed(37);
+
+	struct hexmap map;
+	hexmap_init(&map, 32, 24);
+	for (int i = 0; i < map.w * map.h; ++i) {
+		hexmap_set_movement_cost(&map, hexmap_index_to_coord(&map, i), (rng_f() < 0.2f) ? HEXMAP_MOVEMENT_COST_MAX : 1 + rng_i() % 5);
+	}
+
+	struct hexmap_path_request requests[200];
+	for (usize i = 0; i < count_of(requests); ++i) {
+		requests[i].start = (struct hexcoord){ .x = rng_i() % map.w, .y = rng_i() % map.h };
+		requests[i].goal  = (struct hexcoord){ .x = rng_i() % map.w, .y = rng_i() % map.h };
+		requests[i].flags = (i % 3 == 0) ? PATH_FLAGS_FIND_NEIGHBOR : PATH_FLAGS_NONE;
+	}
+
+	// the same results with and without worker threads
+	for (int threads_len = 0; threads_len <= 3; threads_len += 3) {
+		struct hexmap_path_workers workers;
+		hexmap_path_workers_init(&workers, threads_len);
+
+		struct hexmap_path results[count_of(requests)];
+		hexmap_path_find_batch(&workers, &map, count_of(requests), requests, results);
+
+		for (usize i = 0; i < count_of(requests); ++i) {
+			struct hexmap_path expected;
+			hexmap_path_find_ex(&map, requests[i].start, requests[i].goal, requests[i].flags, &expected);
+			TEST_ASSERT(expected.result == results[i].result);
+			TEST_ASSERT(expected.cost == results[i].cost);
+			TEST_ASSERT(expected.distance_in_tiles == results[i].distance_in_tiles);
+			for (usize t = 0; t < expected.distance_in_tiles; ++t) {
+				TEST_ASSERT(hexmap_path_at(&expected, t) == hexmap_path_at(&results[i], t));
+			}
+			hexmap_path_destroy(&expected);
+			hexmap_path_destroy(&results[i]);
+		}
+
+		hexmap_path_workers_destroy(&workers);
+	}
+
+	hexmap_destroy(&map);
+	TEST_SUCCESS;
+}
+
+TEST(hexmap_visibility_blocked_by_obstacles) {
+	struct hexmap map;
+	hexmap_init(&map, 7, 7);
+	struct hexmap_visibility vis;
+	hexmap_visibility_init(&vis, &map, 4);
+
+	struct hexcoord viewer = { .x=0, .y=3 };
+	struct hexcoord wall   = { .x=2, .y=3 };
+	struct hexcoord behind = { .x=4, .y=3 };
+	TEST_ASSERT(hexmap_visibility_can_see(&vis, viewer, behind));
+
+	// the wall itself stays visible, the tile behind it does not
+	hexmap_set_movement_cost(&map, wall, HEXMAP_MOVEMENT_COST_MAX);
+	TEST_ASSERT(hexmap_visibility_can_see(&vis, viewer, wall));
+	TEST_ASSERT(!hexmap_visibility_can_see(&vis, viewer, behind));
+
+	hexmap_set_movement_cost(&map, wall, 1);
+	TEST_ASSERT(hexmap_visibility_can_see(&vis, viewer, behind));
+
+	hexmap_visibility_destroy(&vis);
+	hexmap_destroy(&map);
+	TEST_SUCCESS;
+}
+
+TEST(hexmap_visibility_matches_line_of_sight) {
+	rng_seed(38);
+
+	struct hexmap map;
+	hexmap_init(&map, 20, 16);
+	const usize map_size = (usize)map.w * map.h;
+	for (usize i = 0; i < map_size; ++i) {
+		if (rng_f() < 0.25f) {
+			hexmap_set_movement_cost(&map, hexmap_index_to_coord(&map, i), HEXMAP_MOVEMENT_COST_MAX);
+		}
+	}
+
+	struct hexmap_visibility vis;
+	const int radius = 5;
+	hexmap_visibility_init(&vis, &map, radius);
+	uint64_t fov[bitset_words(map_size)];
+
+	for (int round = 0; round < 8; ++round) {
+		// queries beyond the radius fall back to tracing the line
+		for (usize a = 0; a < map_size; ++a) {
+			const struct hexcoord from = hexmap_index_to_coord(&map, a);
+			for (usize b = 0; b < map_size; ++b) {
+				const struct hexcoord to = hexmap_index_to_coord(&map, b);
+				if (hexcoord_distance(from, to) > radius + 2) continue;
+				TEST_ASSERT(hexmap_has_line_of_sight(&map, from, to) == hexmap_visibility_can_see(&vis, from, to));
+			}
+		}
+
+		struct hexcoord viewers[3];
+		for (usize v = 0; v < count_of(viewers); ++v) {
+			viewers[v] = hexmap_index_to_coord(&map, rng_i() % map_size);
+		}
+		hexmap_visibility_field_of_view(&vis, count_of(viewers), viewers, fov);
+		for (usize t = 0; t < map_size; ++t) {
+			const struct hexcoord target = hexmap_index_to_coord(&map, t);
+			int expected = 0;
+			for (usize v = 0; v < count_of(viewers); ++v) {
+				if (hexcoord_distance(viewers[v], target) <= radius && hexmap_has_line_of_sight(&map, viewers[v], target)) {
+					expected = 1;
+				}
+			}
+			TEST_ASSERT(expected == bitset_get(fov, t));
+		}
+
+		// move some obstacles and units around
+		for (int change = 0; change < 10; ++change) {
+			const struct hexcoord coord = hexmap_index_to_coord(&map, rng_i() % map_size);
+			if (rng_f() < 0.5f) {
+				hexmap_set_movement_cost(&map, coord, hexmap_is_tile_obstacle(&map, coord) ? 1 : HEXMAP_MOVEMENT_COST_MAX);
+			} else {
+				hexmap_set_occupied_by(&map, coord, hexmap_occupied_by(&map, coord) ? 0 : 1);
+			}
+		}
+	}
+
+	hexmap_visibility_destroy(&vis);
+	hexmap_destroy(&map);
+	TEST_SUCCESS;
+}
+
+TEST(hexmap_flowfield_update_matches_rebuild) {
+	rng_seed(40);
+
+	struct hexmap map;
+	hexmap_init(&map, 24, 18);
+	const usize map_size = (usize)map.w * map.h;
+	for (usize i = 0; i < map_size; ++i) {
+		if (rng_f() < 0.2f) {
+			hexmap_set_movement_cost(&map, hexmap_index_to_coord(&map, i), HEXMAP_MOVEMENT_COST_MAX);
+		}
+	}
+
+	struct hexcoord origin = { .x=11, .y=9 };
+	hexmap_set_occupied_by(&map, origin, 1);
+	struct hexmap_flowfield flowfield;
+	hexmap_flowfield_init(&flowfield, &map, origin);
+	usize rebuilt[map_size];
+
+	for (int round = 0; round < 300; ++round) {
+		// a few tiles change between updates, sometimes the origin itself
+		const int changes = 1 + rng_i() % 4;
+		for (int change = 0; change < changes; ++change) {
+			const struct hexcoord coord = (rng_f() < 0.05f) ? origin : hexmap_index_to_coord(&map, rng_i() % map_size);
+			switch (rng_i() % 3) {
+			case 0:
+				hexmap_set_occupied_by(&map, coord, hexmap_occupied_by(&map, coord) ? 0 : 2);
+				break;
+			case 1:
+				hexmap_set_movement_cost(&map, coord, hexmap_is_tile_obstacle(&map, coord) ? 1 : HEXMAP_MOVEMENT_COST_MAX);
+				break;
+			default:
+				hexmap_set_movement_cost(&map, coord, 1 + rng_i() % 5);
+				break;
+			}
+		}
+
+		hexmap_flowfield_update(&flowfield, &map);
+		hexmap_generate_flowfield(&map, origin, map_size, rebuilt);
+		for (usize i = 0; i < map_size; ++i) {
+			const struct hexcoord coord = hexmap_index_to_coord(&map, i);
+			const usize expected = hexmap_flowfield_distance(&map, coord, map_size, rebuilt);
+			TEST_ASSERT(expected == hexmap_flowfield_distance(&map, coord, map_size, flowfield.came_from));
+			TEST_ASSERT(expected == ((flowfield.distance[i] == HEXMAP_FLOWFIELD_UNREACHABLE) ? (usize)-1 : flowfield.distance[i]));
+		}
+	}
+
+	hexmap_flowfield_destroy(&flowfield);
+	hexmap_destroy(&map);
+	TEST_SUCCESS;
+}
+
@@ -0,0 +1,118 @@
+#include "framework/testing.h"
+
+#include "server/timer_wheel.h"
+
+struct fired {
+	int count;
+	uint64_t at_ms[16];
+};
+
+static uint64_t g_now_ms;
+
+static void on_timer(void *userdata) {
+	struct fired *fired = userdata;
+	if (fired->count < 16) {
+		fired->at_ms[fired->count] = g_now_ms;
+	}
+	++fired->count;
+}
+
+TEST(timer_wheel_fires_when_due) {
+	struct timer_wheel wheel;
+	timer_wheel_init(&wheel, 1000, 10);
+	struct fired fired = {0};
+
+	g_now_ms = 1000;
+	TEST_ASSERT(timer_wheel_timeout_ms(&wheel, g_now_ms, 500) == 500);
+	TEST_ASSERT(timer_wheel_schedule(&wheel, g_now_ms, 45, 0, on_timer, &fired) != 0);
+	// rounded up to the next tick
+	TEST_ASSERT(timer_wheel_timeout_ms(&wheel, g_now_ms, 500) == 50);
+
+	for (g_now_ms = 1000; g_now_ms < 1049; g_now_ms += 7) {
+		timer_wheel_advance(&wheel, g_now_ms);
+	}
+	TEST_ASSERT(fired.count == 0);
+
+	g_now_ms = 1050;
+	timer_wheel_advance(&wheel, g_now_ms);
+	TEST_ASSERT(fired.count == 1);
+	TEST_ASSERT(timer_wheel_timeout_ms(&wheel, g_now_ms, 500) == 500);
+
+	// one-shot
+	g_now_ms = 2000;
+	timer_wheel_advance(&wheel, g_now_ms);
+	TEST_ASSERT(fired.count == 1);
+
+	timer_wheel_destroy(&wheel);
+	TEST_SUCCESS;
+}
+
+TEST(timer_wheel_repeats_and_cancels) {
+	struct timer_wheel wheel;
+	timer_wheel_init(&wheel, 0, 10);
+	struct fired repeating = {0}, cancelled = {0};
+
+	g_now_ms = 0;
+	const uint32_t repeating_id = timer_wheel_schedule(&wheel, g_now_ms, 20, 30, on_timer, &repeating);
+	const uint32_t cancelled_id = timer_wheel_schedule(&wheel, g_now_ms, 40, 0, on_timer, &cancelled);
+	TEST_ASSERT(repeating_id != cancelled_id);
+	timer_wheel_cancel(&wheel, cancelled_id);
+
+	for (g_now_ms = 0; g_now_ms <= 110; g_now_ms += 10) {
+		timer_wheel_advance(&wheel, g_now_ms);
+	}
+	// at 20, 50, 80, 110
+	TEST_ASSERT(repeating.count == 4);
+	TEST_ASSERT(repeating.at_ms[0] == 20);
+	TEST_ASSERT(repeating.at_ms[1] == 50);
+	TEST_ASSERT(repeating.at_ms[3] == 110);
+	TEST_ASSERT(cancelled.count == 0);
+
+	timer_wheel_cancel(&wheel, repeating_id);
+	for (; g_now_ms <= 300; g_now_ms += 10) {
+		timer_wheel_advance(&wheel, g_now_ms);
+	}
+	TEST_ASSERT(repeating.count == 4);
+	TEST_ASSERT(timer_wheel_timeout_ms(&wheel, g_now_ms, 500) == 500);
+
+	timer_wheel_destroy(&wheel);
+	TEST_SUCCESS;
+}
+
+TEST(timer_wheel_catches_up_after_stall) {
+	struct timer_wheel wheel;
+	timer_wheel_init(&wheel, 0, 10);
+	struct fired near = {0}, far = {0}, later = {0}, repeating = {0};
+
+	g_now_ms = 0;
+	timer_wheel_schedule(&wheel, g_now_ms, 30, 0, on_timer, &near);
+	// more than one revolution ahead, shares a slot with earlier ticks
+	timer_wheel_schedule(&wheel, g_now_ms, 10 * TIMER_WHEEL_SLOTS + 30, 0, on_timer, &far);
+	timer_wheel_schedule(&wheel, g_now_ms, 10 * TIMER_WHEEL_SLOTS * 3, 0, on_timer, &later);
+	timer_wheel_schedule(&wheel, g_now_ms, 10, 10, on_timer, &repeating);
+
+	// the first revolution only fires the near timer
+	g_now_ms = 100;
+	timer_wheel_advance(&wheel, g_now_ms);
+	TEST_ASSERT(near.count == 1);
+	TEST_ASSERT(far.count == 0);
+
+	// a stall longer than a revolution fires everything due, once
+	g_now_ms = 10 * TIMER_WHEEL_SLOTS * 2;
+	timer_wheel_advance(&wheel, g_now_ms);
+	TEST_ASSERT(near.count == 1);
+	TEST_ASSERT(far.count == 1);
+	TEST_ASSERT(later.count == 0);
+	// missed repeats are not made up for
+	TEST_ASSERT(repeating.count == 11);
+	g_now_ms += 10;
+	timer_wheel_advance(&wheel, g_now_ms);
+	TEST_ASSERT(repeating.count == 12);
+
+	g_now_ms = 10 * TIMER_WHEEL_SLOTS * 3;
+	timer_wheel_advance(&wheel, g_now_ms);
+	TEST_ASSERT(later.count == 1);
+
+	timer_wheel_destroy(&wheel);
+	TEST_SUCCESS;
+}
@@ -0,0 +1,97 @@
+#include "arena.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+// strictest alignment any allocation could need.
+union arena_align {
+	long double ld;
+	long long ll;
+	void *ptr;
+	void (*fn)(void);
+};
+
+struct arena_block {
+	struct arena_block *next;
+	size_t used;
+	size_t capacity;
+	union arena_align data[];
+};
+
+//
+// private functions
+//
+
+static size_t align_size(size_t size) {
+	const size_t alignment = sizeof(union arena_align);
+	return (size + alignment - 1) & ~(alignment - 1);
+}
+
+static struct arena_block *block_new(size_t capacity) {
+	struct arena_block *block = malloc(sizeof(*block) + capacity);
+	assert(block != NULL);
+	block->next = NULL;
+	block->used = 0;
+	block->capacity = capacity;
+	return block;
+}
+
+//
+// public api
+//
+
+void arena_init(struct arena *arena, size_t block_size) {
+	assert(arena != NULL);
+	assert(block_size > 0);
+	arena->block_size = align_size(block_size);
+	arena->first = NULL;
+	arena->current = NULL;
+}
+
+void arena_destroy(struct arena *arena) {
+	assert(arena != NULL);
+	struct arena_block *block = arena->first;
+	while (block != NULL) {
+		struct arena_block *next = block->next;
+		free(block);
+		block = next;
+	}
+	arena->first = NULL;
+	arena->current = NULL;
+}
+
+void arena_reset(struct arena *arena) {
+	assert(arena != NULL);
+	for (struct arena_block *block = arena->first; block != NULL; block = block->next) {
+		block->used = 0;
+	}
+	arena->current = arena->first;
+}
+
+void *arena_alloc(struct arena *arena, size_t size) {
+	assert(arena != NULL);
+	size = align_size(size);
+
+	// Blocks behind `current` are kept after a reset, try them before allocating.
+	struct arena_block *block = arena->current;
+	while (block != NULL && block->used + size > block->capacity) {
+		block = block->next;
+	}
+
+	if (block == NULL) {
+		block = block_new(size > arena->block_size ? size : arena->block_size);
+		if (arena->current == NULL) {
+			arena->first = block;
+		} else {
+			// insert after `current`, so reused blocks further down the chain stay reachable.
+			block->next = arena->current->next;
+			arena->current->next = block;
+		}
+	}
+
+	arena->current = block;
+	void *memory = (char *)block->data + block->used;
+	block->used += size;
+	return memory;
+}
+
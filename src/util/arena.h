@@ -0,0 +1,27 @@
+#ifndef CENGINE_ARENA_H
+#define CENGINE_ARENA_H
+
+#include <stddef.h>
+
+// Bump allocator for short lived data, e.g. everything computed during
+// one turn. Allocations are never freed individually, arena_reset()
+// releases all of them at once and keeps the memory for reuse.
+// Pointers stay valid until the next reset, the arena grows by
+// chaining blocks instead of reallocating.
+
+struct arena_block;
+
+struct arena {
+	size_t block_size;
+	struct arena_block *first;
+	struct arena_block *current;
+};
+
+void arena_init(struct arena *, size_t block_size);
+void arena_destroy(struct arena *);
+void arena_reset(struct arena *);
+
+void *arena_alloc(struct arena *, size_t size);
+
+#endif
+
@@ -0,0 +1,35 @@
+#ifndef CENGINE_BITSET_H
+#define CENGINE_BITSET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Packed array of bits, stored in 64 bit words.
+// Allocate `bitset_words(n)` words, e.g. with calloc().
+
+static inline size_t bitset_words(size_t bits) {
+	return (bits + 63) / 64;
+}
+
+static inline int bitset_get(const uint64_t *bitset, size_t index) {
+	return (bitset[index / 64] >> (index % 64)) & 1;
+}
+
+static inline void bitset_set(uint64_t *bitset, size_t index) {
+	bitset[index / 64] |= (uint64_t)1 << (index % 64);
+}
+
+static inline void bitset_clear(uint64_t *bitset, size_t index) {
+	bitset[index / 64] &= ~((uint64_t)1 << (index % 64));
+}
+
+static inline void bitset_assign(uint64_t *bitset, size_t index, int value) {
+	if (value) {
+		bitset_set(bitset, index);
+	} else {
+		bitset_clear(bitset, index);
+	}
+}
+
+#endif
+
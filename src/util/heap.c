@@ -0,0 +1,114 @@
+#include "heap.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+//
+// private functions
+//
+
+static int entry_less(const struct heap_entry *a, const struct heap_entry *b) {
+	return a->priority < b->priority || (a->priority == b->priority && a->id < b->id);
+}
+
+static void place(struct heap *heap, size_t index, struct heap_entry entry) {
+	heap->entries[index] = entry;
+	heap->positions[entry.id] = index;
+}
+
+static void sift_up(struct heap *heap, size_t index) {
+	const struct heap_entry entry = heap->entries[index];
+	while (index > 0) {
+		const size_t parent = (index - 1) / 2;
+		if (!entry_less(&entry, &heap->entries[parent])) break;
+
+		place(heap, index, heap->entries[parent]);
+		index = parent;
+	}
+	place(heap, index, entry);
+}
+
+static void sift_down(struct heap *heap, size_t index) {
+	const struct heap_entry entry = heap->entries[index];
+	for (;;) {
+		size_t child = index * 2 + 1;
+		if (child >= heap->len) break;
+		if (child + 1 < heap->len && entry_less(&heap->entries[child + 1], &heap->entries[child])) {
+			++child;
+		}
+		if (!entry_less(&heap->entries[child], &entry)) break;
+
+		place(heap, index, heap->entries[child]);
+		index = child;
+	}
+	place(heap, index, entry);
+}
+
+//
+// public api
+//
+
+void heap_init(struct heap *heap, size_t capacity) {
+	assert(heap != NULL);
+	assert(capacity > 0);
+
+	heap->len = 0;
+	heap->capacity = capacity;
+	heap->entries = malloc(capacity * sizeof(*heap->entries));
+	heap->positions = malloc(capacity * sizeof(*heap->positions));
+}
+
+void heap_destroy(struct heap *heap) {
+	assert(heap != NULL);
+
+	free(heap->entries);
+	free(heap->positions);
+	heap->entries = NULL;
+	heap->positions = NULL;
+	heap->len = heap->capacity = 0;
+}
+
+void heap_clear(struct heap *heap) {
+	assert(heap != NULL);
+	heap->len = 0;
+}
+
+void heap_push(struct heap *heap, size_t id, uint32_t priority) {
+	assert(heap != NULL);
+	assert(id < heap->capacity);
+	assert(heap->len < heap->capacity);
+
+	const size_t index = heap->len++;
+	heap->entries[index] = (struct heap_entry){ .priority = priority, .id = id };
+	sift_up(heap, index);
+}
+
+size_t heap_pop(struct heap *heap, uint32_t *OUT_priority) {
+	assert(heap != NULL);
+	assert(heap->len > 0);
+
+	const struct heap_entry top = heap->entries[0];
+	--heap->len;
+	if (heap->len > 0) {
+		heap->entries[0] = heap->entries[heap->len];
+		sift_down(heap, 0);
+	}
+
+	if (OUT_priority != NULL) {
+		*OUT_priority = top.priority;
+	}
+	return top.id;
+}
+
+void heap_decrease(struct heap *heap, size_t id, uint32_t priority) {
+	assert(heap != NULL);
+	assert(id < heap->capacity);
+
+	const size_t index = heap->positions[id];
+	assert(index < heap->len && heap->entries[index].id == id);
+	assert(priority <= heap->entries[index].priority);
+
+	heap->entries[index].priority = priority;
+	sift_up(heap, index);
+}
+
@@ -0,0 +1,33 @@
+#ifndef CENGINE_HEAP_H
+#define CENGINE_HEAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Indexed binary min-heap over ids in [0, capacity).
+// Every id can be in the heap at most once, which allows lowering
+// its priority in-place. Equal priorities pop the smaller id first.
+
+struct heap_entry {
+	uint32_t priority;
+	size_t id;
+};
+
+struct heap {
+	size_t len;
+	size_t capacity;
+	struct heap_entry *entries;
+	// index into `entries`, only valid while the id is in the heap.
+	size_t *positions;
+};
+
+void heap_init(struct heap *, size_t capacity);
+void heap_destroy(struct heap *);
+void heap_clear(struct heap *);
+
+void heap_push(struct heap *, size_t id, uint32_t priority);
+size_t heap_pop(struct heap *, uint32_t *OUT_priority);
+void heap_decrease(struct heap *, size_t id, uint32_t priority);
+
+#endif
+
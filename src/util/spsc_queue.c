@@ -0,0 +1,64 @@
+#include "util/spsc_queue.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+void spsc_queue_init(struct spsc_queue *queue, int capacity) {
+	assert(queue != NULL);
+	assert(capacity >= 2 && (capacity & (capacity - 1)) == 0);
+
+	*queue = (struct spsc_queue){ 0 };
+	queue->capacity = capacity;
+	queue->items = malloc(capacity * sizeof(*queue->items));
+	SDL_AtomicSet(&queue->head, 0);
+	SDL_AtomicSet(&queue->tail, 0);
+}
+
+void spsc_queue_destroy(struct spsc_queue *queue) {
+	assert(queue != NULL);
+	free(queue->items);
+	*queue = (struct spsc_queue){ 0 };
+}
+
+int spsc_queue_push(struct spsc_queue *queue, void *item) {
+	assert(queue != NULL);
+	assert(item != NULL);
+
+	const int tail = SDL_AtomicGet(&queue->tail);
+	const int next = (tail + 1) & (queue->capacity - 1);
+	if (next == SDL_AtomicGet(&queue->head)) {
+		return 0;
+	}
+	// the consumer is done with the slot.
+	SDL_MemoryBarrierAcquire();
+
+	queue->items[tail] = item;
+	// the item is visible before the new tail.
+	SDL_MemoryBarrierRelease();
+	SDL_AtomicSet(&queue->tail, next);
+	return 1;
+}
+
+// Exact for the producer, only the consumer can make room.
+int spsc_queue_is_full(struct spsc_queue *queue) {
+	assert(queue != NULL);
+	const int next = (SDL_AtomicGet(&queue->tail) + 1) & (queue->capacity - 1);
+	return (next == SDL_AtomicGet(&queue->head));
+}
+
+void *spsc_queue_pop(struct spsc_queue *queue) {
+	assert(queue != NULL);
+
+	const int head = SDL_AtomicGet(&queue->head);
+	if (head == SDL_AtomicGet(&queue->tail)) {
+		return NULL;
+	}
+	// see the item the producer stored before the tail.
+	SDL_MemoryBarrierAcquire();
+
+	void *item = queue->items[head];
+	// the slot is read before the producer can reuse it.
+	SDL_MemoryBarrierRelease();
+	SDL_AtomicSet(&queue->head, (head + 1) & (queue->capacity - 1));
+	return item;
+}
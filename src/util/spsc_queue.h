@@ -0,0 +1,35 @@
+#ifndef CENGINE_SPSC_QUEUE_H
+#define CENGINE_SPSC_QUEUE_H
+
+#include <SDL.h>
+
+// Bounded lock-free queue of pointers between exactly two threads, one
+// pushing and one popping. Holds at most `capacity - 1` items.
+//
+// Each index is only written by its own side, the other side only reads
+// it. SDL_AtomicSet() alone does not order the item around the index, so
+// an explicit release barrier comes before every index store and an
+// acquire barrier after reading the other side's index.
+
+struct spsc_queue {
+	int capacity;
+	void **items;
+	// next slot to pop, written by the consumer.
+	SDL_atomic_t head;
+	char _padding[64 - sizeof(SDL_atomic_t)];
+	// next slot to push, written by the producer.
+	SDL_atomic_t tail;
+};
+
+// `capacity` must be a power of two.
+void spsc_queue_init(struct spsc_queue *, int capacity);
+void spsc_queue_destroy(struct spsc_queue *);
+
+// producer side, returns 0 and keeps the item if the queue is full.
+int spsc_queue_push(struct spsc_queue *, void *item);
+int spsc_queue_is_full(struct spsc_queue *);
+
+// consumer side, returns NULL if the queue is empty.
+void *spsc_queue_pop(struct spsc_queue *);
+
+#endif